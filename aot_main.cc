@@ -0,0 +1,36 @@
+/**
+ * Ahead-of-time compiler: LispKit program in, C++ source out (see
+ * src/cpp_backend.hpp). Build the result together with the
+ * lispkit_runtime library.
+ */
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "interpreter.hpp"
+
+int main(int argc, char** argv) {
+    if(argc != 3){
+        std::cerr << "usage: lispkit_aot program.lisp output.cpp" << std::endl;
+        return 2;
+    }
+    std::ifstream input{argv[1], std::ios::binary};
+    if(!input){
+        std::cerr << "lispkit_aot: cannot open " << argv[1] << std::endl;
+        return 2;
+    }
+    std::stringstream messages;
+    yy::Interpreter interpreter;
+    interpreter.set_file_name(argv[1]);
+    interpreter.switch_streams(&input, &messages);
+    if(interpreter.parse() != 0 || interpreter.is_error()){
+        std::cerr << messages.str();
+        return 1;
+    }
+    interpreter.compile_cpp(argv[2]);
+    if(interpreter.is_error()){
+        std::cerr << messages.str();
+        return 1;
+    }
+    return 0;
+}
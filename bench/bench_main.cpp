@@ -0,0 +1,543 @@
+/**
+ * Benchmarks for every stage of the pipeline: lexer, parser, tree-walking
+ * interpreter, SECD compiler, SECD machine and register machine (compiled
+ * and run). Each program of the corpus is run through the stages
+ * separately, a warm-up run first, then --repeat timed runs. Without
+ * file arguments the corpus is extended with generated programs
+ * (program_generator.hpp), one per combination of --gen-size and
+ * --gen-depth values, to chart how the stages scale. Allocations are
+ * counted on the first timed run, peak RSS is the process-wide maximum
+ * at the end of the stage.
+ *
+ * The results of the SECD and register machines are checked against the
+ * tree-walking interpreter, or against each other when it does not run.
+ * It has no closures over outer variables, so the programs that need
+ * them are in corpus/closures, outside the default corpus; pass them as
+ * files with --stages compile,secd,register.
+ *
+ * Output is one JSON object per line (--format json, default) or a table
+ * (--format text).
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define LISPKIT_HAS_RUSAGE
+#endif
+
+#include "interpreter.hpp"
+#include "alloc_stats.hpp"
+#include "program_generator.hpp"
+
+#ifndef LISPKIT_BENCH_CORPUS
+#define LISPKIT_BENCH_CORPUS "bench/corpus"
+#endif
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+
+    const std::vector<std::string> all_stages = {"lex", "parse", "execute", "compile", "secd", "register"};
+
+    struct options{
+        int repeat = 5;
+        std::vector<std::string> stages = all_stages;
+        std::string format = "json";
+        std::filesystem::path corpus = LISPKIT_BENCH_CORPUS;
+        std::vector<std::filesystem::path> files;
+        std::vector<std::size_t> generated_sizes = {20000};
+        std::vector<std::size_t> generated_depths = {50};
+        bench::generator_options generator;
+        bool profile = false;
+        std::filesystem::path flame_graph;
+        yy::resource_limits limits;   // для execute и secd
+        bool jit = false;
+    };
+
+    struct program{
+        std::string name;
+        std::string source;
+    };
+
+    struct stage_result{
+        std::string program;
+        std::string stage;
+        std::size_t source_bytes = 0;
+        std::vector<std::int64_t> times_ns;
+        std::uint64_t allocations = 0;
+        std::uint64_t allocated_bytes = 0;
+        std::int64_t peak_live_bytes = 0;
+        long peak_rss_kb = 0;
+        std::size_t tokens = 0;  // только для lex
+        bool ok = true;
+        std::string output;     // вывод прогрева
+    };
+
+    // все записи в поток без буфера игнорируются
+    std::ostream null_stream{nullptr};
+
+    long peak_rss_kb() {
+#ifdef LISPKIT_HAS_RUSAGE
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024; // на macOS в байтах
+#else
+        return usage.ru_maxrss;
+#endif
+#else
+        return 0;
+#endif
+    }
+
+    std::string trim(const std::string& str) {
+        auto begin = str.find_first_not_of(" \t\n");
+        if(begin == std::string::npos)
+            return {};
+        auto end = str.find_last_not_of(" \t\n");
+        return str.substr(begin, end - begin + 1);
+    }
+
+    bool has_error_message(const std::string& output) {
+        return output.find("Execution error") != std::string::npos ||
+               output.find("Error in compiling") != std::string::npos ||
+               output.find(": error: ") != std::string::npos;
+    }
+
+    /**
+     * prepare(output) builds the untimed state of one run,
+     * run(state) is the measured part and returns false on failure.
+     */
+    template<typename Prepare, typename Run>
+    stage_result measure(const options& opts, Prepare&& prepare, Run&& run) {
+        stage_result result;
+        for(int i = -1; i < opts.repeat; i++){
+            std::ostringstream warm_up_output;
+            std::ostream& output = i < 0 ? static_cast<std::ostream&>(warm_up_output) : null_stream;
+            auto state = prepare(output);
+
+            alloc_stats::reset_peak();
+            auto before = alloc_stats::current();
+            auto start = clock_type::now();
+            bool ok = run(*state);
+            auto elapsed = clock_type::now() - start;
+            auto after = alloc_stats::current();
+
+            if(i < 0){
+                result.output = warm_up_output.str();
+                result.ok = ok && !has_error_message(result.output);
+                continue;
+            }
+            result.times_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            if(i == 0){
+                result.allocations = after.allocations - before.allocations;
+                result.allocated_bytes = after.allocated_bytes - before.allocated_bytes;
+                result.peak_live_bytes = after.peak_live_bytes - before.live_bytes;
+            }
+        }
+        result.peak_rss_kb = peak_rss_kb();
+        return result;
+    }
+
+    struct lex_state{
+        std::istringstream input;
+        yy::Interpreter driver;
+        yy::Scanner scanner{driver};
+    };
+
+    struct parse_state{
+        std::istringstream input;
+        yy::Interpreter interpreter;
+    };
+
+    // программа уже разобрана, поток вывода - output
+    std::unique_ptr<parse_state> make_parsed(const std::string& source, std::ostream& output, bool check_arguments,
+                                             const yy::resource_limits& limits = {}) {
+        auto state = std::make_unique<parse_state>();
+        state->input.str(source);
+        state->interpreter.check_number_of_arguments = check_arguments;
+        state->interpreter.limits = limits;
+        state->interpreter.switch_streams(&state->input, &null_stream);
+        state->interpreter.parse();
+        state->interpreter.switch_streams(nullptr, &output);
+        return state;
+    }
+
+    stage_result run_stage(const options& opts, const program& prog, const std::string& stage, const std::string& secd_code) {
+        stage_result result;
+        if(stage == "lex"){
+            std::size_t tokens = 0;
+            result = measure(opts, [&](std::ostream& output){
+                auto state = std::make_unique<lex_state>();
+                state->input.str(prog.source);
+                state->driver.switch_streams(nullptr, &output);
+                state->scanner.switch_streams(&state->input, &output);
+                return state;
+            }, [&](lex_state& state){
+                tokens = 0;
+                while(state.scanner.get_next_token().kind() != yy::Parser::symbol_kind::S_YYEOF)
+                    tokens++;
+                return true;
+            });
+            result.tokens = tokens;
+        }
+        else if(stage == "parse"){
+            result = measure(opts, [&](std::ostream& output){
+                auto state = std::make_unique<parse_state>();
+                state->input.str(prog.source);
+                state->interpreter.switch_streams(&state->input, &output);
+                return state;
+            }, [](parse_state& state){
+                return state.interpreter.parse() == 0 && !state.interpreter.is_error();
+            });
+        }
+        else if(stage == "execute" || stage == "compile" || stage == "register"){
+            result = measure(opts, [&](std::ostream& output){
+                return make_parsed(prog.source, output, true, opts.limits);
+            }, [&](parse_state& state){
+                if(stage == "execute")
+                    state.interpreter.execute();
+                else if(stage == "compile")
+                    state.interpreter.compile();
+                else
+                    state.interpreter.execute_register();
+                return !state.interpreter.is_error();
+            });
+        }
+        else if(stage == "secd"){
+            result = measure(opts, [&](std::ostream& output){
+                auto state = make_parsed(secd_code, output, false, opts.limits);
+                state->interpreter.jit = opts.jit;
+                return state;
+            }, [](parse_state& state){
+                state.interpreter.execute_secd();
+                return !state.interpreter.is_error();
+            });
+        }
+        else{
+            throw std::invalid_argument{"unknown stage " + stage};
+        }
+        result.program = prog.name;
+        result.stage = stage;
+        result.source_bytes = stage == "secd" ? secd_code.size() : prog.source.size();
+        return result;
+    }
+
+    std::string read_file(const std::filesystem::path& path) {
+        std::ifstream file{path, std::ios::binary};
+        if(!file)
+            throw std::runtime_error{"cannot open " + path.string()};
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+
+    std::vector<program> load_programs(const options& opts) {
+        std::vector<program> programs;
+        auto files = opts.files;
+        if(files.empty() && std::filesystem::is_directory(opts.corpus)){
+            for(auto&& entry : std::filesystem::directory_iterator{opts.corpus})
+                if(entry.is_regular_file() && entry.path().extension() == ".lisp")
+                    files.push_back(entry.path());
+            std::sort(files.begin(), files.end());
+        }
+        for(auto&& file : files)
+            programs.push_back({file.stem().string(), read_file(file)});
+        if(opts.files.empty()){
+            for(auto size : opts.generated_sizes){
+                for(auto depth : opts.generated_depths){
+                    auto generator = opts.generator;
+                    generator.size = size;
+                    generator.depth = depth;
+                    programs.push_back({"generated_s" + std::to_string(size) + "_d" + std::to_string(depth),
+                                        bench::generate_program(generator)});
+                }
+            }
+        }
+        return programs;
+    }
+
+    std::string json_escape(const std::string& str) {
+        std::string escaped;
+        for(char c : str){
+            switch(c){
+                case '"': escaped += "\\\""; break;
+                case '\\': escaped += "\\\\"; break;
+                case '\n': escaped += "\\n"; break;
+                case '\t': escaped += "\\t"; break;
+                default:
+                    if(static_cast<unsigned char>(c) < 0x20){
+                        char buffer[8];
+                        std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                        escaped += buffer;
+                    }
+                    else
+                        escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    struct summary{
+        std::int64_t min = 0;
+        std::int64_t median = 0;
+        std::int64_t mean = 0;
+    };
+
+    summary summarize(std::vector<std::int64_t> times) {
+        if(times.empty())
+            return {};
+        std::sort(times.begin(), times.end());
+        std::int64_t total = 0;
+        for(auto time : times)
+            total += time;
+        return {times.front(), times[times.size() / 2], total / static_cast<std::int64_t>(times.size())};
+    }
+
+    void print_json(std::ostream& out, const stage_result& result, const std::string& extra) {
+        auto times = summarize(result.times_ns);
+        out << "{\"program\":\"" << json_escape(result.program) << "\""
+            << ",\"stage\":\"" << result.stage << "\""
+            << ",\"source_bytes\":" << result.source_bytes
+            << ",\"runs\":" << result.times_ns.size()
+            << ",\"min_ns\":" << times.min
+            << ",\"median_ns\":" << times.median
+            << ",\"mean_ns\":" << times.mean
+            << ",\"allocations\":" << result.allocations
+            << ",\"allocated_bytes\":" << result.allocated_bytes
+            << ",\"peak_live_bytes\":" << result.peak_live_bytes
+            << ",\"peak_rss_kb\":" << result.peak_rss_kb
+            << (result.stage == "lex" ? ",\"tokens\":" + std::to_string(result.tokens) : "")
+            << ",\"ok\":" << (result.ok ? "true" : "false")
+            << extra << "}" << std::endl;
+    }
+
+    void print_text_header(std::ostream& out) {
+        out << std::left << std::setw(24) << "program" << std::setw(9) << "stage"
+            << std::right << std::setw(14) << "median us" << std::setw(14) << "min us"
+            << std::setw(12) << "allocs" << std::setw(14) << "alloc bytes"
+            << std::setw(12) << "peak RSS kB" << "  status" << std::endl;
+    }
+
+    void print_text(std::ostream& out, const stage_result& result, const std::string& extra) {
+        auto times = summarize(result.times_ns);
+        out << std::left << std::setw(24) << result.program << std::setw(9) << result.stage
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(14) << static_cast<double>(times.median) / 1000
+            << std::setw(14) << static_cast<double>(times.min) / 1000
+            << std::setw(12) << result.allocations << std::setw(14) << result.allocated_bytes
+            << std::setw(12) << result.peak_rss_kb
+            << "  " << (result.ok ? "ok" : "FAILED") << extra << std::endl;
+    }
+
+    // отдельный прогон: профилирование замедляет машину и не должно попадать в замеры
+    void print_profile(std::ostream& out, const program& prog, const std::string& secd_code, const options& opts) {
+        bool text = opts.format == "text";
+        auto state = make_parsed(secd_code, null_stream, false, opts.limits);
+        state->interpreter.profile_secd = true;
+        state->interpreter.execute_secd();
+        auto&& profile = state->interpreter.get_secd_profile();
+        if(text){
+            out << prog.name << ' ';
+            profile.report_text(out);
+        }
+        else{
+            out << "{\"program\":\"" << json_escape(prog.name) << "\",\"stage\":\"secd_profile\",\"profile\":";
+            profile.report_json(out);
+            out << '}' << std::endl;
+        }
+    }
+
+    // корневой кадр - имя программы, так все программы помещаются в один граф
+    void sample_execute(std::ostream& out, const program& prog, const options& opts) {
+        auto state = make_parsed(prog.source, null_stream, true, opts.limits);
+        state->interpreter.set_file_name(prog.name);
+        state->interpreter.profile_execute = true;
+        state->interpreter.get_sampling_profiler().set_interval(std::chrono::microseconds{100});
+        state->interpreter.execute();
+        state->interpreter.get_sampling_profiler().write_collapsed(out);
+    }
+
+    std::vector<std::string> split(const std::string& str, char separator) {
+        std::vector<std::string> parts;
+        std::istringstream input{str};
+        std::string part;
+        while(std::getline(input, part, separator))
+            if(!part.empty())
+                parts.push_back(part);
+        return parts;
+    }
+
+    std::vector<std::size_t> split_sizes(const std::string& str) {
+        std::vector<std::size_t> sizes;
+        for(auto&& part : split(str, ','))
+            if(auto size = std::stoull(part); size > 0)
+                sizes.push_back(size);
+        return sizes;
+    }
+
+    void usage(std::ostream& out) {
+        out << "usage: lispkit_bench [options] [file.lisp...]\n"
+               "  --repeat N         timed runs per stage (default 5)\n"
+               "  --stages LIST      comma separated subset of lex,parse,execute,compile,secd,register\n"
+               "  --format FMT       json (one object per line, default) or text\n"
+               "  --corpus DIR       directory with *.lisp programs (default " LISPKIT_BENCH_CORPUS ")\n"
+               "  --gen-size LIST    comma separated sizes of generated programs, 0 disables them (default 20000)\n"
+               "  --gen-depth LIST   comma separated nesting depths of generated programs (default 50)\n"
+               "  --gen-list-length N, --gen-let P, --gen-lambda P, --seed N\n"
+               "                     other generator options, see lispkit_gen --help\n"
+               "  --profile          after the stages run the SECD program once more with\n"
+               "                     per-instruction profiling and print the profile\n"
+               "  --flame FILE       sample one more execute run of every program and write\n"
+               "                     the collapsed stacks (flame graph input) to FILE\n"
+               "  --max-steps N, --max-heap BYTES, --max-depth N, --max-stack BYTES, --timeout-ms N\n"
+               "                     resource limits of every execute, secd and register run, a program\n"
+               "                     over a limit is reported as failed and the next one runs\n"
+               "  --jit              compile hot closures of the secd stage to native code\n";
+    }
+
+    options parse_options(int argc, char** argv) {
+        options opts;
+        for(int i = 1; i < argc; i++){
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if(i + 1 >= argc)
+                    throw std::invalid_argument{"missing value for " + arg};
+                return argv[++i];
+            };
+            if(arg == "--repeat")
+                opts.repeat = std::max(1, std::stoi(value()));
+            else if(arg == "--stages")
+                opts.stages = split(value(), ',');
+            else if(arg == "--format")
+                opts.format = value();
+            else if(arg == "--corpus")
+                opts.corpus = value();
+            else if(arg == "--gen-size")
+                opts.generated_sizes = split_sizes(value());
+            else if(arg == "--gen-depth")
+                opts.generated_depths = split_sizes(value());
+            else if(arg == "--gen-list-length")
+                opts.generator.list_length = std::stoull(value());
+            else if(arg == "--gen-let")
+                opts.generator.let_density = std::stod(value());
+            else if(arg == "--gen-lambda")
+                opts.generator.lambda_density = std::stod(value());
+            else if(arg == "--profile")
+                opts.profile = true;
+            else if(arg == "--flame")
+                opts.flame_graph = value();
+            else if(arg == "--max-steps")
+                opts.limits.max_steps = std::stoull(value());
+            else if(arg == "--max-heap")
+                opts.limits.max_heap_bytes = std::stoull(value());
+            else if(arg == "--max-depth")
+                opts.limits.max_depth = std::stoull(value());
+            else if(arg == "--max-stack")
+                opts.limits.max_stack_bytes = std::stoull(value());
+            else if(arg == "--timeout-ms")
+                opts.limits.timeout = std::chrono::milliseconds{std::stoll(value())};
+            else if(arg == "--jit")
+                opts.jit = true;
+            else if(arg == "--seed")
+                opts.generator.seed = std::stoull(value());
+            else if(arg == "--help" || arg == "-h"){
+                usage(std::cout);
+                std::exit(0);
+            }
+            else if(arg.starts_with("--"))
+                throw std::invalid_argument{"unknown option " + arg};
+            else
+                opts.files.emplace_back(arg);
+        }
+        for(auto&& stage : opts.stages)
+            if(std::find(all_stages.begin(), all_stages.end(), stage) == all_stages.end())
+                throw std::invalid_argument{"unknown stage " + stage};
+        if(opts.format != "json" && opts.format != "text")
+            throw std::invalid_argument{"unknown format " + opts.format};
+        return opts;
+    }
+}
+
+int main(int argc, char** argv) {
+    options opts;
+    std::vector<program> programs;
+    try{
+        opts = parse_options(argc, argv);
+        programs = load_programs(opts);
+    }
+    catch(const std::exception& ex){
+        std::cerr << "lispkit_bench: " << ex.what() << std::endl;
+        usage(std::cerr);
+        return 2;
+    }
+
+    auto wants = [&](const std::string& stage){
+        return std::find(opts.stages.begin(), opts.stages.end(), stage) != opts.stages.end();
+    };
+    bool text = opts.format == "text";
+    if(text)
+        print_text_header(std::cout);
+
+    std::ofstream flame_output;
+    if(!opts.flame_graph.empty()){
+        flame_output.open(opts.flame_graph);
+        if(!flame_output){
+            std::cerr << "lispkit_bench: cannot open " << opts.flame_graph << std::endl;
+            return 2;
+        }
+    }
+
+    bool all_ok = true;
+    for(auto&& prog : programs){
+        // для secd нужен код компилятора; результаты машин сверяются с интерпретатором,
+        // а без него (замыкания, --stages без execute) - с первой из машин
+        std::string secd_code;
+        std::string expected;
+        std::string expected_from;
+        if(wants("secd")){
+            std::ostringstream output;
+            make_parsed(prog.source, output, true)->interpreter.compile();
+            secd_code = trim(output.str());
+        }
+        for(auto&& stage : opts.stages){
+            auto result = run_stage(opts, prog, stage, secd_code);
+            std::string extra;
+            bool machine = stage == "secd" || stage == "register";
+            if(stage == "execute" || (machine && expected_from.empty())){
+                if(result.ok){
+                    expected = trim(result.output);
+                    expected_from = stage;
+                }
+            }
+            else if(machine){
+                bool matches = trim(result.output) == expected;
+                extra = text ? (matches ? "" : " (result differs from " + expected_from + ")")
+                             : ",\"matches_" + expected_from + "\":" + (matches ? "true" : "false");
+                result.ok = result.ok && matches;
+            }
+            all_ok = all_ok && result.ok;
+            if(text)
+                print_text(std::cout, result, extra);
+            else
+                print_json(std::cout, result, extra);
+        }
+        if(opts.profile && wants("secd"))
+            print_profile(std::cout, prog, secd_code, opts);
+        if(flame_output.is_open())
+            sample_execute(flame_output, prog, opts);
+    }
+    return all_ok ? 0 : 1;
+}
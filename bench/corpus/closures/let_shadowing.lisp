@@ -0,0 +1,7 @@
+(LET (F N)
+    (F (LAMBDA (X)
+        (LET (Y N X)
+            (N (QUOTE 9))
+            (X (QUOTE 1))
+            (Y (LAMBDA (A B) (ADD X (ADD A B)))))))
+    (N (QUOTE 5)))
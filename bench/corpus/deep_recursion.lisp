@@ -0,0 +1,6 @@
+(LET (SUM SUM N)
+    (SUM (LAMBDA (SELF N)
+        (COND (LEQ N (QUOTE 0))
+            (QUOTE 0)
+            (ADD N (SELF SELF (SUB N (QUOTE 1)))))))
+    (N (QUOTE 2000)))
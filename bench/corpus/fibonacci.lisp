@@ -0,0 +1,7 @@
+(LET (FIB FIB N)
+    (FIB (LAMBDA (SELF N)
+        (COND (LEQ N (QUOTE 1))
+            N
+            (ADD (SELF SELF (SUB N (QUOTE 1)))
+                 (SELF SELF (SUB N (QUOTE 2)))))))
+    (N (QUOTE 18)))
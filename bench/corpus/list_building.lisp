@@ -0,0 +1,12 @@
+(LET (SUM SUM LIST N)
+    (SUM (LAMBDA (SELF L N)
+        (COND (LEQ N (QUOTE 1))
+            (CAR L)
+            (ADD (CAR L) (SELF SELF (CDR L) (SUB N (QUOTE 1)))))))
+    (LIST (LET (BUILD BUILD N)
+        (BUILD (LAMBDA (SELF N)
+            (COND (LEQ N (QUOTE 1))
+                (CONS N (QUOTE ()))
+                (CONS N (SELF SELF (SUB N (QUOTE 1)))))))
+        (N (QUOTE 300))))
+    (N (QUOTE 300)))
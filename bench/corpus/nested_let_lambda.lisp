@@ -0,0 +1,16 @@
+(LET (LOOP LOOP SQUARE STEP N)
+    (LOOP (LAMBDA (SELF SQUARE STEP N)
+        (COND (LEQ N (QUOTE 0))
+            (QUOTE 0)
+            (ADD (SQUARE (STEP N))
+                 (SELF SELF SQUARE STEP (SUB N (QUOTE 1)))))))
+    (SQUARE (LAMBDA (X)
+        (LET (TIMES X X)
+            (TIMES (LAMBDA (A B) (MUL A B)))
+            (X X))))
+    (STEP (LAMBDA (X)
+        (LET (PLUS X ONE)
+            (PLUS (LAMBDA (A B) (ADD A B)))
+            (X X)
+            (ONE (QUOTE 1)))))
+    (N (QUOTE 500)))
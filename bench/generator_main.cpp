@@ -0,0 +1,58 @@
+/**
+ * Prints a synthetic LispKit program, see program_generator.hpp.
+ * The output can be fed to lispkit_bench as a file argument.
+ */
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "program_generator.hpp"
+
+namespace {
+    void usage(std::ostream& out) {
+        out << "usage: lispkit_gen [options]\n"
+               "  --seed N          random seed (default 1)\n"
+               "  --size N          approximate number of nodes (default 20000)\n"
+               "  --depth N         nesting depth of each spine (default 50)\n"
+               "  --list-length N   length of generated lists (default 4)\n"
+               "  --let P           probability of a LET level (default 0.2)\n"
+               "  --lambda P        probability of a LAMBDA level (default 0.1)\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    bench::generator_options options;
+    try{
+        for(int i = 1; i < argc; i++){
+            std::string arg = argv[i];
+            if(arg == "--help" || arg == "-h"){
+                usage(std::cout);
+                return 0;
+            }
+            if(i + 1 >= argc)
+                throw std::invalid_argument{"missing value for " + arg};
+            std::string value = argv[++i];
+            if(arg == "--seed")
+                options.seed = std::stoull(value);
+            else if(arg == "--size")
+                options.size = std::stoull(value);
+            else if(arg == "--depth")
+                options.depth = std::stoull(value);
+            else if(arg == "--list-length")
+                options.list_length = std::stoull(value);
+            else if(arg == "--let")
+                options.let_density = std::stod(value);
+            else if(arg == "--lambda")
+                options.lambda_density = std::stod(value);
+            else
+                throw std::invalid_argument{"unknown option " + arg};
+        }
+    }
+    catch(const std::exception& ex){
+        std::cerr << "lispkit_gen: " << ex.what() << std::endl;
+        usage(std::cerr);
+        return 2;
+    }
+    std::cout << bench::generate_program(options) << std::endl;
+    return 0;
+}
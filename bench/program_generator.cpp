@@ -0,0 +1,214 @@
+#include "program_generator.hpp"
+
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace bench;
+
+namespace {
+    class generator {
+    public:
+        explicit generator(const generator_options& options) :
+                options(options),
+                random(options.seed),
+                list_length(options.list_length == 0 ? 1 : options.list_length)
+        {}
+
+        std::string program() {
+            std::vector<std::string> spines;
+            while(spines.empty() || nodes < options.size)
+                spines.push_back(spine());
+            // сбалансированное дерево сложений, без рекурсии
+            while(spines.size() > 1){
+                std::vector<std::string> sums;
+                for(std::size_t i = 0; i + 1 < spines.size(); i += 2){
+                    sums.push_back("(ADD " + spines[i] + ' ' + spines[i + 1] + ')');
+                    nodes += 2;
+                }
+                if(spines.size() % 2 == 1)
+                    sums.push_back(std::move(spines.back()));
+                spines = std::move(sums);
+            }
+            return std::move(spines.front());
+        }
+
+    private:
+        std::uint64_t below(std::uint64_t bound) {
+            return random() % bound;
+        }
+
+        bool chance(double probability) {
+            return static_cast<double>(random() >> 11) * 0x1.0p-53 < probability;
+        }
+
+        std::string fresh_name(const char* prefix) {
+            return prefix + std::to_string(next_name++);
+        }
+
+        std::string number(std::uint64_t from, std::uint64_t to) {
+            nodes += 3;
+            return "(QUOTE " + std::to_string(from + below(to - from + 1)) + ')';
+        }
+
+        std::string leaf() {
+            if(!scope.empty() && below(2) == 0){
+                nodes++;
+                return scope[below(scope.size())];
+            }
+            return number(0, 99);
+        }
+
+        static std::string repeat(const char* str, std::size_t count) {
+            std::string result;
+            for(std::size_t i = 0; i < count; i++)
+                result += str;
+            return result;
+        }
+
+        // небольшое выражение глубины не больше depth, значение - число
+        std::string small(int depth) {
+            if(depth == 0)
+                return leaf();
+            switch(below(7)){
+                case 1:
+                    nodes += 2;
+                    return "(ADD " + small(depth - 1) + ' ' + small(depth - 1) + ')';
+                case 2:
+                    nodes += 2;
+                    return "(SUB " + small(depth - 1) + ' ' + small(depth - 1) + ')';
+                case 3:
+                    nodes += 2;
+                    return "(MUL " + small(depth - 1) + ' ' + number(1, 9) + ')';
+                case 4:
+                    nodes += 2;
+                    return "(REM " + small(depth - 1) + ' ' + number(1, 9) + ')';
+                case 5:{
+                    nodes += 4;
+                    auto condition = "(LEQ " + small(depth - 1) + ' ' + small(depth - 1) + ')';
+                    return "(COND " + condition + ' ' + small(depth - 1) + ' ' + small(depth - 1) + ')';
+                }
+                case 6:{
+                    auto index = below(list_length);
+                    std::string elements;
+                    for(std::size_t i = 0; i < list_length; i++)
+                        elements += (i == 0 ? "" : " ") + std::to_string(below(100));
+                    nodes += 2 + 2 * index + 3 + list_length;
+                    return "(CAR " + repeat("(CDR ", index) + "(QUOTE (" + elements + "))" + repeat(")", index) + ')';
+                }
+                default:
+                    return leaf();
+            }
+        }
+
+        /**
+         * Nested levels are collected as prefix/suffix pairs and joined at
+         * the end, so deep spines do not recurse in the generator itself.
+         */
+        std::string spine() {
+            auto saved_scope = scope;
+            std::string prefix;
+            std::vector<std::string> suffixes;
+            for(std::size_t level = 0; level < options.depth; level++){
+                if(chance(options.lambda_density)){
+                    auto function = fresh_name("F");
+                    auto argument = fresh_name("A");
+                    if(below(2) == 0){
+                        // вложенная часть - тело функции
+                        auto parameter = fresh_name("X");
+                        auto value = small(1);
+                        nodes += 11;
+                        prefix += "(LET (" + function + ' ' + argument + ") (" + function + " (LAMBDA (" + parameter + ") ";
+                        suffixes.push_back(")) (" + argument + ' ' + value + "))");
+                        scope = {parameter};
+                    }
+                    else{
+                        // вложенная часть - аргумент вызова
+                        auto second_argument = fresh_name("B");
+                        auto x = fresh_name("X");
+                        auto y = fresh_name("Y");
+                        auto outer_scope = std::exchange(scope, {x, y});
+                        nodes += 2;
+                        auto body = "(ADD " + small(1) + ' ' + small(1) + ')';
+                        scope = std::move(outer_scope);
+                        auto value = small(1);
+                        nodes += 15;
+                        prefix += "(LET (" + function + ' ' + argument + ' ' + second_argument + ") (" + function +
+                                  " (LAMBDA (" + x + ' ' + y + ") " + body + ")) (" + argument + ' ';
+                        suffixes.push_back(") (" + second_argument + ' ' + value + "))");
+                    }
+                }
+                else if(chance(options.let_density)){
+                    auto first = fresh_name("V");
+                    auto second = fresh_name("W");
+                    auto value = small(1);
+                    nodes += 10;
+                    prefix += std::string{"(LET ("} + (below(2) == 0 ? "ADD " : "SUB ") + first + ' ' + second +
+                              ") (" + first + ' ';
+                    suffixes.push_back(") (" + second + ' ' + value + "))");
+                }
+                else switch(below(4)){
+                    case 0:
+                        nodes += 2;
+                        prefix += "(ADD ";
+                        suffixes.push_back(' ' + small(2) + ')');
+                        break;
+                    case 1:
+                        nodes += 2;
+                        prefix += "(SUB " + small(2) + ' ';
+                        suffixes.push_back(")");
+                        break;
+                    case 2:{
+                        // условие всегда выбирает вложенную часть, чтобы она исполнялась целиком
+                        nodes += 10;
+                        auto low = below(50);
+                        auto high = 50 + below(50);
+                        if(below(2) == 0){
+                            prefix += "(COND (LEQ (QUOTE " + std::to_string(low) + ") (QUOTE " + std::to_string(high) + ")) ";
+                            suffixes.push_back(' ' + small(2) + ')');
+                        }
+                        else{
+                            prefix += "(COND (LEQ (QUOTE " + std::to_string(high) + ") (QUOTE " + std::to_string(low) + ")) " +
+                                      small(2) + ' ';
+                            suffixes.push_back(")");
+                        }
+                        break;
+                    }
+                    default:{
+                        // (CAR (CDR ... (CONS e0 ... (CONS <вложенная часть> ...))))
+                        auto index = below(list_length);
+                        nodes += 2 + 2 * index + 2 * list_length + 3;
+                        prefix += "(CAR " + repeat("(CDR ", index);
+                        for(std::size_t i = 0; i < index; i++)
+                            prefix += "(CONS " + small(1) + ' ';
+                        prefix += "(CONS ";
+                        std::string suffix;
+                        for(std::size_t i = index + 1; i < list_length; i++)
+                            suffix += " (CONS " + small(1);
+                        suffix += " (QUOTE ())" + repeat(")", list_length - index - 1) + ')';
+                        suffix += repeat(")", 2 * index) + ')';
+                        suffixes.push_back(std::move(suffix));
+                    }
+                }
+            }
+            // тело функции должно быть списком, поэтому внутри всегда форма
+            nodes += 2;
+            prefix += "(ADD " + leaf() + ' ' + leaf() + ')';
+            for(auto it = suffixes.rbegin(); it != suffixes.rend(); ++it)
+                prefix += *it;
+            scope = std::move(saved_scope);
+            return prefix;
+        }
+
+        const generator_options& options;
+        std::mt19937_64 random;
+        std::size_t list_length;
+        std::size_t nodes = 0;
+        std::size_t next_name = 0;
+        std::vector<std::string> scope;   // параметры функции, видимые на текущем уровне
+    };
+}
+
+std::string bench::generate_program(const generator_options &options) {
+    return generator{options}.program();
+}
@@ -0,0 +1,40 @@
+#ifndef LISPKIT_COMPILER_PROGRAM_GENERATOR_HPP
+#define LISPKIT_COMPILER_PROGRAM_GENERATOR_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace bench {
+
+/**
+ * Generator of synthetic LispKit programs for scaling tests.
+ *
+ * A program is a balanced ADD tree of "spines". A spine is a chain of
+ * `depth` nested forms (arithmetic, COND, LET, LAMBDA application, CAR of
+ * a CONS list), each level has small random operands next to the nested
+ * one, and every level of a spine is evaluated. Spines are added until
+ * the program has about `size` nodes (atoms and lists), so size and
+ * nesting depth can be varied independently.
+ *
+ * Programs are valid for both evaluators: LET bodies are call signatures
+ * of symbols, names are never reused, lambda bodies use only their
+ * parameters, CDR is applied only to lists of two or more elements and
+ * nothing divides by zero. The result is always a number.
+ *
+ * The same options and seed give the same program on every platform:
+ * only std::mt19937_64 is used, not the standard distributions.
+ */
+struct generator_options {
+    std::uint64_t seed = 1;
+    std::size_t size = 20000;
+    std::size_t depth = 50;
+    std::size_t list_length = 4;
+    double let_density = 0.2;     // probability of a LET level in a spine
+    double lambda_density = 0.1;  // probability of a LAMBDA level
+};
+
+std::string generate_program(const generator_options& options);
+
+}
+
+#endif //LISPKIT_COMPILER_PROGRAM_GENERATOR_HPP
@@ -0,0 +1,107 @@
+/**
+ * Build tool for programs of several modules (see src/module_linker.hpp):
+ *
+ *     lispkit_build build_directory module.lisp...
+ *
+ * Every module is compiled into build_directory/<name>.unit, where name
+ * is the file name without the extension. A unit whose source has not
+ * changed since it was written is loaded instead of compiled. The units
+ * are linked and the program is run, its value goes to the standard
+ * output, the build log to the standard error.
+ */
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "interpreter.hpp"
+
+namespace {
+    // unit up to date with source, nullopt if it must be compiled again
+    std::optional<yy::module_unit> load_unit(const std::filesystem::path& path, const std::string& name,
+                                             std::uint64_t source_hash) {
+        if(!std::filesystem::exists(path))
+            return std::nullopt;
+        try{
+            auto unit = yy::module_unit::load(path);
+            if(unit.name == name && unit.source_hash == source_hash)
+                return unit;
+        }
+        catch(const std::runtime_error& ex){
+            std::cerr << "lispkit_build: " << ex.what() << ", compiling again" << std::endl;
+        }
+        return std::nullopt;
+    }
+}
+
+int main(int argc, char** argv) {
+    if(argc < 3){
+        std::cerr << "usage: lispkit_build build_directory module.lisp..." << std::endl;
+        return 2;
+    }
+    std::filesystem::path build_directory{argv[1]};
+    std::error_code error;
+    std::filesystem::create_directories(build_directory, error);
+    if(error){
+        std::cerr << "lispkit_build: cannot create " << build_directory.string() << ": " << error.message() << std::endl;
+        return 2;
+    }
+
+    std::vector<yy::module_unit> units;
+    for(int i = 2; i < argc; i++){
+        std::filesystem::path source_path{argv[i]};
+        std::ifstream input{source_path, std::ios::binary};
+        if(!input){
+            std::cerr << "lispkit_build: cannot open " << source_path.string() << std::endl;
+            return 2;
+        }
+        std::stringstream source;
+        source << input.rdbuf();
+        auto name = source_path.stem().string();
+        auto source_hash = yy::ProgramCache::make_key(source.view(), true);
+        auto unit_path = build_directory / (name + ".unit");
+        if(auto unit = load_unit(unit_path, name, source_hash)){
+            units.push_back(std::move(*unit));
+            continue;
+        }
+
+        std::cerr << "compiling " << source_path.string() << std::endl;
+        std::stringstream messages;
+        yy::Interpreter interpreter;
+        interpreter.set_file_name(source_path.string());
+        interpreter.multiple_forms = true;
+        interpreter.switch_streams(&source, &messages);
+        if(interpreter.parse() != 0 || interpreter.is_error()){
+            std::cerr << messages.str();
+            return 1;
+        }
+        auto unit = interpreter.compile_module(name);
+        if(!unit){
+            std::cerr << messages.str();
+            return 1;
+        }
+        unit->source_hash = source_hash;
+        try{
+            unit->save(unit_path);
+        }
+        catch(const std::runtime_error& ex){
+            std::cerr << "lispkit_build: " << ex.what() << std::endl;
+            return 1;
+        }
+        units.push_back(std::move(*unit));
+    }
+
+    yy::linked_program program;
+    try{
+        program = yy::link(units);
+    }
+    catch(const yy::link_error& ex){
+        std::cerr << "lispkit_build: link error: " << ex.what() << std::endl;
+        return 1;
+    }
+    yy::Interpreter interpreter;
+    interpreter.switch_streams(nullptr, &std::cout);
+    interpreter.execute_linked(program);
+    return interpreter.is_error() ? 1 : 0;
+}
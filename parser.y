@@ -54,6 +54,7 @@
 //%token END_OF_FILE нам не нужно переизобретать EOF, он сам генерируется бизоном (см. parser.hpp "make_YYEOF")
 %token <std::string> ID
 %token <int64_t> NUM
+%token <std::string> BIG_NUM
 %token OP_BR "("
 %token CL_BR ")"
 
@@ -65,11 +66,27 @@
 
 %%
 
-start : s_expr {
+start : forms {
     OUT << "Success" << std::endl;
-    driver.AST = $1;
+    driver.AST = driver.forms.back();
 }
 
+forms :
+    s_expr
+    {
+        driver.forms.clear();
+        driver.forms.push_back($1);
+    }
+    | forms s_expr
+    {
+        //несколько форм верхнего уровня - только у модулей
+        if(!driver.multiple_forms){
+            error(@2, "syntax error, unexpected form after the end of the program");
+            YYABORT;
+        }
+        driver.forms.push_back($2);
+    };
+
 s_expr :
     atom
     {
@@ -79,6 +96,7 @@ s_expr :
     {
         //check for num of arguments
         AST_node& current = $2;
+        current.set_location({static_cast<std::uint32_t>(@1.begin.line), static_cast<std::uint32_t>(@1.begin.column)});
         if(driver.check_number_of_arguments){
             try{
                 current.check_command_syntax();
@@ -109,6 +127,10 @@ atom: ID
     | NUM
     {
         $$ = AST_node{$1};
+    }
+    | BIG_NUM
+    {
+        $$ = AST_node{big_int{$1}};
     };
     
 %%
@@ -117,6 +139,7 @@ atom: ID
 void yy::Parser::error(const location &loc, const std::string &message) {
     OUT << (loc.begin.filename != nullptr ? *loc.begin.filename : "input") << ':' << loc.begin.line << ':' << loc.begin.column
         << ": error: " << message << std::endl;
+    driver.add_diagnostic(loc.begin, message);
     driver.m_error = true;
 }
 
@@ -0,0 +1,69 @@
+/**
+ * Interactive session: forms are read from the standard input one by one
+ * and run with Interpreter::execute_session, so (DEFINE NAME EXPRESSION)
+ * stays in the session and later forms use it without sending the library
+ * again. A form may span several lines, it is complete when its brackets
+ * are balanced; a line may also hold several forms.
+ */
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "interpreter.hpp"
+
+namespace {
+    // скобки, открытые в строке и еще не закрытые
+    int bracket_balance(const std::string& line) {
+        int balance = 0;
+        for(auto c : line){
+            if(c == '(')
+                ++balance;
+            else if(c == ')')
+                --balance;
+        }
+        return balance;
+    }
+}
+
+int main() {
+    const bool interactive = isatty(0);
+    yy::Interpreter interpreter;
+    interpreter.set_file_name("repl");
+    interpreter.multiple_forms = true;
+    std::string form;
+    std::string line;
+    int balance = 0;
+    if(interactive)
+        std::cout << "> " << std::flush;
+    while(std::getline(std::cin, line)){
+        form += line;
+        form += '\n';
+        balance += bracket_balance(line);
+        if(balance > 0 || form.find_first_not_of(" \t\r\n") == std::string::npos){
+            if(interactive)
+                std::cout << (balance > 0 ? "  " : "> ") << std::flush;
+            if(balance <= 0)
+                form.clear();
+            continue;
+        }
+        std::istringstream input{form};
+        std::stringstream messages;
+        interpreter.switch_streams(&input, &messages);
+        if(interpreter.parse() != 0 || interpreter.is_error())
+            std::cout << messages.str();
+        else{
+            interpreter.switch_streams(&input, &std::cout);
+            for(auto&& top_level : interpreter.get_forms()){
+                interpreter.get_AST() = top_level;
+                interpreter.execute_session();
+            }
+        }
+        form.clear();
+        balance = 0;
+        if(interactive)
+            std::cout << "> " << std::flush;
+    }
+    return 0;
+}
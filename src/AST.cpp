@@ -3,22 +3,40 @@
 //
 #include "AST.hpp"
 
+#include <charconv>
+#include <utility>
+#include <vector>
+
+#include "hash.hpp"
+
 AST_node::AST_node(std::string val) : value(val)
 {}
 
 AST_node::AST_node(AST_node::num_t num) : value(num)
 {}
 
-AST_node::AST_node() : value(AST_node_list{})
+AST_node::AST_node() : value(list_ptr{})
+{}
+
+AST_node::AST_node(big_int num)
+{
+    if(num.fits_int64())
+        value = num.to_int64();
+    else
+        value = std::make_shared<const big_int>(std::move(num));
+}
+
+AST_node::AST_node(std::vector<num_t> elements) :
+        value(std::make_shared<const std::vector<num_t>>(std::move(elements)))
 {}
 
 AST_node&& AST_node::append(AST_node node) {
-    std::get<AST_node_list>(value).push_back(std::move(node));
+    to_list().push_back(std::move(node));
     return std::move(*this);
 }
 
 void AST_node::check_command_syntax() {
-    auto&& list = std::get<AST_node_list>(value);
+    auto&& list = std::as_const(*this).to_list();
     if(list.empty())
         return;
     auto&& first = list.front();
@@ -46,10 +64,10 @@ void AST_node::check_command_syntax() {
             for(int arg = 2; current != list.end(); current++, arg++){
                 //тут должна быть пара
                 auto&& elem = *current;
-                if(!std::holds_alternative<AST_node_list>(elem.value))
+                if(!elem.is_list())
                     throw std::runtime_error{std::format("Error in {} argument, arg {} should be pair", keyword, arg)};
                 else{
-                    auto&& elem_list = std::get<AST_node_list>(elem.value);
+                    auto&& elem_list = elem.to_list();
                     if(elem_list.size() != 2)
                         throw std::runtime_error{std::format("Error in {} argument, arg {} should be pair", keyword, arg)};
                     //плюс проверка на то, что первый элемент должен быть строкой
@@ -67,48 +85,216 @@ struct AST_to_string_struct{
     bool is_last = false;
 };
 
-std::string AST_node::print_tree(int depth) {
-    if(depth == 0)
-        return std::string{"..."};
-    if(std::holds_alternative<std::string>(this->value))
-        return std::get<std::string>(this->value);
-    else if(std::holds_alternative<num_t>(this->value))
-        return std::to_string(std::get<num_t>(this->value));
-    else{ //std::holds_alternative<AST_node_list>(this->value)
-        std::stringstream ss;
-        auto&& list = std::get<AST_node_list>(this->value);
-        ss << '(';
-        bool first = true;
-        for(auto&& elem : list){
-            if(!first)
-                ss << ' ';
-            ss << elem.print_tree(depth - 1);
-            first = false;
+std::string AST_node::print_tree(int depth) const {
+    std::ostringstream ss;
+    print(ss, depth);
+    return ss.str();
+}
+
+void AST_node::print(std::ostream &out, int max_depth, std::int64_t max_length) const {
+    //открытые списки: текущий элемент, конец и сколько элементов уже напечатано
+    struct open_list{
+        AST_node_list::const_iterator next;
+        AST_node_list::const_iterator end;
+        std::int64_t printed;
+    };
+    std::vector<open_list> open;
+    const AST_node* current = this;
+    while(true){
+        auto depth = static_cast<std::int64_t>(open.size());
+        if(max_depth >= 0 && depth == max_depth)
+            out << "...";
+        else if(current->is_string())
+            out << current->to_string();
+        else if(current->is_num()){
+            char buffer[24];
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), current->to_num());
+            out.write(buffer, result.ptr - buffer);
+        }
+        else if(current->is_big())
+            out << current->to_big().to_string();
+        else if(current->is_vector()){
+            //вектор - атом, но длинный: обрезается так же, как список
+            auto&& elements = current->to_vector();
+            out << '[';
+            for(std::size_t i = 0; i < elements.size(); i++){
+                if(max_length >= 0 && static_cast<std::int64_t>(i) == max_length){
+                    out << (i == 0 ? "..." : " ...");
+                    break;
+                }
+                char buffer[24];
+                auto result = std::to_chars(buffer, buffer + sizeof(buffer), elements[i]);
+                if(i != 0)
+                    out << ' ';
+                out.write(buffer, result.ptr - buffer);
+            }
+            out << ']';
+        }
+        else{
+            auto&& list = current->to_list();
+            out << '(';
+            open.push_back({list.begin(), list.end(), 0});
+        }
+        //следующий элемент: спускаемся в список или закрываем законченные
+        current = nullptr;
+        while(!open.empty()){
+            auto&& top = open.back();
+            if(top.next != top.end && max_length >= 0 && top.printed == max_length){
+                out << (top.printed == 0 ? "...)" : " ...)");
+                open.pop_back();
+                continue;
+            }
+            if(top.next == top.end){
+                out << ')';
+                open.pop_back();
+                continue;
+            }
+            if(top.printed != 0)
+                out << ' ';
+            top.printed++;
+            current = &*top.next++;
+            break;
+        }
+        if(current == nullptr)
+            return;
+    }
+}
+
+bool AST_node::operator==(const AST_node &other) const {
+    if(value.index() != other.value.index())
+        return false;
+    if(is_string())
+        return to_string() == other.to_string();
+    if(is_num())
+        return to_num() == other.to_num();
+    if(is_big())
+        return to_big() == other.to_big();
+    if(is_vector())
+        return to_vector() == other.to_vector();
+    auto&& left = std::get<list_ptr>(value);
+    auto&& right = std::get<list_ptr>(other.value);
+    if(left == right)
+        return true;
+    if(left && right){
+        if(left->owner != 0 && left->owner == right->owner)
+            return false;
+        auto left_hash = left->cached_hash.load(std::memory_order_relaxed);
+        auto right_hash = right->cached_hash.load(std::memory_order_relaxed);
+        if(left_hash != 0 && right_hash != 0 && left_hash != right_hash)
+            return false;
+    }
+    return to_list() == other.to_list();
+}
+
+std::uint64_t AST_node::hash() const {
+    const list_storage* storage = nullptr;
+    if(is_list()){
+        storage = std::get<list_ptr>(value).get();
+        if(storage != nullptr){
+            auto cached = storage->cached_hash.load(std::memory_order_relaxed);
+            if(cached != 0)
+                return cached;
         }
-        ss << ')';
-        return ss.str();
     }
+    //тег типа подмешивается, чтобы "1" и 1 не совпадали
+    char tag = static_cast<char>('A' + value.index());
+    auto result = hashing::fnv1a(&tag, 1);
+    if(is_string())
+        return hashing::fnv1a(to_string(), result);
+    if(is_num()){
+        auto num = to_num();
+        return hashing::fnv1a(&num, sizeof(num), result);
+    }
+    if(is_big()){
+        auto&& limbs = to_big().limbs();
+        char sign = to_big().is_negative() ? '-' : '+';
+        result = hashing::fnv1a(&sign, 1, result);
+        return hashing::fnv1a(limbs.data(), limbs.size() * sizeof(big_int::limb_t), result);
+    }
+    if(is_vector()){
+        auto&& elements = to_vector();
+        return hashing::fnv1a(elements.data(), elements.size() * sizeof(num_t), result);
+    }
+    for(auto&& elem : to_list()){
+        auto elem_hash = elem.hash();
+        result = hashing::fnv1a(&elem_hash, sizeof(elem_hash), result);
+    }
+    if(result == 0)
+        result = 1; // 0 означает "не посчитан"
+    if(storage != nullptr)
+        storage->cached_hash.store(result, std::memory_order_relaxed);
+    return result;
 }
 
 AST_node::num_t& AST_node::to_num(){
     return std::get<num_t>(value);
 }
-bool AST_node::is_num(){
+const AST_node::num_t& AST_node::to_num() const{
+    return std::get<num_t>(value);
+}
+bool AST_node::is_num() const{
     return std::holds_alternative<num_t>(value);
 }
 
+const big_int& AST_node::to_big() const{
+    return *std::get<big_ptr>(value);
+}
+bool AST_node::is_big() const{
+    return std::holds_alternative<big_ptr>(value);
+}
+
+bool AST_node::is_number() const{
+    return is_num() || is_big();
+}
+
+const std::vector<AST_node::num_t>& AST_node::to_vector() const{
+    return *std::get<vector_ptr>(value);
+}
+bool AST_node::is_vector() const{
+    return std::holds_alternative<vector_ptr>(value);
+}
+
 std::string& AST_node::to_string(){
     return std::get<std::string>(value);
 }
-bool AST_node::is_string(){
+const std::string& AST_node::to_string() const{
+    return std::get<std::string>(value);
+}
+bool AST_node::is_string() const{
     return std::holds_alternative<std::string>(value);
 }
 
 AST_node::AST_node_list& AST_node::to_list(){
-    return std::get<AST_node_list>(value);
+    auto&& storage = std::get<list_ptr>(value);
+    if(!storage)
+        storage = std::make_shared<list_storage>();
+    else if(storage.use_count() > 1 || storage->owner != 0)
+        storage = std::make_shared<list_storage>(*storage); // copy on write
+    else
+        storage->cached_hash.store(0, std::memory_order_relaxed);
+    return storage->items;
+}
+const AST_node::AST_node_list& AST_node::to_list() const{
+    static const AST_node_list empty_list;
+    auto&& storage = std::get<list_ptr>(value);
+    return storage ? storage->items : empty_list;
 }
-bool AST_node::is_list(){
-    return std::holds_alternative<AST_node_list>(value);
+bool AST_node::is_list() const{
+    return std::holds_alternative<list_ptr>(value);
+}
+
+AST_node::source_location AST_node::location() const{
+    if(!is_list())
+        return {};
+    auto&& storage = std::get<list_ptr>(value);
+    return storage ? storage->location : source_location{};
+}
+
+void AST_node::set_location(source_location new_location){
+    if(!is_list())
+        return;
+    if(auto&& storage = std::get<list_ptr>(value))
+        storage->location = new_location;
 }
 
 AST_node AST_node::TRUE() {
@@ -118,3 +304,55 @@ AST_node AST_node::TRUE() {
 AST_node AST_node::FALSE() {
     return AST_node("FALSE");
 }
+
+namespace {
+    // children of both lists are already canonical, so lists compare by pointer
+    bool same_interned_items(const AST_node::AST_node_list& left, const AST_node::AST_node_list& right){
+        if(left.size() != right.size())
+            return false;
+        auto right_iterator = right.begin();
+        for(auto&& elem : left){
+            auto&& other = *right_iterator++;
+            if(elem.value.index() != other.value.index())
+                return false;
+            if(elem.is_list()){
+                if(std::get<AST_node::list_ptr>(elem.value) != std::get<AST_node::list_ptr>(other.value))
+                    return false;
+            }
+            else if(!(elem == other)){
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+AST_intern_table::AST_intern_table() {
+    static std::atomic<std::uint64_t> last_id{0};
+    id = ++last_id;
+}
+
+AST_node AST_intern_table::intern(AST_node node) {
+    if(!node.is_list())
+        return node;
+    auto&& storage = std::get<AST_node::list_ptr>(node.value);
+    if(!storage || storage->owner == id)
+        return node;
+    for(auto&& elem : node.to_list())
+        elem = intern(std::move(elem));
+    auto hash = node.hash();
+    auto [begin, end] = canonical.equal_range(hash);
+    for(auto it = begin; it != end; ++it){
+        if(same_interned_items(it->second->items, storage->items)){
+            node.value = it->second;
+            return node;
+        }
+    }
+    storage->owner = id;
+    canonical.insert({hash, storage});
+    return node;
+}
+
+std::size_t AST_intern_table::size() const {
+    return canonical.size();
+}
@@ -5,41 +5,111 @@
 #ifndef LISPKIT_COMPILER_AST_HPP
 #define LISPKIT_COMPILER_AST_HPP
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <variant>
 #include <list>
+#include <vector>
 #include <unordered_map>
 #include <stdexcept>
 #include <format>
 #include <sstream>
+#include <ostream>
+
+#include "big_int.hpp"
 
 
 struct AST_node{
     using AST_node_list = std::list<AST_node>;
     using num_t = int64_t;
-    std::variant<std::string, num_t, AST_node_list> value;
+    /**
+     * Lists are kept in shared copy-on-write storage: copying a node is O(1)
+     * and identical subtrees can be shared (see AST_intern_table).
+     * The non-const to_list() makes the storage unique before returning it,
+     * so a list can be changed without touching other copies.
+     * nullptr is the empty list.
+     */
+    struct list_storage;
+    using list_ptr = std::shared_ptr<list_storage>;
+    // numbers outside of num_t range, never holds a value that fits num_t
+    using big_ptr = std::shared_ptr<const big_int>;
+    // packed vector of numbers, an atom made at run time (see packed_vector.hpp)
+    using vector_ptr = std::shared_ptr<const std::vector<num_t>>;
+    std::variant<std::string, num_t, list_ptr, big_ptr, vector_ptr> value;
+
+    // position of the opening bracket of a parsed list, 1-based
+    struct source_location{
+        std::uint32_t line = 0;   // 0 - unknown
+        std::uint32_t column = 0;
+
+        bool known() const { return line != 0; }
+    };
+
+    /**
+     * Lists keep the location in their storage, so it costs nothing for
+     * atoms and survives copies, the program cache and hash-consing (an
+     * interned list keeps the location of its first occurrence).
+     * Atoms, the empty list and lists built at run time have none.
+     */
+    source_location location() const;
+    // for a list that is not shared yet, used by the parser
+    void set_location(source_location new_location);
 
     //value should be std::list
     AST_node&& append(AST_node node);
 
     void check_command_syntax();
 
-    std::string print_tree(int depth = -1);
+    std::string print_tree(int depth = -1) const;
+
+    /**
+     * Write the tree to out without recursion and without building
+     * strings, in the format of print_tree. Lists nested max_depth levels
+     * deep are printed as "...", lists longer than max_length show their
+     * first max_length elements and "...". Negative means unlimited.
+     */
+    void print(std::ostream& out, int max_depth = -1, std::int64_t max_length = -1) const;
 
     num_t& to_num();
-    bool is_num();
+    const num_t& to_num() const;
+    bool is_num() const;
+
+    const big_int& to_big() const;
+    bool is_big() const;
+
+    // is_num() || is_big()
+    bool is_number() const;
+
+    const std::vector<num_t>& to_vector() const;
+    bool is_vector() const;
 
     std::string& to_string();
-    bool is_string();
+    const std::string& to_string() const;
+    bool is_string() const;
 
     AST_node_list& to_list();
-    bool is_list();
+    const AST_node_list& to_list() const;
+    bool is_list() const;
 
     explicit AST_node(std::string val);
     explicit AST_node(num_t num);
+    explicit AST_node(big_int num); // stored as num_t when it fits
+    explicit AST_node(std::vector<num_t> elements); // packed vector
     explicit AST_node(); // list
 
-    bool operator==(const AST_node&) const = default;
+    /**
+     * Lists sharing storage are equal without looking inside, lists
+     * interned by the same table are equal only if they share storage.
+     */
+    bool operator==(const AST_node& other) const;
+
+    /**
+     * Structural hash, equal trees have equal hashes.
+     * Cached in the list storage, the cache is dropped by the non-const to_list().
+     */
+    std::uint64_t hash() const;
 
 #undef TRUE
 #undef FALSE
@@ -49,6 +119,46 @@ struct AST_node{
 
 };
 
+struct AST_node::list_storage{
+    AST_node_list items;
+    // 0 - not computed yet
+    mutable std::atomic<std::uint64_t> cached_hash{0};
+    // id of the table that made this storage canonical, 0 if not interned
+    std::uint64_t owner = 0;
+    source_location location;
+
+    list_storage() = default;
+    list_storage(const list_storage& other) : items(other.items), location(other.location) {}
+};
+
+/**
+ * Hash-consing: intern() replaces every list in a tree with the canonical
+ * storage for its contents, so identical subtrees (repeated QUOTE
+ * constants, closure bodies) exist once and compare by pointer.
+ * Interned storage is never changed in place, to_list() always copies it.
+ */
+class AST_intern_table{
+public:
+    AST_intern_table();
+
+    AST_node intern(AST_node node);
+
+    std::size_t size() const;
+
+private:
+    // tables are told apart by id, not address: interned trees outlive
+    // their table in the program cache
+    std::uint64_t id;
+    std::unordered_multimap<std::uint64_t, AST_node::list_ptr> canonical;
+};
+
+template<>
+struct std::hash<AST_node>{
+    std::size_t operator()(const AST_node& node) const{
+        return static_cast<std::size_t>(node.hash());
+    }
+};
+
 namespace Rules{
     struct command_trait{
         int arguments;
@@ -71,7 +181,25 @@ namespace Rules{
         {"COND", {3, true}},
         {"LAMBDA", {2, false}},
         {"LET", {2, false}},
-        {"LETREC", {2, false}}
+        {"LETREC", {2, false}},
+        {"DEFINE", {2, true}},
+        {"IMPORT", {1, false}},
+        {"EXPORT", {1, false}},
+        {"MAP", {2, true}},
+        {"FILTER", {2, true}},
+        {"FOLD", {3, true}},
+        {"VEC", {1, true}},
+        {"VLIST", {1, true}},
+        {"VLEN", {1, true}},
+        {"VADD", {2, true}},
+        {"VSUB", {2, true}},
+        {"VMUL", {2, true}},
+        {"VLEQ", {2, true}},
+        {"VEQ", {2, true}},
+        {"VDOT", {2, true}},
+        {"VSUM", {1, true}},
+        {"VMIN", {1, true}},
+        {"VMAX", {1, true}}
     };
 }
 
@@ -0,0 +1,98 @@
+#include "alloc_stats.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    constinit thread_local alloc_stats::counters thread_counters;
+
+    // заголовок блока хранит его размер, выравнивание как у malloc
+    constexpr std::size_t header_size = alignof(std::max_align_t);
+
+    void* allocate(std::size_t size) noexcept {
+        auto* block = static_cast<unsigned char*>(std::malloc(size + header_size));
+        if(block == nullptr)
+            return nullptr;
+        *reinterpret_cast<std::size_t*>(block) = size;
+        auto&& stats = thread_counters;
+        stats.allocations++;
+        stats.allocated_bytes += size;
+        stats.live_bytes += static_cast<std::int64_t>(size);
+        if(stats.live_bytes > stats.peak_live_bytes)
+            stats.peak_live_bytes = stats.live_bytes;
+        return block + header_size;
+    }
+
+    void* allocate_or_throw(std::size_t size) {
+        for(;;){
+            if(auto* pointer = allocate(size))
+                return pointer;
+            auto handler = std::get_new_handler();
+            if(handler == nullptr)
+                throw std::bad_alloc{};
+            handler();
+        }
+    }
+
+    void deallocate(void* pointer) noexcept {
+        if(pointer == nullptr)
+            return;
+        auto* block = static_cast<unsigned char*>(pointer) - header_size;
+        auto size = *reinterpret_cast<std::size_t*>(block);
+        auto&& stats = thread_counters;
+        stats.deallocations++;
+        stats.live_bytes -= static_cast<std::int64_t>(size);
+        std::free(block);
+    }
+}
+
+alloc_stats::counters alloc_stats::current() {
+    return thread_counters;
+}
+
+void alloc_stats::reset_peak() {
+    thread_counters.peak_live_bytes = thread_counters.live_bytes;
+}
+
+// выровненные версии new/delete не заменяются, они работают в обход счётчиков
+
+void* operator new(std::size_t size) {
+    return allocate_or_throw(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate_or_throw(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    deallocate(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    deallocate(pointer);
+}
@@ -0,0 +1,31 @@
+#ifndef LISPKIT_COMPILER_ALLOC_STATS_HPP
+#define LISPKIT_COMPILER_ALLOC_STATS_HPP
+
+#include <cstdint>
+
+/**
+ * Heap usage counters. alloc_stats.cpp replaces the global operator
+ * new/delete; every block carries a small header with its size, so live
+ * bytes are exact. Counters are per thread, a block freed by another
+ * thread is subtracted there.
+ *
+ * The replacement is linked only into programs that reference this
+ * header's functions.
+ */
+namespace alloc_stats{
+    struct counters{
+        std::uint64_t allocations = 0;
+        std::uint64_t deallocations = 0;
+        std::uint64_t allocated_bytes = 0;
+        std::int64_t live_bytes = 0;
+        std::int64_t peak_live_bytes = 0;
+    };
+
+    // counters of the calling thread
+    counters current();
+
+    // start a new peak measurement from the current live size
+    void reset_peak();
+}
+
+#endif //LISPKIT_COMPILER_ALLOC_STATS_HPP
@@ -0,0 +1,32 @@
+#include "arithmetic.hpp"
+
+namespace {
+    big_int to_big_int(const AST_node& num){
+        return num.is_num() ? big_int{num.to_num()} : num.to_big();
+    }
+}
+
+AST_node arithmetic::add_slow(const AST_node &left, const AST_node &right) {
+    return AST_node{to_big_int(left) + to_big_int(right)};
+}
+
+AST_node arithmetic::subtract_slow(const AST_node &left, const AST_node &right) {
+    return AST_node{to_big_int(left) - to_big_int(right)};
+}
+
+AST_node arithmetic::multiply_slow(const AST_node &left, const AST_node &right) {
+    return AST_node{to_big_int(left) * to_big_int(right)};
+}
+
+AST_node arithmetic::divide_slow(const AST_node &left, const AST_node &right) {
+    return AST_node{to_big_int(left) / to_big_int(right)};
+}
+
+AST_node arithmetic::remainder_slow(const AST_node &left, const AST_node &right) {
+    return AST_node{to_big_int(left) % to_big_int(right)};
+}
+
+int arithmetic::compare_slow(const AST_node &left, const AST_node &right) {
+    auto order = to_big_int(left) <=> to_big_int(right);
+    return order < 0 ? -1 : (order > 0 ? 1 : 0);
+}
@@ -0,0 +1,77 @@
+#ifndef LISPKIT_COMPILER_ARITHMETIC_HPP
+#define LISPKIT_COMPILER_ARITHMETIC_HPP
+
+#include <limits>
+
+#include "AST.hpp"
+
+/**
+ * Checked arithmetic shared by both evaluators. Operands must satisfy
+ * is_number(). Two num_t operands are handled inline; on overflow, or
+ * when an operand is already a big_int, the *_slow functions compute the
+ * exact result, which is stored back as num_t whenever it fits.
+ */
+namespace arithmetic{
+    AST_node add_slow(const AST_node& left, const AST_node& right);
+    AST_node subtract_slow(const AST_node& left, const AST_node& right);
+    AST_node multiply_slow(const AST_node& left, const AST_node& right);
+    AST_node divide_slow(const AST_node& left, const AST_node& right);
+    AST_node remainder_slow(const AST_node& left, const AST_node& right);
+    int compare_slow(const AST_node& left, const AST_node& right);
+
+    inline bool is_zero(const AST_node& num){
+        return num.is_num() && num.to_num() == 0; // big_int is never zero
+    }
+
+    inline AST_node add(const AST_node& left, const AST_node& right){
+        AST_node::num_t result;
+        if(left.is_num() && right.is_num() && !__builtin_add_overflow(left.to_num(), right.to_num(), &result))
+            return AST_node{result};
+        return add_slow(left, right);
+    }
+
+    inline AST_node subtract(const AST_node& left, const AST_node& right){
+        AST_node::num_t result;
+        if(left.is_num() && right.is_num() && !__builtin_sub_overflow(left.to_num(), right.to_num(), &result))
+            return AST_node{result};
+        return subtract_slow(left, right);
+    }
+
+    inline AST_node multiply(const AST_node& left, const AST_node& right){
+        AST_node::num_t result;
+        if(left.is_num() && right.is_num() && !__builtin_mul_overflow(left.to_num(), right.to_num(), &result))
+            return AST_node{result};
+        return multiply_slow(left, right);
+    }
+
+    // right must not be zero, callers report that as a runtime error
+    inline AST_node divide(const AST_node& left, const AST_node& right){
+        if(left.is_num() && right.is_num() &&
+           !(left.to_num() == std::numeric_limits<AST_node::num_t>::min() && right.to_num() == -1))
+            return AST_node{left.to_num() / right.to_num()};
+        return divide_slow(left, right);
+    }
+
+    inline AST_node remainder(const AST_node& left, const AST_node& right){
+        if(left.is_num() && right.is_num()){
+            if(right.to_num() == -1)
+                return AST_node{AST_node::num_t{0}}; // min % -1 is undefined for int64_t
+            return AST_node{left.to_num() % right.to_num()};
+        }
+        return remainder_slow(left, right);
+    }
+
+    inline bool less_equal(const AST_node& left, const AST_node& right){
+        if(left.is_num() && right.is_num())
+            return left.to_num() <= right.to_num();
+        return compare_slow(left, right) <= 0;
+    }
+
+    inline bool equal(const AST_node& left, const AST_node& right){
+        if(left.is_num() && right.is_num())
+            return left.to_num() == right.to_num();
+        return compare_slow(left, right) == 0;
+    }
+}
+
+#endif //LISPKIT_COMPILER_ARITHMETIC_HPP
@@ -0,0 +1,118 @@
+#include "ast_list_model.hpp"
+
+#include <utility>
+
+AstItem::AstItem(AST_node node, std::string label) :
+        node(std::move(node)),
+        label(std::move(label))
+{}
+
+Glib::RefPtr<AstItem> AstItem::create(AST_node node, std::string label) {
+    return Glib::make_refptr_for_instance<AstItem>(new AstItem(std::move(node), std::move(label)));
+}
+
+const AST_node &AstItem::get_node() const {
+    return node;
+}
+
+std::string AstItem::get_operation() const {
+    if(!label.empty())
+        return label;
+    return node.is_list() ? "()" : node.print_tree();
+}
+
+std::size_t AstItem::get_arg_count() const {
+    return node.is_list() ? node.to_list().size() : 0;
+}
+
+bool AstItem::has_children() const {
+    return node.is_list() && !node.to_list().empty();
+}
+
+AstChildren::AstChildren(const AST_node& list) :
+        Glib::ObjectBase(typeid(AstChildren)),
+        Glib::Object(),
+        Gio::ListModel(),
+        list(list)
+{
+    //std::list без произвольного доступа - запоминаем адреса детей один раз
+    for(auto&& child : std::as_const(this->list).to_list())
+        children.push_back(&child);
+    items.resize(children.size());
+}
+
+Glib::RefPtr<AstChildren> AstChildren::create(const AST_node& list) {
+    return Glib::make_refptr_for_instance<AstChildren>(new AstChildren(list));
+}
+
+GType AstChildren::get_item_type_vfunc() {
+    return Glib::Object::get_base_type();
+}
+
+guint AstChildren::get_n_items_vfunc() {
+    return static_cast<guint>(children.size());
+}
+
+gpointer AstChildren::get_item_vfunc(guint position) {
+    if(position >= children.size())
+        return nullptr;
+    auto&& item = items[position];
+    if(!item)
+        item = AstItem::create(*children[position]);
+    //модель отдает новую ссылку
+    return item->gobj_copy();
+}
+
+Glib::RefPtr<Gtk::TreeListModel> make_AST_tree_model(const Glib::RefPtr<Gio::ListModel>& roots) {
+    return Gtk::TreeListModel::create(roots, [](const Glib::RefPtr<Glib::ObjectBase>& object) -> Glib::RefPtr<Gio::ListModel> {
+        auto item = std::dynamic_pointer_cast<AstItem>(object);
+        if(!item || !item->has_children())
+            return {};
+        return AstChildren::create(item->get_node());
+    }, false, false);
+}
+
+namespace {
+    Glib::RefPtr<AstItem> bound_item(const Glib::RefPtr<Gtk::ListItem>& list_item) {
+        auto row = std::dynamic_pointer_cast<Gtk::TreeListRow>(list_item->get_item());
+        if(!row)
+            return {};
+        return std::dynamic_pointer_cast<AstItem>(row->get_item());
+    }
+}
+
+void append_AST_columns(Gtk::ColumnView& view) {
+    auto operation_factory = Gtk::SignalListItemFactory::create();
+    operation_factory->signal_setup().connect([](const Glib::RefPtr<Gtk::ListItem>& list_item){
+        auto expander = Gtk::make_managed<Gtk::TreeExpander>();
+        auto label = Gtk::make_managed<Gtk::Label>();
+        label->set_halign(Gtk::Align::START);
+        expander->set_child(*label);
+        list_item->set_child(*expander);
+    });
+    operation_factory->signal_bind().connect([](const Glib::RefPtr<Gtk::ListItem>& list_item){
+        auto expander = dynamic_cast<Gtk::TreeExpander*>(list_item->get_child());
+        if(!expander)
+            return;
+        expander->set_list_row(std::dynamic_pointer_cast<Gtk::TreeListRow>(list_item->get_item()));
+        auto label = dynamic_cast<Gtk::Label*>(expander->get_child());
+        if(auto item = bound_item(list_item); item && label)
+            label->set_text(item->get_operation());
+    });
+    auto operation_column = Gtk::ColumnViewColumn::create("command", operation_factory);
+    operation_column->set_expand();
+    view.append_column(operation_column);
+
+    auto count_factory = Gtk::SignalListItemFactory::create();
+    count_factory->signal_setup().connect([](const Glib::RefPtr<Gtk::ListItem>& list_item){
+        auto label = Gtk::make_managed<Gtk::Label>();
+        label->set_halign(Gtk::Align::END);
+        list_item->set_child(*label);
+    });
+    count_factory->signal_bind().connect([](const Glib::RefPtr<Gtk::ListItem>& list_item){
+        auto label = dynamic_cast<Gtk::Label*>(list_item->get_child());
+        if(auto item = bound_item(list_item); item && label)
+            label->set_text(std::to_string(item->get_arg_count()));
+    });
+    view.append_column(Gtk::ColumnViewColumn::create("arg_count", count_factory));
+}
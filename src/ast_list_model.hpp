@@ -0,0 +1,64 @@
+#ifndef LISPKIT_COMPILER_AST_LIST_MODEL_HPP
+#define LISPKIT_COMPILER_AST_LIST_MODEL_HPP
+
+#include <string>
+#include <vector>
+
+#include <gtkmm.h>
+
+#include "AST.hpp"
+
+/**
+ * Row of an AST view: one node, sharing the storage of the tree it came
+ * from. A non-empty label replaces the "()" of a list, the history uses
+ * it to name the runs.
+ */
+class AstItem : public Glib::Object {
+public:
+    static Glib::RefPtr<AstItem> create(AST_node node, std::string label = {});
+
+    const AST_node& get_node() const;
+    std::string get_operation() const;
+    std::size_t get_arg_count() const;
+    bool has_children() const;
+
+protected:
+    AstItem(AST_node node, std::string label);
+
+private:
+    AST_node node;
+    std::string label;
+};
+
+/**
+ * Children of one list node as a Gio::ListModel. Items are created when
+ * the view asks for them, so a node with 10^5 children costs one pointer
+ * per child until its rows are scrolled into view.
+ */
+class AstChildren : public Glib::Object, public Gio::ListModel {
+public:
+    static Glib::RefPtr<AstChildren> create(const AST_node& list);
+
+protected:
+    explicit AstChildren(const AST_node& list);
+
+    GType get_item_type_vfunc() override;
+    guint get_n_items_vfunc() override;
+    gpointer get_item_vfunc(guint position) override;
+
+private:
+    AST_node list;                          // держит хранилище детей
+    std::vector<const AST_node*> children;
+    std::vector<Glib::RefPtr<AstItem>> items;
+};
+
+/**
+ * Tree over root items (AstItem) that asks for the children of a row only
+ * when the row is expanded.
+ */
+Glib::RefPtr<Gtk::TreeListModel> make_AST_tree_model(const Glib::RefPtr<Gio::ListModel>& roots);
+
+// "command" column with expanders and "arg_count" column
+void append_AST_columns(Gtk::ColumnView& view);
+
+#endif //LISPKIT_COMPILER_AST_LIST_MODEL_HPP
@@ -0,0 +1,383 @@
+#include "big_int.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    using limb_t = big_int::limb_t;
+    using magnitude_t = std::vector<limb_t>;
+
+    // ниже этого размера (в limb'ах) обычное умножение быстрее Карацубы
+    constexpr std::size_t karatsuba_threshold = 32;
+    constexpr std::uint64_t limb_base = std::uint64_t{1} << 32;
+
+    void trim_magnitude(magnitude_t& m){
+        while(!m.empty() && m.back() == 0)
+            m.pop_back();
+    }
+
+    int compare_magnitude(const magnitude_t& left, const magnitude_t& right){
+        if(left.size() != right.size())
+            return left.size() < right.size() ? -1 : 1;
+        for(auto i = left.size(); i-- > 0;){
+            if(left[i] != right[i])
+                return left[i] < right[i] ? -1 : 1;
+        }
+        return 0;
+    }
+
+    // acc += value << (32 * shift)
+    void add_to(magnitude_t& acc, const limb_t* value, std::size_t size, std::size_t shift){
+        if(acc.size() < size + shift)
+            acc.resize(size + shift, 0);
+        std::uint64_t carry = 0;
+        std::size_t i = 0;
+        for(; i < size; i++){
+            std::uint64_t sum = std::uint64_t{acc[i + shift]} + value[i] + carry;
+            acc[i + shift] = static_cast<limb_t>(sum);
+            carry = sum >> 32;
+        }
+        for(auto j = i + shift; carry != 0; j++){
+            if(j == acc.size())
+                acc.push_back(0);
+            std::uint64_t sum = std::uint64_t{acc[j]} + carry;
+            acc[j] = static_cast<limb_t>(sum);
+            carry = sum >> 32;
+        }
+    }
+
+    // acc -= value, acc must not be less than value
+    void subtract_from(magnitude_t& acc, const magnitude_t& value){
+        std::int64_t borrow = 0;
+        for(std::size_t i = 0; i < acc.size(); i++){
+            if(i >= value.size() && borrow == 0)
+                break;
+            std::int64_t diff = std::int64_t{acc[i]} - (i < value.size() ? std::int64_t{value[i]} : 0) - borrow;
+            borrow = diff < 0 ? 1 : 0;
+            if(diff < 0)
+                diff += static_cast<std::int64_t>(limb_base);
+            acc[i] = static_cast<limb_t>(diff);
+        }
+        trim_magnitude(acc);
+    }
+
+    magnitude_t multiply_schoolbook(const limb_t* left, std::size_t left_size, const limb_t* right, std::size_t right_size){
+        magnitude_t result(left_size + right_size, 0);
+        for(std::size_t i = 0; i < left_size; i++){
+            std::uint64_t carry = 0;
+            for(std::size_t j = 0; j < right_size; j++){
+                std::uint64_t product = std::uint64_t{left[i]} * right[j] + result[i + j] + carry;
+                result[i + j] = static_cast<limb_t>(product);
+                carry = product >> 32;
+            }
+            result[i + right_size] = static_cast<limb_t>(carry);
+        }
+        trim_magnitude(result);
+        return result;
+    }
+
+    /**
+     * Karatsuba: with x = x1*B^m + x0 and y = y1*B^m + y0
+     * x*y = z2*B^2m + z1*B^m + z0, where z0 = x0*y0, z2 = x1*y1,
+     * z1 = (x0 + x1)(y0 + y1) - z0 - z2 - three multiplications instead of four.
+     */
+    magnitude_t multiply(const limb_t* left, std::size_t left_size, const limb_t* right, std::size_t right_size){
+        if(left_size < right_size){
+            std::swap(left, right);
+            std::swap(left_size, right_size);
+        }
+        if(right_size == 0)
+            return {};
+        if(right_size < karatsuba_threshold)
+            return multiply_schoolbook(left, left_size, right, right_size);
+
+        auto half = left_size / 2;
+        if(right_size <= half){
+            // несимметричный случай: режем только левый множитель
+            auto result = multiply(left, half, right, right_size);
+            auto high = multiply(left + half, left_size - half, right, right_size);
+            add_to(result, high.data(), high.size(), half);
+            trim_magnitude(result);
+            return result;
+        }
+        auto z0 = multiply(left, half, right, half);
+        auto z2 = multiply(left + half, left_size - half, right + half, right_size - half);
+
+        magnitude_t left_sum(left, left + half);
+        add_to(left_sum, left + half, left_size - half, 0);
+        trim_magnitude(left_sum);
+        magnitude_t right_sum(right, right + half);
+        add_to(right_sum, right + half, right_size - half, 0);
+        trim_magnitude(right_sum);
+
+        auto z1 = multiply(left_sum.data(), left_sum.size(), right_sum.data(), right_sum.size());
+        subtract_from(z1, z0);
+        subtract_from(z1, z2);
+
+        auto result = std::move(z0);
+        add_to(result, z1.data(), z1.size(), half);
+        add_to(result, z2.data(), z2.size(), 2 * half);
+        trim_magnitude(result);
+        return result;
+    }
+
+    // деление на одно слово, возвращает остаток
+    limb_t divide_by_limb(magnitude_t& value, limb_t divisor){
+        std::uint64_t remainder = 0;
+        for(auto i = value.size(); i-- > 0;){
+            std::uint64_t current = (remainder << 32) | value[i];
+            value[i] = static_cast<limb_t>(current / divisor);
+            remainder = current % divisor;
+        }
+        trim_magnitude(value);
+        return static_cast<limb_t>(remainder);
+    }
+
+    // Knuth, TAOCP vol. 2, 4.3.1, algorithm D. divisor has at least two limbs
+    void divide_magnitude(const magnitude_t& dividend, const magnitude_t& divisor,
+                          magnitude_t& quotient, magnitude_t& remainder){
+        auto n = divisor.size();
+        auto m = dividend.size() - n;
+        auto shift = std::countl_zero(divisor.back());
+
+        // нормализация: старший бит делителя должен быть единицей
+        magnitude_t v(n);
+        for(auto i = n - 1; i > 0; i--)
+            v[i] = (divisor[i] << shift) | static_cast<limb_t>(std::uint64_t{divisor[i - 1]} >> (32 - shift));
+        v[0] = divisor[0] << shift;
+        magnitude_t u(m + n + 1);
+        u[m + n] = static_cast<limb_t>(std::uint64_t{dividend[m + n - 1]} >> (32 - shift));
+        for(auto i = m + n - 1; i > 0; i--)
+            u[i] = (dividend[i] << shift) | static_cast<limb_t>(std::uint64_t{dividend[i - 1]} >> (32 - shift));
+        u[0] = dividend[0] << shift;
+
+        quotient.assign(m + 1, 0);
+        for(auto j = m + 1; j-- > 0;){
+            std::uint64_t numerator = (std::uint64_t{u[j + n]} << 32) | u[j + n - 1];
+            std::uint64_t q_hat = numerator / v[n - 1];
+            std::uint64_t r_hat = numerator % v[n - 1];
+            while(q_hat >= limb_base || q_hat * v[n - 2] > ((r_hat << 32) | u[j + n - 2])){
+                q_hat--;
+                r_hat += v[n - 1];
+                if(r_hat >= limb_base)
+                    break;
+            }
+            // u[j..j+n] -= q_hat * v
+            std::int64_t borrow = 0;
+            std::int64_t diff;
+            for(std::size_t i = 0; i < n; i++){
+                std::uint64_t product = q_hat * v[i];
+                diff = std::int64_t{u[i + j]} - borrow - static_cast<std::int64_t>(product & 0xFFFFFFFF);
+                u[i + j] = static_cast<limb_t>(diff);
+                borrow = static_cast<std::int64_t>(product >> 32) - (diff >> 32);
+            }
+            diff = std::int64_t{u[j + n]} - borrow;
+            u[j + n] = static_cast<limb_t>(diff);
+            quotient[j] = static_cast<limb_t>(q_hat);
+            if(diff < 0){
+                // q_hat оказался на единицу больше - возвращаем v обратно
+                quotient[j]--;
+                std::uint64_t carry = 0;
+                for(std::size_t i = 0; i < n; i++){
+                    std::uint64_t sum = std::uint64_t{u[i + j]} + v[i] + carry;
+                    u[i + j] = static_cast<limb_t>(sum);
+                    carry = sum >> 32;
+                }
+                u[j + n] = static_cast<limb_t>(std::uint64_t{u[j + n]} + carry);
+            }
+        }
+        remainder.assign(n, 0);
+        for(std::size_t i = 0; i + 1 < n; i++)
+            remainder[i] = (u[i] >> shift) | static_cast<limb_t>(std::uint64_t{u[i + 1]} << (32 - shift));
+        remainder[n - 1] = u[n - 1] >> shift;
+        trim_magnitude(quotient);
+        trim_magnitude(remainder);
+    }
+}
+
+big_int::big_int(std::int64_t value) : negative(value < 0) {
+    auto absolute = value < 0 ? std::uint64_t{0} - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value);
+    while(absolute != 0){
+        magnitude.push_back(static_cast<limb_t>(absolute));
+        absolute >>= 32;
+    }
+}
+
+big_int::big_int(std::string_view decimal) {
+    bool is_negative = false;
+    if(!decimal.empty() && (decimal.front() == '-' || decimal.front() == '+')){
+        is_negative = decimal.front() == '-';
+        decimal.remove_prefix(1);
+    }
+    if(decimal.empty())
+        throw std::invalid_argument{"big_int: empty number"};
+    // по 9 десятичных цифр за раз
+    auto first_chunk = decimal.size() % 9 == 0 ? 9 : decimal.size() % 9;
+    for(std::size_t position = 0; position < decimal.size();){
+        auto chunk_size = position == 0 ? first_chunk : 9;
+        std::uint64_t chunk = 0;
+        std::uint64_t scale = 1;
+        for(std::size_t i = 0; i < chunk_size; i++){
+            auto c = decimal[position + i];
+            if(c < '0' || c > '9')
+                throw std::invalid_argument{"big_int: bad digit"};
+            chunk = chunk * 10 + static_cast<std::uint64_t>(c - '0');
+            scale *= 10;
+        }
+        std::uint64_t carry = chunk;
+        for(auto&& limb : magnitude){
+            std::uint64_t current = std::uint64_t{limb} * scale + carry;
+            limb = static_cast<limb_t>(current);
+            carry = current >> 32;
+        }
+        if(carry != 0)
+            magnitude.push_back(static_cast<limb_t>(carry));
+        position += chunk_size;
+    }
+    trim_magnitude(magnitude);
+    negative = is_negative && !magnitude.empty();
+}
+
+bool big_int::is_zero() const {
+    return magnitude.empty();
+}
+
+bool big_int::is_negative() const {
+    return negative;
+}
+
+bool big_int::fits_int64() const {
+    if(magnitude.size() > 2)
+        return false;
+    std::uint64_t absolute = 0;
+    for(auto i = magnitude.size(); i-- > 0;)
+        absolute = (absolute << 32) | magnitude[i];
+    auto limit = static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max());
+    return negative ? absolute <= limit + 1 : absolute <= limit;
+}
+
+std::int64_t big_int::to_int64() const {
+    std::uint64_t absolute = 0;
+    for(auto i = magnitude.size(); i-- > 0;)
+        absolute = (absolute << 32) | magnitude[i];
+    return negative ? static_cast<std::int64_t>(std::uint64_t{0} - absolute) : static_cast<std::int64_t>(absolute);
+}
+
+std::string big_int::to_string() const {
+    if(magnitude.empty())
+        return "0";
+    std::string digits;
+    auto value = magnitude;
+    while(!value.empty()){
+        auto chunk = divide_by_limb(value, 1000000000);
+        for(int i = 0; i < 9 && (chunk != 0 || !value.empty()); i++){
+            digits.push_back(static_cast<char>('0' + chunk % 10));
+            chunk /= 10;
+        }
+    }
+    if(negative)
+        digits.push_back('-');
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+}
+
+const std::vector<big_int::limb_t> &big_int::limbs() const {
+    return magnitude;
+}
+
+big_int big_int::operator-() const {
+    auto result = *this;
+    result.negative = !negative && !magnitude.empty();
+    return result;
+}
+
+big_int operator+(const big_int &left, const big_int &right) {
+    big_int result;
+    if(left.negative == right.negative){
+        result.magnitude = left.magnitude;
+        add_to(result.magnitude, right.magnitude.data(), right.magnitude.size(), 0);
+        result.negative = left.negative;
+    }
+    else if(compare_magnitude(left.magnitude, right.magnitude) >= 0){
+        result.magnitude = left.magnitude;
+        subtract_from(result.magnitude, right.magnitude);
+        result.negative = left.negative;
+    }
+    else{
+        result.magnitude = right.magnitude;
+        subtract_from(result.magnitude, left.magnitude);
+        result.negative = right.negative;
+    }
+    result.trim();
+    return result;
+}
+
+big_int operator-(const big_int &left, const big_int &right) {
+    return left + (-right);
+}
+
+big_int operator*(const big_int &left, const big_int &right) {
+    big_int result;
+    result.magnitude = multiply(left.magnitude.data(), left.magnitude.size(),
+                                right.magnitude.data(), right.magnitude.size());
+    result.negative = left.negative != right.negative;
+    result.trim();
+    return result;
+}
+
+big_int operator/(const big_int &left, const big_int &right) {
+    big_int quotient;
+    big_int::divide(left, right, &quotient, nullptr);
+    return quotient;
+}
+
+big_int operator%(const big_int &left, const big_int &right) {
+    big_int remainder;
+    big_int::divide(left, right, nullptr, &remainder);
+    return remainder;
+}
+
+std::strong_ordering operator<=>(const big_int &left, const big_int &right) {
+    if(left.negative != right.negative)
+        return left.negative ? std::strong_ordering::less : std::strong_ordering::greater;
+    auto order = compare_magnitude(left.magnitude, right.magnitude);
+    if(left.negative)
+        order = -order;
+    return order <=> 0;
+}
+
+void big_int::divide(const big_int &left, const big_int &right, big_int *quotient, big_int *remainder) {
+    if(right.is_zero())
+        throw std::domain_error{"big_int: division by zero"};
+    magnitude_t q, r;
+    if(compare_magnitude(left.magnitude, right.magnitude) < 0){
+        r = left.magnitude;
+    }
+    else if(right.magnitude.size() == 1){
+        q = left.magnitude;
+        auto rest = divide_by_limb(q, right.magnitude.front());
+        if(rest != 0)
+            r.push_back(rest);
+    }
+    else{
+        divide_magnitude(left.magnitude, right.magnitude, q, r);
+    }
+    if(quotient != nullptr){
+        quotient->magnitude = std::move(q);
+        quotient->negative = left.negative != right.negative;
+        quotient->trim();
+    }
+    if(remainder != nullptr){
+        remainder->magnitude = std::move(r);
+        remainder->negative = left.negative;
+        remainder->trim();
+    }
+}
+
+void big_int::trim() {
+    trim_magnitude(magnitude);
+    if(magnitude.empty())
+        negative = false;
+}
@@ -0,0 +1,55 @@
+#ifndef LISPKIT_COMPILER_BIG_INT_HPP
+#define LISPKIT_COMPILER_BIG_INT_HPP
+
+#include <compare>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Arbitrary precision integer, used when int64_t arithmetic overflows.
+ * Sign and magnitude, the magnitude is stored in 32 bit limbs, least
+ * significant first, without leading zero limbs (zero has no limbs).
+ * Division truncates toward zero like the built-in integer division.
+ */
+class big_int{
+public:
+    using limb_t = std::uint32_t;
+
+    big_int() = default;
+    explicit big_int(std::int64_t value);
+    // throws std::invalid_argument on a malformed number
+    explicit big_int(std::string_view decimal);
+
+    bool is_zero() const;
+    bool is_negative() const;
+
+    bool fits_int64() const;
+    std::int64_t to_int64() const;
+
+    std::string to_string() const;
+
+    const std::vector<limb_t>& limbs() const;
+
+    big_int operator-() const;
+
+    friend big_int operator+(const big_int& left, const big_int& right);
+    friend big_int operator-(const big_int& left, const big_int& right);
+    friend big_int operator*(const big_int& left, const big_int& right);
+    // right must not be zero
+    friend big_int operator/(const big_int& left, const big_int& right);
+    friend big_int operator%(const big_int& left, const big_int& right);
+
+    friend bool operator==(const big_int& left, const big_int& right) = default;
+    friend std::strong_ordering operator<=>(const big_int& left, const big_int& right);
+
+private:
+    static void divide(const big_int& left, const big_int& right, big_int* quotient, big_int* remainder);
+    void trim();
+
+    bool negative = false;
+    std::vector<limb_t> magnitude;
+};
+
+#endif //LISPKIT_COMPILER_BIG_INT_HPP
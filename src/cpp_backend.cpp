@@ -0,0 +1,332 @@
+#include "cpp_backend.hpp"
+
+#include <algorithm>
+#include <format>
+#include <limits>
+#include <ranges>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include "interpreter.hpp"
+
+using namespace yy;
+
+namespace {
+    std::string string_literal(const std::string& str) {
+        std::string quoted = "\"";
+        for(char c : str){
+            if(c == '"' || c == '\\')
+                quoted += '\\';
+            quoted += c;
+        }
+        return quoted + '"';
+    }
+
+    std::string number_literal(AST_node::num_t number) {
+        if(number == std::numeric_limits<AST_node::num_t>::min())
+            return "rt::number(std::numeric_limits<std::int64_t>::min())";
+        return std::format("rt::number({})", number);
+    }
+
+    std::string function_name(std::size_t id) {
+        return std::format("f{}", id);
+    }
+
+    const std::string function_parameters = "(const rt::frame* env, const rt::value* args, std::size_t count)";
+}
+
+CppBackend::CppBackend(std::string file_name) :
+        file_name(std::move(file_name))
+{}
+
+std::string CppBackend::generate(const AST_node &program) {
+    functions.clear();
+    active.clear();
+    constants.clear();
+    //функция 0 - сама программа, у нее нет аргументов и окружения
+    open_function(0);
+    auto result = expression(program, AST_node{});
+    auto&& main_function = *functions.front();
+    main_function.body << std::string(4, ' ') << "return " << result << ";\n";
+
+    std::ostringstream out;
+    out << "// generated by lispkit_compiler from " << file_name << "\n"
+        << "#include <cstddef>\n#include <cstdint>\n#include <limits>\n\n"
+        << "#include \"lispkit_runtime.hpp\"\n\n"
+        << "namespace rt = lispkit_runtime;\n\n";
+    for(std::size_t i = 0; i < constants.size(); i++)
+        out << "static rt::value c" << i << ";\n";
+    out << "\nstatic void init_constants() {\n";
+    for(std::size_t i = 0; i < constants.size(); i++)
+        out << "    c" << i << " = " << constants[i] << ";\n";
+    out << "}\n\n";
+    for(std::size_t i = 1; i < functions.size(); i++)
+        out << "static rt::value " << function_name(i) << function_parameters << ";\n";
+    for(std::size_t i = 1; i < functions.size(); i++){
+        auto&& current = *functions[i];
+        out << "\nstatic rt::value " << function_name(i) << function_parameters << " {\n"
+            << "    rt::check_arity(count, " << current.arity << ");\n";
+        if(current.captured)
+            out << "    const rt::frame* self = rt::make_frame(env, args, count);\n";
+        else if(current.makes_closures)
+            out << "    const rt::frame* self = nullptr;\n";
+        out << current.body.str() << "}\n";
+    }
+    out << "\nstatic rt::value program() {\n";
+    if(main_function.makes_closures)
+        out << "    const rt::frame* self = nullptr;\n";
+    out << main_function.body.str() << "}\n\n"
+        << "extern \"C\" int lispkit_run() {\n"
+        << "    return rt::run(&init_constants, &program);\n"
+        << "}\n\n"
+        << "#ifndef LISPKIT_NO_MAIN\n"
+        << "int main() {\n"
+        << "    return lispkit_run();\n"
+        << "}\n"
+        << "#endif\n";
+    return out.str();
+}
+
+std::string CppBackend::expression(const AST_node &current, AST_node enviroment) {
+    if(current.is_number())
+        throw make_execution_error(file_name, "compilation", current, "cant resolve ID");
+    if(current.is_string())
+        return variable(current, enviroment);
+
+    auto&& current_list = current.to_list();
+    auto&& command_node = current_list.front();
+    if(!command_node.is_string())
+        throw make_execution_error(file_name, "compilation", current, "command name must be string");
+    auto&& command = command_node.to_string();
+
+    if(command == "QUOTE"){
+        return constant(current_list.back());
+    }
+    else if(command == "ADD" ||
+            command == "SUB" ||
+            command == "MUL" ||
+            command == "DIVE" ||
+            command == "REM" ||
+            command == "EQUAL" ||
+            command == "LEQ" ||
+            command == "CONS"
+    ){
+        auto iterator = current_list.begin(); ++iterator;
+        auto&& left_node = *iterator; ++iterator;
+        auto&& right_node = *iterator;
+        //порядок вычисления - как в коде SECD
+        std::string left;
+        std::string right;
+        if(command == "CONS"){
+            right = expression(right_node, enviroment);
+            left = expression(left_node, enviroment);
+        }
+        else{
+            left = expression(left_node, enviroment);
+            right = expression(right_node, enviroment);
+        }
+        static const std::unordered_map<std::string, std::string> operations = {
+                {"ADD", "add"}, {"SUB", "subtract"}, {"MUL", "multiply"}, {"DIVE", "divide"},
+                {"REM", "remainder"}, {"EQUAL", "equal"}, {"LEQ", "less_equal"}, {"CONS", "cons"}
+        };
+        auto result = temporary();
+        line() << "const rt::value " << result << " = rt::" << operations.at(command) << '(' << left << ", " << right << ");\n";
+        return result;
+    }
+    else if(command == "ATOM" ||
+            command == "CAR" ||
+            command == "CDR"
+    ){
+        auto argument = expression(current_list.back(), enviroment);
+        std::string operation = command == "ATOM" ? "atom" : (command == "CAR" ? "car" : "cdr");
+        auto result = temporary();
+        line() << "const rt::value " << result << " = rt::" << operation << '(' << argument << ");\n";
+        return result;
+    }
+    else if(command == "COND"){
+        auto iterator = current_list.begin(); ++iterator;
+        auto&& condition = *iterator; ++iterator;
+        auto&& true_branch = *iterator; ++iterator;
+        auto&& false_branch = *iterator;
+        auto condition_value = expression(condition, enviroment);
+        auto result = temporary();
+        auto&& target = *active.back();
+        line() << "rt::value " << result << ";\n";
+        line() << "if(rt::truth(" << condition_value << ")){\n";
+        target.indent++;
+        auto true_value = expression(true_branch, enviroment);
+        line() << result << " = " << true_value << ";\n";
+        target.indent--;
+        line() << "}\n";
+        line() << "else{\n";
+        target.indent++;
+        auto false_value = expression(false_branch, enviroment);
+        line() << result << " = " << false_value << ";\n";
+        target.indent--;
+        line() << "}\n";
+        return result;
+    }
+    else if(command == "LAMBDA"){
+        auto iterator = current_list.begin(); ++iterator;
+        auto&& lambda_arguments = *iterator; ++iterator;
+        auto&& lambda_body = *iterator;
+        if(!lambda_arguments.is_list())
+            throw make_execution_error(file_name, "compilation", current, "bad env");
+
+        enviroment.to_list().push_front(lambda_arguments);
+        active.back()->makes_closures = true;
+        auto&& lambda = open_function(lambda_arguments.to_list().size());
+        auto id = lambda.id;
+        close_function(expression(lambda_body, enviroment));
+
+        auto result = temporary();
+        line() << "const rt::value " << result << " = rt::make_closure(&" << function_name(id) << ", self);\n";
+        return result;
+    }
+    else if(command == "LET"){
+        //(LET (ADD X Y) (X (QUOTE 5)) (Y (QUOTE 4)))
+        auto arguments_end = current_list.rend(); arguments_end--; arguments_end--;
+        std::vector<std::string> values;
+        auto new_enviroment = AST_node{};
+        auto&& new_enviroment_list = new_enviroment.to_list();
+        for(auto arg_iterator = current_list.rbegin();
+            arg_iterator != arguments_end;
+            ++arg_iterator
+        ){
+            auto&& pair_list = arg_iterator->to_list();
+            values.push_back(expression(pair_list.back(), enviroment));
+            new_enviroment_list.push_front(pair_list.front());
+        }
+        std::reverse(values.begin(), values.end());
+        enviroment.to_list().push_front(new_enviroment);
+
+        auto function_node = current_list.begin(); ++function_node;
+        active.back()->makes_closures = true;
+        auto&& body = open_function(values.size());
+        auto id = body.id;
+        close_function(expression(*function_node, enviroment));
+
+        //тело LET известно - вызываем его напрямую, без замыкания
+        auto arguments = call_arguments(values);
+        auto result = temporary();
+        line() << "const rt::value " << result << " = " << function_name(id) << "(self, " << arguments << ", "
+               << values.size() << ");\n";
+        return result;
+    }
+    else{ //вызов функции
+        std::vector<std::string> values;
+        for(auto&& item : current_list | std::views::reverse)
+            values.push_back(expression(item, enviroment));
+        //последним вычислена сама функция
+        auto called = values.back();
+        values.pop_back();
+        std::reverse(values.begin(), values.end());
+        auto arguments = call_arguments(values);
+        auto result = temporary();
+        line() << "const rt::value " << result << " = rt::apply(" << called << ", " << arguments << ", "
+               << values.size() << ");\n";
+        return result;
+    }
+}
+
+std::string CppBackend::variable(const AST_node &current, const AST_node &enviroment) {
+    auto&& symbol_name = current.to_string();
+    if(!enviroment.is_list())
+        throw make_execution_error(file_name, "compilation", current, "bad env");
+    std::size_t i = 0;
+    for(auto&& internal_list : enviroment.to_list()){
+        if(!internal_list.is_list())
+            throw make_execution_error(file_name, "compilation", current, "bad env");
+        auto&& int_list = internal_list.to_list();
+        auto find_result = std::find_if(int_list.begin(), int_list.end(), [&symbol_name](const AST_node& symbol){
+            return symbol.is_string() && symbol.to_string() == symbol_name;
+        });
+        if(find_result != int_list.end()){
+            auto j = std::distance(int_list.begin(), find_result);
+            if(i == 0)
+                return std::format("args[{}]", j);
+            //кадры всех функций между текущей и той, чья это переменная, должны дожить до вызова
+            auto owner = active.size() - 1 - i;
+            for(auto k = owner; k < active.size() - 1; k++)
+                active[k]->captured = true;
+            std::string access = "env";
+            for(std::size_t level = 1; level < i; level++)
+                access += "->parent";
+            return std::format("{}->slots[{}]", access, j);
+        }
+        i++;
+    }
+    throw make_execution_error(file_name, "ID", current, std::format("using undeclared symbol {}", symbol_name));
+}
+
+std::string CppBackend::constant(const AST_node &quoted) {
+    if(quoted.is_num())
+        return number_literal(quoted.to_num());
+    //списки, символы и большие числа строятся один раз до запуска
+    std::vector<std::pair<const AST_node*, bool>> pending{{&quoted, false}};
+    std::vector<std::string> parts;
+    //обход без рекурсии: элемент списка раскрывается, затем собирается
+    std::vector<std::size_t> starts;
+    while(!pending.empty()){
+        auto [node, assembled] = pending.back();
+        pending.pop_back();
+        if(assembled){
+            auto start = starts.back();
+            starts.pop_back();
+            std::string items;
+            for(auto k = start; k < parts.size(); k++)
+                items += (k == start ? "" : ", ") + parts[k];
+            parts.resize(start);
+            parts.push_back(items.empty() ? "rt::value{}" : "rt::list({" + items + "})");
+        }
+        else if(node->is_string())
+            parts.push_back("rt::symbol(" + string_literal(node->to_string()) + ")");
+        else if(node->is_num())
+            parts.push_back(number_literal(node->to_num()));
+        else if(node->is_big())
+            parts.push_back("rt::big(\"" + node->to_big().to_string() + "\")");
+        else{
+            auto&& list = node->to_list();
+            starts.push_back(parts.size());
+            pending.emplace_back(node, true);
+            for(auto it = list.rbegin(); it != list.rend(); ++it)
+                pending.emplace_back(&*it, false);
+        }
+    }
+    constants.push_back(std::move(parts.front()));
+    return std::format("c{}", constants.size() - 1);
+}
+
+std::string CppBackend::call_arguments(const std::vector<std::string> &values) {
+    if(values.empty())
+        return "nullptr";
+    auto name = temporary();
+    auto&& out = line() << "const rt::value " << name << "[] = {";
+    for(std::size_t i = 0; i < values.size(); i++)
+        out << (i == 0 ? "" : ", ") << values[i];
+    out << "};\n";
+    return name;
+}
+
+CppBackend::function &CppBackend::open_function(std::size_t arity) {
+    auto&& created = functions.emplace_back(std::make_unique<function>());
+    created->id = functions.size() - 1;
+    created->arity = arity;
+    active.push_back(created.get());
+    return *created;
+}
+
+void CppBackend::close_function(const std::string &result) {
+    active.back()->body << std::string(4, ' ') << "return " << result << ";\n";
+    active.pop_back();
+}
+
+std::string CppBackend::temporary() {
+    return std::format("v{}", active.back()->temporaries++);
+}
+
+std::ostream &CppBackend::line() {
+    auto&& current = *active.back();
+    return current.body << std::string(4 * current.indent, ' ');
+}
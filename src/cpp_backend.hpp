@@ -0,0 +1,69 @@
+#ifndef LISPKIT_COMPILER_CPP_BACKEND_HPP
+#define LISPKIT_COMPILER_CPP_BACKEND_HPP
+
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AST.hpp"
+
+namespace yy {
+
+/**
+ * Ahead-of-time backend: the program as C++ source for the runtime in
+ * lispkit_runtime.hpp.
+ *
+ * Variables are resolved like Interpreter::compile resolves them for LD,
+ * the evaluation order is the one of the SECD code, so the program
+ * prints what execute_secd prints. Every LAMBDA and LET body becomes a
+ * C++ function of (env, arguments, count), a LET calls its body
+ * directly. The arguments stay on the C++ stack unless a closure made in
+ * the body can reach them, only then they are copied into a heap frame.
+ * Arithmetic, comparisons and list operations are inline calls with a
+ * small-number fast path.
+ *
+ * The result defines lispkit_run() and, unless LISPKIT_NO_MAIN is
+ * defined, main(). Build it with the runtime library:
+ *
+ *     c++ -std=c++20 -O2 -I src program.cpp liblispkit_runtime.a
+ */
+class CppBackend {
+public:
+    explicit CppBackend(std::string file_name = "input");
+
+    // throws std::runtime_error on the programs Interpreter::compile rejects
+    std::string generate(const AST_node& program);
+
+private:
+    struct function {
+        std::size_t id = 0;
+        std::size_t arity = 0;
+        bool captured = false;     // кадр нужен замыканиям внутри тела
+        bool makes_closures = false;
+        std::ostringstream body;
+        std::size_t temporaries = 0;
+        int indent = 1;
+    };
+
+    // C++ expression with the value of current, statements go to the current function
+    std::string expression(const AST_node& current, AST_node enviroment);
+    std::string variable(const AST_node& current, const AST_node& enviroment);
+    std::string constant(const AST_node& quoted);
+    std::string call_arguments(const std::vector<std::string>& values);
+
+    function& open_function(std::size_t arity);
+    void close_function(const std::string& result);
+    std::string temporary();
+    std::ostream& line();
+
+    std::string file_name;
+    std::vector<std::unique_ptr<function>> functions;
+    std::vector<function*> active;     // вложенность функций, последняя - текущая
+    std::vector<std::string> constants;
+};
+
+}
+
+#endif //LISPKIT_COMPILER_CPP_BACKEND_HPP
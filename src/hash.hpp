@@ -0,0 +1,27 @@
+#ifndef LISPKIT_COMPILER_HASH_HPP
+#define LISPKIT_COMPILER_HASH_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+namespace hashing{
+    constexpr std::uint64_t fnv_offset = 14695981039346656037ull;
+    constexpr std::uint64_t fnv_prime = 1099511628211ull;
+
+    // FNV-1a, hash can be chained through the seed
+    inline std::uint64_t fnv1a(const void* data, std::size_t size, std::uint64_t seed = fnv_offset){
+        auto bytes = static_cast<const unsigned char*>(data);
+        for(std::size_t i = 0; i < size; i++){
+            seed ^= bytes[i];
+            seed *= fnv_prime;
+        }
+        return seed;
+    }
+
+    inline std::uint64_t fnv1a(std::string_view str, std::uint64_t seed = fnv_offset){
+        return fnv1a(str.data(), str.size(), seed);
+    }
+}
+
+#endif //LISPKIT_COMPILER_HASH_HPP
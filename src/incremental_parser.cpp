@@ -0,0 +1,150 @@
+#include "incremental_parser.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace yy;
+
+namespace {
+    // пробельные символы сканера, все остальное - часть токена
+    bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n';
+    }
+
+    std::size_t skip_spaces(const std::string& text, std::size_t pos) {
+        while(pos < text.size() && is_space(text[pos]))
+            pos++;
+        return pos;
+    }
+
+    // конец сегмента, который начинается с непробельного символа pos
+    std::size_t segment_end(const std::string& text, std::size_t pos) {
+        if(text[pos] == ')')
+            return pos + 1;
+        if(text[pos] != '('){
+            while(pos < text.size() && !is_space(text[pos]) && text[pos] != '(' && text[pos] != ')')
+                pos++;
+            return pos;
+        }
+        std::size_t depth = 0;
+        for(; pos < text.size(); pos++){
+            if(text[pos] == '(')
+                depth++;
+            else if(text[pos] == ')' && --depth == 0)
+                return pos + 1;
+        }
+        return pos; // незакрытая скобка - до конца текста
+    }
+}
+
+IncrementalParser::change IncrementalParser::update(const std::string &new_text) {
+    //общие начало и конец старого и нового текста, между ними - правка
+    auto common = std::min(text.size(), new_text.size());
+    std::size_t prefix = std::mismatch(text.begin(), text.begin() + common, new_text.begin()).first - text.begin();
+    std::size_t suffix = 0;
+    while(suffix < common - prefix && text[text.size() - 1 - suffix] == new_text[new_text.size() - 1 - suffix])
+        suffix++;
+    if(prefix == text.size() && prefix == new_text.size())
+        return {segments.size(), 0, 0};
+    auto old_edit_end = text.size() - suffix;
+    auto new_edit_end = new_text.size() - suffix;
+    // сдвиг неизмененного хвоста, может быть отрицательным - считаем по модулю
+    auto delta = new_text.size() - text.size();
+    auto shift = [delta](std::size_t offset){ return offset + delta; };
+
+    //первый сегмент, который правка задевает или к которому примыкает
+    auto first = static_cast<std::size_t>(std::partition_point(segments.begin(), segments.end(), [&](const segment& current){
+        return current.end < prefix;
+    }) - segments.begin());
+    auto pos = first < segments.size() ? std::min(prefix, segments[first].begin) : prefix;
+
+    std::vector<std::pair<std::size_t, std::size_t>> bounds;
+    auto last = first;
+    while(true){
+        pos = skip_spaces(new_text, pos);
+        if(pos >= new_text.size()){
+            last = segments.size();
+            break;
+        }
+        //в неизмененном хвосте деление совпадает со старым, как только встретили начало старого сегмента
+        if(pos >= new_edit_end){
+            while(last < segments.size() && (segments[last].begin < old_edit_end || shift(segments[last].begin) < pos))
+                last++;
+            if(last < segments.size() && shift(segments[last].begin) == pos)
+                break;
+        }
+        auto end = segment_end(new_text, pos);
+        bounds.emplace_back(pos, end);
+        pos = end;
+    }
+    last = std::max(last, first);
+
+    text = new_text;
+    for(auto it = segments.begin() + last; it != segments.end(); ++it){
+        it->begin = shift(it->begin);
+        it->end = shift(it->end);
+    }
+    std::vector<segment> parsed;
+    parsed.reserve(bounds.size());
+    for(auto [begin, end] : bounds)
+        parsed.push_back(parse_segment(begin, end));
+    segments.erase(segments.begin() + first, segments.begin() + last);
+    segments.insert(segments.begin() + first, std::make_move_iterator(parsed.begin()), std::make_move_iterator(parsed.end()));
+    return {first, last - first, bounds.size()};
+}
+
+IncrementalParser::segment IncrementalParser::parse_segment(std::size_t begin, std::size_t end) {
+    segment result;
+    result.begin = begin;
+    result.end = end;
+    std::istringstream input{text.substr(begin, end - begin)};
+    std::ostream discard{nullptr};
+    Interpreter interpreter;
+    interpreter.check_number_of_arguments = check_number_of_arguments;
+    interpreter.switch_streams(&input, &discard);
+    result.ok = interpreter.parse() == 0 && !interpreter.is_error();
+    result.diagnostics = interpreter.get_diagnostics();
+    if(result.ok)
+        result.AST = std::move(interpreter.get_AST());
+    parsed_bytes += end - begin;
+    return result;
+}
+
+const std::vector<IncrementalParser::segment> &IncrementalParser::get_segments() const {
+    return segments;
+}
+
+std::vector<Interpreter::diagnostic> IncrementalParser::get_diagnostics() const {
+    std::vector<Interpreter::diagnostic> result;
+    unsigned int line = 1;
+    std::size_t line_start = 0;
+    std::size_t counted = 0;
+    for(std::size_t i = 0; i < segments.size(); i++){
+        auto&& current = segments[i];
+        if(current.diagnostics.empty() && i == 0)
+            continue;
+        //строка и столбец начала сегмента
+        for(; counted < current.begin; counted++){
+            if(text[counted] == '\n'){
+                line++;
+                line_start = counted + 1;
+            }
+        }
+        auto column = static_cast<unsigned int>(current.begin - line_start);
+        //грамматика принимает ровно одно выражение
+        if(i != 0)
+            result.push_back({line, column + 1, "the program must be a single expression, this one is extra"});
+        for(auto&& relative : current.diagnostics)
+            result.push_back({line + relative.line - 1, relative.line == 1 ? column + relative.column : relative.column,
+                              relative.message});
+    }
+    return result;
+}
+
+const std::string &IncrementalParser::get_text() const {
+    return text;
+}
+
+std::size_t IncrementalParser::get_parsed_bytes() const {
+    return parsed_bytes;
+}
@@ -0,0 +1,70 @@
+#ifndef LISPKIT_COMPILER_INCREMENTAL_PARSER_HPP
+#define LISPKIT_COMPILER_INCREMENTAL_PARSER_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AST.hpp"
+#include "interpreter.hpp"
+
+namespace yy {
+
+/**
+ * Parser for an editor buffer that changes a little at a time.
+ *
+ * The text is split into top-level segments: a parenthesised form up to
+ * its closing bracket (or the end of the text), a single atom or a stray
+ * closing bracket. Splitting needs only bracket counting, no scanner. On
+ * update() the changed range is found by comparing the new text with the
+ * previous one; only the segments it touches are split again and parsed,
+ * segments after it are kept with shifted offsets as soon as the new
+ * split reaches one of their starts.
+ *
+ * Every segment is parsed on its own, so the AST of a segment and the
+ * positions of its diagnostics are relative to the segment start.
+ * get_diagnostics() translates them into positions in the whole text.
+ */
+class IncrementalParser {
+public:
+    struct segment {
+        std::size_t begin = 0;   // offsets in the text, end is past the last byte
+        std::size_t end = 0;
+        bool ok = false;         // parsed without errors, AST is valid
+        AST_node AST;
+        std::vector<Interpreter::diagnostic> diagnostics;
+    };
+
+    // segments [first, first + removed) were replaced by `inserted` new ones
+    struct change {
+        std::size_t first = 0;
+        std::size_t removed = 0;
+        std::size_t inserted = 0;
+    };
+
+    change update(const std::string& new_text);
+
+    const std::vector<segment>& get_segments() const;
+
+    // positions in the whole text, in text order
+    std::vector<Interpreter::diagnostic> get_diagnostics() const;
+
+    const std::string& get_text() const;
+
+    // bytes handed to the parser by all update() calls
+    std::size_t get_parsed_bytes() const;
+
+    bool check_number_of_arguments = true;
+
+private:
+    segment parse_segment(std::size_t begin, std::size_t end);
+
+    std::string text;
+    std::vector<segment> segments;
+    std::size_t parsed_bytes = 0;
+};
+
+}
+
+#endif //LISPKIT_COMPILER_INCREMENTAL_PARSER_HPP
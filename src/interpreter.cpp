@@ -1,13 +1,53 @@
 #include "interpreter.hpp"
 
+#include <limits>
+#include <new>
+#include <optional>
 #include <sstream>
+#include <utility>
+
+#include "secd_image.hpp"
+#include "cpp_backend.hpp"
+#include "arithmetic.hpp"
+#include "packed_vector.hpp"
 
 using namespace yy;
 
 int Interpreter::parse() {
     m_location = 0;
+    m_error = false;
+    diagnostics.clear();
+    //новый текст - запись кэша, если она была, уже не про него
+    cached_entry.reset();
     
-    return m_parser.parse();
+    int result = m_parser.parse();
+    if(result == 0 && hash_consing){
+        for(auto&& form : forms)
+            form = intern_table.intern(std::move(form));
+        AST = forms.back();
+    }
+    return result;
+}
+
+int Interpreter::parse(const std::string &source, ProgramCache &cache) {
+    program_cache = &cache;
+    //в кэше одна форма на программу, модули разбираются мимо него
+    cached_entry = multiple_forms ? nullptr : cache.find(source, check_number_of_arguments);
+    if(cached_entry){
+        m_location = 0;
+        m_error = false;
+        diagnostics.clear();
+        AST = hash_consing ? intern_table.intern(cached_entry->AST) : cached_entry->AST;
+        forms.assign(1, AST);
+        (*output_stream) << "Success (cached)" << std::endl;
+        return 0;
+    }
+    source_input = std::istringstream{source};
+    switch_streams(&source_input, output_stream);
+    int result = parse();
+    if(result == 0 && !m_error && !multiple_forms)
+        cached_entry = cache.insert(source, check_number_of_arguments, AST);
+    return result;
 }
 
 void Interpreter::switch_streams(std::istream* is, std::ostream* os) {
@@ -30,14 +70,32 @@ unsigned int Interpreter::location() const {
     return m_location;
 }
 
+void Interpreter::add_diagnostic(const yy::position &position, std::string message) {
+    diagnostics.push_back({static_cast<unsigned int>(position.line), static_cast<unsigned int>(position.column), std::move(message)});
+}
+
+const std::vector<Interpreter::diagnostic> &Interpreter::get_diagnostics() const {
+    return diagnostics;
+}
+
 yy::position Interpreter::current_pos() {
     return yy::position{&file_name, static_cast<int>(m_lineno), static_cast<int>(m_column)};
 }
 
 AST_node &Interpreter::get_AST() {
+    //дерево могут заменить, и код из кэша к нему уже не относится
+    cached_entry.reset();
+    return AST;
+}
+
+const AST_node &Interpreter::get_AST() const {
     return AST;
 }
 
+const std::vector<AST_node> &Interpreter::get_forms() const {
+    return forms;
+}
+
 void Interpreter::set_file_name(const std::string &str) {
     file_name = str;
 }
@@ -45,6 +103,26 @@ void Interpreter::set_file_name(const std::string &str) {
 bool Interpreter::is_error() {
     return m_error;
 }
+
+MemoTable &Interpreter::get_memo_table() {
+    return memo_table;
+}
+
+const AST_intern_table &Interpreter::get_intern_table() const {
+    return intern_table;
+}
+
+const SECDProfile &Interpreter::get_secd_profile() const {
+    return secd_profile;
+}
+
+SamplingProfiler &Interpreter::get_sampling_profiler() {
+    return sampling_profiler;
+}
+
+const SECDJit &Interpreter::get_secd_jit() const {
+    return secd_jit;
+}
 /**
  *      {"QUOTE", {1, true}},
         {"CAR", {1, true}},
@@ -80,16 +158,16 @@ Interpreter::Interpreter(std::istream *inp)  :
 
 
     functions = {
-        {"QUOTE", [](AST_node& node, context_t context) -> AST_node{
+        {"QUOTE", [](const AST_node& node, context_t context) -> AST_node{
             //просто возвращает аргумент
             auto&& list = node.to_list();
             return list.back();
         }},
-        {"CAR", [this](AST_node& node, context_t context) -> AST_node{
+        {"CAR", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto&& argument = list.back();
             //вычисляем аргумент
-            auto arg_value = this->execute(argument, context);
+            const auto arg_value = this->execute(argument, context);
             //является ли аргумент списком
             if(!arg_value.is_list()){
                 //синтаксическая ошибка - аргумент должен быть списком
@@ -103,10 +181,10 @@ Interpreter::Interpreter(std::istream *inp)  :
                 return *arg_list.begin();
             }
         }},
-        {"CDR", [this](AST_node& node, context_t context) -> AST_node{
+        {"CDR", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto&& argument = list.back();
-            auto arg_value = this->execute(argument, context);
+            const auto arg_value = this->execute(argument, context);
             //является ли аргумент списком
             if(!arg_value.is_list()){
                 throw report_runtime_error("CDR", node, "the argument should be a list, but a non-list value was provided");
@@ -119,7 +197,7 @@ Interpreter::Interpreter(std::istream *inp)  :
             return_node.to_list() = AST_node::AST_node_list{++arg_list.begin(), arg_list.end()};
             return return_node;
         }},
-        {"CONS", [this](AST_node& node, std::unordered_map<std::string, AST_node> context) -> AST_node{
+        {"CONS", [this](const AST_node& node, std::unordered_map<std::string, AST_node> context) -> AST_node{
             auto&& list = node.to_list();
             auto&& new_head = *(++list.begin());
             auto&& new_tail = list.back();
@@ -135,7 +213,7 @@ Interpreter::Interpreter(std::istream *inp)  :
             tail_list.push_front(head_value);
             return tail_value;
         }},
-        {"ATOM", [this](AST_node& node, context_t context) -> AST_node{
+        {"ATOM", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto&& atom = list.back();
             auto atom_value = this->execute(atom, context);
@@ -146,7 +224,7 @@ Interpreter::Interpreter(std::istream *inp)  :
                 return AST_node::TRUE();
             }
         }},
-        {"EQUAL", [this](AST_node& node, context_t context) -> AST_node{
+        {"EQUAL", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto iterator = list.begin(); ++iterator;
             auto&& left = *iterator; ++iterator;
@@ -163,17 +241,21 @@ Interpreter::Interpreter(std::istream *inp)  :
                 return AST_node::FALSE();
             }
             else{
-                if(left_value.value.index() != left_value.value.index())
-                    return AST_node::FALSE();
+                if(left_value.is_number() && right_value.is_number()){
+                    return arithmetic::equal(left_value, right_value) ? AST_node::TRUE() : AST_node::FALSE();
+                }
                 else if (left_value.is_string() && right_value.is_string()){
                     return (left_value.to_string() == right_value.to_string()) ? AST_node::TRUE() : AST_node::FALSE();
                 }
+                else if(left_value.is_vector() && right_value.is_vector()){
+                    return left_value == right_value ? AST_node::TRUE() : AST_node::FALSE();
+                }
                 else{
-                    return (left_value.to_num() == right_value.to_num()) ? AST_node::TRUE() : AST_node::FALSE();
+                    return AST_node::FALSE();
                 }
             }
         }},
-        {"ADD", [this](AST_node& node, context_t context) -> AST_node{
+        {"ADD", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto iterator = list.begin(); ++iterator;
             auto&& left = *iterator; ++iterator;
@@ -181,16 +263,12 @@ Interpreter::Interpreter(std::istream *inp)  :
             auto left_value = this->execute(left, context);
             auto right_value = this->execute(right, context);
             //оба аргумента должны быть числами
-            if(!left_value.is_num() || !right_value.is_num()){
+            if(!left_value.is_number() || !right_value.is_number()){
                 throw report_runtime_error("ADD", node, "both arguments must be numeric values");
             }
-            auto&& left_num = left_value.to_num();
-            auto&& right_num = right_value.to_num();
-
-            left_num += right_num;
-            return left_value;
+            return arithmetic::add(left_value, right_value);
         }},
-        {"SUB", [this](AST_node& node, context_t context) -> AST_node{
+        {"SUB", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto iterator = list.begin(); ++iterator;
             auto&& left = *iterator; ++iterator;
@@ -198,16 +276,12 @@ Interpreter::Interpreter(std::istream *inp)  :
             auto left_value = this->execute(left, context);
             auto right_value = this->execute(right, context);
             //оба аргумента должны быть числами
-            if(!left_value.is_num() || !right_value.is_num()){
+            if(!left_value.is_number() || !right_value.is_number()){
                 throw report_runtime_error("SUB", node, "both arguments must be numeric values");
             }
-            auto&& left_num = left_value.to_num();
-            auto&& right_num = right_value.to_num();
-
-            left_num -= right_num;
-            return left_value;
+            return arithmetic::subtract(left_value, right_value);
         }},
-        {"MUL", [this](AST_node& node, context_t context) -> AST_node{
+        {"MUL", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto iterator = list.begin(); ++iterator;
             auto&& left = *iterator; ++iterator;
@@ -215,16 +289,12 @@ Interpreter::Interpreter(std::istream *inp)  :
             auto left_value = this->execute(left, context);
             auto right_value = this->execute(right, context);
             //оба аргумента должны быть числами
-            if(!left_value.is_num() || !right_value.is_num()){
+            if(!left_value.is_number() || !right_value.is_number()){
                 throw report_runtime_error("MUL", node, "both arguments must be numeric values");
             }
-            auto&& left_num = left_value.to_num();
-            auto&& right_num = right_value.to_num();
-
-            left_num *= right_num;
-            return left_value;
+            return arithmetic::multiply(left_value, right_value);
         }},
-        {"DIVE", [this](AST_node& node, context_t context) -> AST_node{
+        {"DIVE", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto iterator = list.begin(); ++iterator;
             auto&& left = *iterator; ++iterator;
@@ -232,16 +302,15 @@ Interpreter::Interpreter(std::istream *inp)  :
             auto left_value = this->execute(left, context);
             auto right_value = this->execute(right, context);
             //оба аргумента должны быть числами
-            if(!left_value.is_num() || !right_value.is_num()){
-                throw report_runtime_error("MUL", node, "both arguments must be numeric values");
+            if(!left_value.is_number() || !right_value.is_number()){
+                throw report_runtime_error("DIVE", node, "both arguments must be numeric values");
             }
-            auto&& left_num = left_value.to_num();
-            auto&& right_num = right_value.to_num();
-
-            left_num /= right_num;
-            return left_value;
+            if(arithmetic::is_zero(right_value)){
+                throw report_runtime_error("DIVE", node, "division by zero");
+            }
+            return arithmetic::divide(left_value, right_value);
         }},
-        {"REM", [this](AST_node& node, context_t context) -> AST_node{
+        {"REM", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto iterator = list.begin(); ++iterator;
             auto&& left = *iterator; ++iterator;
@@ -249,16 +318,15 @@ Interpreter::Interpreter(std::istream *inp)  :
             auto left_value = this->execute(left, context);
             auto right_value = this->execute(right, context);
             //оба аргумента должны быть числами
-            if(!left_value.is_num() || !right_value.is_num()){
-                throw report_runtime_error("MUL", node, "both arguments must be numeric values");
+            if(!left_value.is_number() || !right_value.is_number()){
+                throw report_runtime_error("REM", node, "both arguments must be numeric values");
             }
-            auto&& left_num = left_value.to_num();
-            auto&& right_num = right_value.to_num();
-
-            left_num %= right_num;
-            return left_value;
+            if(arithmetic::is_zero(right_value)){
+                throw report_runtime_error("REM", node, "division by zero");
+            }
+            return arithmetic::remainder(left_value, right_value);
         }},
-        {"LEQ", [this](AST_node& node, context_t context) -> AST_node{
+        {"LEQ", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto iterator = list.begin(); ++iterator;
             auto&& left = *iterator; ++iterator;
@@ -266,15 +334,12 @@ Interpreter::Interpreter(std::istream *inp)  :
             auto left_value = this->execute(left, context);
             auto right_value = this->execute(right, context);
             //оба аргумента должны быть числами
-            if(!left_value.is_num() || !right_value.is_num()){
-                throw report_runtime_error("MUL", node, "both arguments must be numeric values");
+            if(!left_value.is_number() || !right_value.is_number()){
+                throw report_runtime_error("LEQ", node, "both arguments must be numeric values");
             }
-            auto&& left_num = left_value.to_num();
-            auto&& right_num = right_value.to_num();
-
-            return left_num <= right_num ? AST_node::TRUE() : AST_node::FALSE();
+            return arithmetic::less_equal(left_value, right_value) ? AST_node::TRUE() : AST_node::FALSE();
         }},
-        {"COND", [this](AST_node& node, context_t context) -> AST_node{
+        {"COND", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto iterator = list.begin(); ++iterator;
             auto&& condition = *iterator; ++iterator;
@@ -300,11 +365,13 @@ Interpreter::Interpreter(std::istream *inp)  :
          * (LAMBDA (A B) (что то, что использует А Б))
          * должна преобразовать себя в вид ((аргументы)(тело))
          * тоесть просто удалить слово лямбда
+         * (в копии - само дерево программы не меняется, иначе лямбду нельзя вычислить дважды)
          */
-        {"LAMBDA", [this](AST_node& node, context_t context) ->AST_node {
+        {"LAMBDA", [this](const AST_node& node, context_t context) ->AST_node {
             auto&& list = node.to_list();
-            list.erase(list.begin());
-            return node;
+            AST_node function{};
+            function.to_list() = AST_node::AST_node_list{++list.begin(), list.end()};
+            return function;
         }},
         /**
          * предназначение: регистрация переменных в контекст
@@ -314,7 +381,7 @@ Interpreter::Interpreter(std::istream *inp)  :
          * 2. сохранить в контекст значения этих символов (исполнить их)
          * 3. послать сигнатуру функции на исполнение (в execute уже символы разыменуются)
          */
-        {"LET", [this](AST_node& node, context_t context) -> AST_node{
+        {"LET", [this](const AST_node& node, context_t context) -> AST_node{
             auto&& list = node.to_list();
             auto iterator = list.begin(); ++iterator;
             auto&& function = *iterator;
@@ -336,7 +403,7 @@ Interpreter::Interpreter(std::istream *inp)  :
                 auto &&current_list = current.to_list();
                 auto &&symbol_name = current_list.front().to_string();
                 auto &&symbol_definition = current_list.back();
-                auto symbol_value = this->execute(symbol_definition, context);
+                auto symbol_value = lazy ? delay(symbol_definition, context) : this->execute(symbol_definition, context);
                 context.insert({symbol_name, symbol_value});
                 registrated_symbols.insert(symbol_name);
             }
@@ -357,8 +424,90 @@ Interpreter::Interpreter(std::istream *inp)  :
             }
             return this->execute(function, context);
 
+        }},
+        /**
+         * (MAP F L), (FILTER F L), (FOLD F INIT L) - обход списка циклом, а не рекурсией
+         * пользовательской функции: форма функции проверяется один раз, на элемент -
+         * только локальный контекст и тело
+         */
+        {"MAP", [this](const AST_node& node, context_t context) -> AST_node{
+            auto&& list = node.to_list();
+            auto iterator = list.begin(); ++iterator;
+            auto function_value = this->execute(*iterator, context); ++iterator;
+            auto list_value = this->execute(*iterator, context);
+            if(!list_value.is_list())
+                throw report_runtime_error("MAP", node, "the second argument should be a list");
+            auto&& parameters = function_parameters(function_value, 1, "MAP", node);
+            auto&& body = std::as_const(function_value).to_list().back();
+            AST_node result{};
+            auto&& result_list = result.to_list();
+            context_t local_context;
+            for(auto&& elem : std::as_const(list_value).to_list()){
+                local_context.insert_or_assign(parameters.front().to_string(), elem);
+                result_list.push_back(this->execute(body, local_context));
+            }
+            return result;
+        }},
+        {"FILTER", [this](const AST_node& node, context_t context) -> AST_node{
+            auto&& list = node.to_list();
+            auto iterator = list.begin(); ++iterator;
+            auto function_value = this->execute(*iterator, context); ++iterator;
+            auto list_value = this->execute(*iterator, context);
+            if(!list_value.is_list())
+                throw report_runtime_error("FILTER", node, "the second argument should be a list");
+            auto&& parameters = function_parameters(function_value, 1, "FILTER", node);
+            auto&& body = std::as_const(function_value).to_list().back();
+            AST_node result{};
+            auto&& result_list = result.to_list();
+            context_t local_context;
+            for(auto&& elem : std::as_const(list_value).to_list()){
+                local_context.insert_or_assign(parameters.front().to_string(), elem);
+                auto keep = this->execute(body, local_context);
+                if(!keep.is_string() || (keep.to_string() != "TRUE" && keep.to_string() != "FALSE"))
+                    throw report_runtime_error("FILTER", node, "the function must return a boolean value");
+                if(keep.to_string() == "TRUE")
+                    result_list.push_back(elem);
+            }
+            return result;
+        }},
+        {"FOLD", [this](const AST_node& node, context_t context) -> AST_node{
+            //(FOLD F INIT L) = (F ... (F (F INIT L1) L2) ... Ln)
+            auto&& list = node.to_list();
+            auto iterator = list.begin(); ++iterator;
+            auto function_value = this->execute(*iterator, context); ++iterator;
+            auto accumulator = this->execute(*iterator, context); ++iterator;
+            auto list_value = this->execute(*iterator, context);
+            if(!list_value.is_list())
+                throw report_runtime_error("FOLD", node, "the third argument should be a list");
+            auto&& parameters = function_parameters(function_value, 2, "FOLD", node);
+            auto&& body = std::as_const(function_value).to_list().back();
+            context_t local_context;
+            for(auto&& elem : std::as_const(list_value).to_list()){
+                local_context.insert_or_assign(parameters.front().to_string(), std::move(accumulator));
+                local_context.insert_or_assign(parameters.back().to_string(), elem);
+                accumulator = this->execute(body, local_context);
+            }
+            return accumulator;
         }}
     };
+    //векторные функции: аргументы вычисляем здесь, остальное делает packed
+    for(auto&& builtin : packed::builtins()){
+        functions.insert({std::string{builtin.name}, [this, &builtin](const AST_node& node, context_t context) -> AST_node{
+            auto&& list = node.to_list();
+            if(static_cast<int>(list.size()) != builtin.arguments + 1)
+                throw report_runtime_error(std::string{builtin.name}, node, "wrong number of arguments");
+            AST_node arguments[2];
+            auto iterator = list.begin(); ++iterator;
+            for(int i = 0; i < builtin.arguments; i++, ++iterator)
+                arguments[i] = this->execute(*iterator, context);
+            try{
+                return builtin.apply(arguments);
+            }
+            catch(const packed::vector_error& error){
+                throw report_runtime_error(std::string{builtin.name}, node, error.what());
+            }
+        }});
+    }
 }
 
 /** (A B C)
@@ -373,16 +522,19 @@ Interpreter::Interpreter(std::istream *inp)  :
  * 3.4 нашли функцию, составлям для нее локальный контекст и исполняем
  */
 
-AST_node Interpreter::execute(AST_node& current, context_t context) {
-    if(current.is_num())
-        throw report_runtime_error("Execution", current, std::format("using undeclared symbol {}", current.to_num()));
+AST_node Interpreter::execute(const AST_node& current, context_t context) try {
+    LimitGuard::nesting nesting{active_limits};
+    if(active_limits && !active_limits->nested_step())
+        throw report_runtime_error("Execution", current, active_limits->reason());
+    if(current.is_number())
+        throw report_runtime_error("Execution", current, std::format("using undeclared symbol {}", current.print_tree()));
     else if(current.is_string()){
         auto context_find = context.find(current.to_string());
         if(context_find == context.end()){ // не нашли
             throw report_runtime_error("Execution", current, std::format("using undeclared symbol {}", current.to_string()));
         }
         else{
-            return (*context_find).second;
+            return lazy ? force(context_find->second) : context_find->second;
         }
     }
     else{ // если список
@@ -395,12 +547,13 @@ AST_node Interpreter::execute(AST_node& current, context_t context) {
         // поиск функции в библиотечных
         auto default_find = functions.find(function_name);
         if(default_find != functions.end()){ //если функция библиотечная
+            SamplingProfiler::frame_scope frame{active_sampler, function_name, true, current};
             return default_find->second(current, context);
         }
         //если не нашли, тогда ищем в контексте
         auto context_find = context.find(function_name);
         if(context_find != context.end()){
-            auto&& function_value = context_find->second;
+            const auto& function_value = lazy ? force(context_find->second) : context_find->second;
             /**
              * функция должна к нам попадать вида
              * (
@@ -424,11 +577,10 @@ AST_node Interpreter::execute(AST_node& current, context_t context) {
             if(!function_arguments_decl.is_list()){
                 throw report_runtime_error("Execute", current, "function argument declaration must be list");
             }
-            if(!function_arguments_decl.is_list()){
+            if(!function_body.is_list()){
                 throw report_runtime_error("Execute", current, "function body declaration must be list");
             }
             auto&& arguments_list = function_arguments_decl.to_list();
-            auto&& body_list = function_body.to_list();
 
             //проверка на количество аргументов вызываемой функции
             auto&& declarated_arg_count = arguments_list.size();
@@ -440,17 +592,31 @@ AST_node Interpreter::execute(AST_node& current, context_t context) {
 
             }
             //создание локального контекста
+            //в lazy-режиме аргументы - отложенные вычисления, запоминать по ним вызовы нельзя
+            const bool memoize_call = memoize && !lazy;
             context_t local_context;
+            AST_node argument_values{}; //нужны только для мемоизации
             auto list_iterator = list.begin(); ++list_iterator; //итератор по значениям аргументов
             for(auto&& argument : arguments_list){
                 //аргумент должен быть строкой
                 if(!argument.is_string())
                     throw report_runtime_error("Execution", current, "argument must be string");
                 auto&& argument_str = argument.to_string();
-                auto argument_value = this->execute(*list_iterator, context);
+                auto argument_value = lazy ? delay(*list_iterator, context) : this->execute(*list_iterator, context);
+                if(memoize_call)
+                    argument_values.to_list().push_back(argument_value);
                 local_context.insert({argument_str, argument_value});
                 ++list_iterator;
             }
+            SamplingProfiler::frame_scope frame{active_sampler, function_name, false, current};
+            if(memoize_call){
+                auto key = MemoTable::make_key(function_value, argument_values);
+                if(auto memoized = memo_table.find(key, function_value, argument_values))
+                    return *memoized;
+                auto result = this->execute(function_body, local_context);
+                memo_table.insert(key, function_value, std::move(argument_values), result);
+                return result;
+            }
             //исполнение тела функции в соответствии с локальным контекстом
             return this->execute(function_body, local_context);
         }
@@ -459,28 +625,142 @@ AST_node Interpreter::execute(AST_node& current, context_t context) {
         }
     }
 }
+catch(const execution_error& error){
+    //обработчик ничего не стоит, пока ошибок нет
+    if(error.is_located() || !current.location().known())
+        throw;
+    throw report_runtime_error(error.get_command(), current, error.get_description());
+}
+
+const AST_node::AST_node_list &Interpreter::function_parameters(const AST_node &function_value, std::size_t count,
+                                                              const std::string &command, const AST_node &node) {
+    //те же проверки, что и при вызове функции в execute
+    if(!function_value.is_list())
+        throw report_runtime_error(command, node, "the first argument should be a function");
+    auto&& function_value_list = function_value.to_list();
+    if(function_value_list.size() != 2 || !function_value_list.front().is_list() || !function_value_list.back().is_list())
+        throw report_runtime_error(command, node, "wrong function declaration");
+    auto&& parameters = function_value_list.front().to_list();
+    if(parameters.size() != count)
+        throw report_runtime_error(command, node, std::format("the function should take {} argument{}", count, count == 1 ? "" : "s"));
+    for(auto&& parameter : parameters)
+        if(!parameter.is_string())
+            throw report_runtime_error(command, node, "argument must be string");
+    return parameters;
+}
+
+AST_node Interpreter::delay(const AST_node &expression, const context_t &context) {
+    if(expression.is_string()){
+        //переменная уже связана со значением или отложенным вычислением - делим его
+        auto context_find = context.find(expression.to_string());
+        if(context_find != context.end())
+            return context_find->second;
+        return this->execute(expression, context);
+    }
+    if(expression.is_list()){
+        //константу и функцию дешевле построить сразу
+        auto&& list = expression.to_list();
+        if(!list.empty() && list.front().is_string() &&
+           (list.front().to_string() == "QUOTE" || list.front().to_string() == "LAMBDA"))
+            return this->execute(expression, context);
+    }
+    thunks.push_back({expression, context, AST_node{}, false});
+    AST_node marker{};
+    marker.to_list().push_back(AST_node{std::string{"#THUNK"}});
+    marker.to_list().push_back(AST_node{static_cast<AST_node::num_t>(thunks.size() - 1)});
+    return marker;
+}
+
+const AST_node &Interpreter::force(const AST_node &value) {
+    //"#THUNK" не может прийти из исходного текста - такой идентификатор лексер не пропустит
+    if(!value.is_list())
+        return value;
+    auto&& list = value.to_list();
+    if(list.size() != 2 || !list.front().is_string() || list.front().to_string() != "#THUNK")
+        return value;
+    auto&& delayed = thunks[static_cast<std::size_t>(list.back().to_num())];
+    if(!delayed.forced){
+        //контекст больше не нужен - отдаем его вычислению целиком
+        delayed.value = this->execute(delayed.expression, std::move(delayed.context));
+        delayed.forced = true;
+    }
+    return delayed.value;
+}
 
 void Interpreter::execute() {
+    thunks.clear();
+    if(profile_execute){
+        sampling_profiler.start(file_name);
+        active_sampler = &sampling_profiler;
+    }
+    std::optional<LimitGuard> guard;
+    if(limits.any())
+        active_limits = &guard.emplace(limits);
     try{
         auto result = this->execute(AST, {});
-        (*output_stream) << result.print_tree() << std::endl;
+        result.print(*output_stream, print_depth, print_length);
+        (*output_stream) << std::endl;
     }
     catch(std::runtime_error& err){
         (*output_stream) << "Execution error: " << err.what() << std::endl;
         m_error = true;
     }
+    catch(std::bad_alloc&){
+        (*output_stream) << "Execution error: out of memory" << std::endl;
+        m_error = true;
+    }
+    thunks.clear();
+    active_limits = nullptr;
+    if(active_sampler){
+        active_sampler = nullptr;
+        sampling_profiler.stop();
+    }
+}
+
+execution_error::execution_error(const std::string &message, std::string command, std::string description, bool located) :
+        std::runtime_error(message),
+        command(std::move(command)),
+        description(std::move(description)),
+        located(located)
+{}
+
+const std::string &execution_error::get_command() const {
+    return command;
+}
+
+const std::string &execution_error::get_description() const {
+    return description;
+}
+
+bool execution_error::is_located() const {
+    return located;
+}
+
+execution_error yy::make_execution_error(const std::string &file_name, std::string command, const AST_node &node,
+                                         std::string description) {
+    auto location = node.location();
+    if(location.known()){
+        auto message = std::format("{}:{}:{}: error in {} expression - {}\n", file_name, location.line, location.column,
+                                   command, description);
+        return execution_error{message, std::move(command), std::move(description), true};
+    }
+    //позиции нет (атом или значение, построенное при исполнении) - печатаем само выражение
+    auto message = std::format("Error in {} expression '{}' - {}\n", command, node.print_tree(3), description);
+    return execution_error{message, std::move(command), std::move(description), false};
 }
 
-std::runtime_error
-Interpreter::report_runtime_error(std::string command, AST_node &node, std::string error_description) {
-    std::stringstream error_str;
-    error_str << "Error in " << command << " expression '" << node.print_tree(3) << "' - " << error_description << std::endl;
-    return std::runtime_error(error_str.str());
+execution_error
+Interpreter::report_runtime_error(std::string command, const AST_node &node, std::string error_description) {
+    return make_execution_error(file_name, std::move(command), node, std::move(error_description));
 }
 
-void Interpreter::report_runtime_warning(std::string command, AST_node &node, std::string error_description) {
-    std::stringstream error_str;
-    (*output_stream) << "Warning in " << command << " expression '" << node.print_tree(3) << "' - " << error_description << std::endl;
+void Interpreter::report_runtime_warning(std::string command, const AST_node &node, std::string error_description) {
+    auto location = node.location();
+    if(location.known())
+        (*output_stream) << file_name << ':' << location.line << ':' << location.column << ": warning in "
+                         << command << " expression - " << error_description << std::endl;
+    else
+        (*output_stream) << "Warning in " << command << " expression '" << node.print_tree(3) << "' - " << error_description << std::endl;
 }
 
 bool Interpreter::is_existing_symbol(const std::string &symbol, const context_t& context) {
@@ -496,9 +776,10 @@ bool Interpreter::is_existing_symbol(const std::string &symbol, const context_t&
 
 void Interpreter::execute_secd(){
     try{
-        auto result = execute_secd_internal();
+        auto result = execute_secd_internal(AST, AST_node{});
         for(auto&& elem : result.to_list()){
-            (*output_stream) << elem.print_tree() << ' ';
+            elem.print(*output_stream, print_depth, print_length);
+            (*output_stream) << ' ';
         }
         (*output_stream) << std::endl;
     }
@@ -506,16 +787,121 @@ void Interpreter::execute_secd(){
         (*output_stream) << "Execution error: " << err.what() << std::endl;
         m_error = true;
     }
+    catch(std::bad_alloc&){
+        (*output_stream) << "Execution error: out of memory" << std::endl;
+        m_error = true;
+    }
+    if(profile_secd)
+        secd_profile.finish();
 }
 
-AST_node Interpreter::execute_secd_internal() {
-    if(!AST.is_list()){
-        throw report_runtime_error("SECD", AST, "");
+AST_node Interpreter::execute_secd_internal(const AST_node& program, AST_node enviroment) {
+    if(!program.is_list()){
+        throw report_runtime_error("SECD", program, "");
     }
     auto stack_node = AST_node{};
-    auto enviroment = AST_node{};
-    auto commands = AST;
+    auto commands = program;
     auto dump_node = AST_node{};
+    //вызовы, результат которых надо запомнить при RTN (только при memoize)
+    struct pending_call{
+        std::uint64_t key;
+        AST_node closure;
+        AST_node arguments;
+        std::size_t dump_depth;
+    };
+    std::vector<pending_call> pending_calls;
+    //обещания LDE, в стеке и окружении лежит ("#PROMISE" номер)
+    struct promise{
+        AST_node code;
+        AST_node enviroment;
+        AST_node value;
+        bool forced;
+    };
+    std::vector<promise> promises;
+    //по обещаниям в аргументах вызовы не запоминаются
+    const bool memoize_calls = memoize && !lazy;
+    //MAP, FILTER, FOLD: замыкание вызывается без записей в dump, его RTN узнается по глубине dump
+    struct native_loop{
+        std::string command;
+        AST_node instruction;
+        AST_node code;
+        AST_node closure_enviroment;
+        AST_node source;                    // держит список, по которому идут итераторы
+        AST_node::AST_node_list::const_iterator next;
+        AST_node::AST_node_list::const_iterator end;
+        AST_node element;                   // аргумент текущего вызова, нужен FILTER
+        AST_node result;                    // собранный список или аккумулятор FOLD
+        AST_node stack;
+        AST_node enviroment;
+        AST_node commands;
+        std::size_t dump_depth;
+    };
+    std::vector<native_loop> loops;
+    //стек кадров: аргументы функций с RTS лежат подряд, frame_bases - начала кадров
+    std::vector<AST_node> frame_slots;
+    std::vector<std::size_t> frame_bases;
+    //кадр функции, которая кончается RTS, кладется на стек кадров, а не в окружение
+    auto enter = [&](const AST_node& code, const AST_node& closure_enviroment, AST_node arguments){
+        auto&& code_list = std::as_const(code).to_list();
+        if(!code_list.empty() && code_list.back().is_string() && code_list.back().to_string() == "RTS"){
+            frame_bases.push_back(frame_slots.size());
+            for(auto&& argument : std::as_const(arguments).to_list())
+                frame_slots.push_back(argument);
+            enviroment = closure_enviroment;
+        }
+        else{
+            enviroment = closure_enviroment;
+            enviroment.to_list().push_front(std::move(arguments));
+        }
+        commands = code;
+    };
+    const bool native_calls = jit && !memoize;
+    auto* profile = profile_secd ? &secd_profile : nullptr;
+    if(profile)
+        profile->start(program, file_name);
+    std::optional<LimitGuard> guard;
+    if(limits.any())
+        guard.emplace(limits);
+    //результат очередного вызова замыкания цикла
+    auto accept = [&](native_loop& loop, AST_node value){
+        if(loop.command == "FOLD")
+            loop.result = std::move(value);
+        else if(loop.command == "MAP")
+            loop.result.to_list().push_back(std::move(value));
+        else{
+            if(!value.is_string() || (value.to_string() != "TRUE" && value.to_string() != "FALSE"))
+                throw report_runtime_error("SECD FILTER", loop.instruction, "the function must return a boolean value");
+            if(value.to_string() == "TRUE")
+                loop.result.to_list().push_back(loop.element);
+        }
+    };
+    //вызывает замыкание со следующим элементом или, если список кончился, возвращает результат цикла
+    auto advance = [&](native_loop& loop){
+        while(loop.next != loop.end){
+            loop.element = *loop.next++;
+            auto arguments = AST_node{};
+            if(loop.command == "FOLD")
+                arguments.to_list().push_back(loop.result);
+            arguments.to_list().push_back(loop.element);
+            if(profile)
+                profile->closure_called(loop.code);
+            if(native_calls){
+                AST_node native_result;
+                if(secd_jit.try_call(loop.code, arguments, guard ? &*guard : nullptr, native_result)){
+                    accept(loop, std::move(native_result));
+                    continue;
+                }
+            }
+            enter(loop.code, loop.closure_enviroment, std::move(arguments));
+            stack_node = AST_node{};
+            return;
+        }
+        stack_node = std::move(loop.stack);
+        enviroment = std::move(loop.enviroment);
+        commands = std::move(loop.commands);
+        stack_node.to_list().push_front(std::move(loop.result));
+        loops.pop_back();
+    };
     //secd - stack, enviroment, command, dump
     while(true){
         if(!stack_node.is_list()){
@@ -538,8 +924,24 @@ AST_node Interpreter::execute_secd_internal() {
             throw report_runtime_error("SECD", current, "command should be string");
         }
         auto command = current.to_string();
+        if(profile)
+            profile->begin_instruction(command, stack.size(), dump.size());
+        if(guard && !guard->step(std::max(stack.size(), dump.size())))
+            throw report_runtime_error("SECD", current, guard->reason());
 
         command_list.erase(command_list.begin());
+        //ADD_N, SEL_B и т.п. доверяют доказательству compile(), но код мог прийти и не из него
+        //(SECD-панель, образ, модуль) - одна проверка тегов, при несовпадении обычная команда
+        if(command.ends_with("_N") || command == "SEL_B"){
+            auto operand = std::as_const(stack).begin();
+            bool proven = command == "SEL_B"
+                    ? operand != stack.end() && operand->is_string() &&
+                      (operand->to_string() == "TRUE" || operand->to_string() == "FALSE")
+                    : operand != stack.end() && operand->is_number() &&
+                      ++operand != stack.end() && operand->is_number();
+            if(!proven)
+                command.resize(command.size() - 2);
+        }
         if(command == "STOP"){
             return stack_node;
         }
@@ -548,71 +950,120 @@ AST_node Interpreter::execute_secd_internal() {
             stack.erase(stack.begin());
             auto right = stack.front();
             stack.erase(stack.begin());
-            if(!left.is_num() || !right.is_num()){
+            if(!left.is_number() || !right.is_number()){
                 throw report_runtime_error("SECD", current, "arguments should be numbers");
             }
-            right.to_num() += left.to_num();
-            stack.push_front(right);
+            stack.push_front(arithmetic::add(right, left));
+        }
+        else if(command == "ADD_N"){
+            auto left = stack.front();
+            stack.erase(stack.begin());
+            auto right = stack.front();
+            stack.erase(stack.begin());
+            stack.push_front(arithmetic::add(right, left));
         }
         else if(command == "SUB"){
             auto left = stack.front();
             stack.erase(stack.begin());
             auto right = stack.front();
             stack.erase(stack.begin());
-            if(!left.is_num() || !right.is_num()){
+            if(!left.is_number() || !right.is_number()){
                 throw report_runtime_error("SECD", current, "arguments should be numbers");
             }
-            right.to_num() -= left.to_num();
-            stack.push_front(right);
+            stack.push_front(arithmetic::subtract(right, left));
+        }
+        else if(command == "SUB_N"){
+            auto left = stack.front();
+            stack.erase(stack.begin());
+            auto right = stack.front();
+            stack.erase(stack.begin());
+            stack.push_front(arithmetic::subtract(right, left));
         }
         else if(command == "MUL"){
             auto left = stack.front();
             stack.erase(stack.begin());
             auto right = stack.front();
             stack.erase(stack.begin());
-            if(!left.is_num() || !right.is_num()){
+            if(!left.is_number() || !right.is_number()){
                 throw report_runtime_error("SECD", current, "arguments should be numbers");
             }
-            left.to_num() *= right.to_num();
-            stack.push_front(left);
+            stack.push_front(arithmetic::multiply(left, right));
+        }
+        else if(command == "MUL_N"){
+            auto left = stack.front();
+            stack.erase(stack.begin());
+            auto right = stack.front();
+            stack.erase(stack.begin());
+            stack.push_front(arithmetic::multiply(left, right));
         }
         else if(command == "DIVE"){
             auto left = stack.front();
             stack.erase(stack.begin());
             auto right = stack.front();
             stack.erase(stack.begin());
-            if(!left.is_num() || !right.is_num()){
+            if(!left.is_number() || !right.is_number()){
                 throw report_runtime_error("SECD", current, "arguments should be numbers");
             }
-            right.to_num() /= left.to_num();
-            stack.push_front(right);
+            if(arithmetic::is_zero(left)){
+                throw report_runtime_error("SECD", current, "division by zero");
+            }
+            stack.push_front(arithmetic::divide(right, left));
+        }
+        else if(command == "DIVE_N"){
+            auto left = stack.front();
+            stack.erase(stack.begin());
+            auto right = stack.front();
+            stack.erase(stack.begin());
+            if(arithmetic::is_zero(left)){
+                throw report_runtime_error("SECD", current, "division by zero");
+            }
+            stack.push_front(arithmetic::divide(right, left));
         }
         else if(command == "REM"){
             auto left = stack.front();
             stack.erase(stack.begin());
             auto right = stack.front();
             stack.erase(stack.begin());
-            if(!left.is_num() || !right.is_num()){
+            if(!left.is_number() || !right.is_number()){
                 throw report_runtime_error("SECD", current, "arguments should be numbers");
             }
-            right.to_num() %= left.to_num();
-            stack.push_front(right);
+            if(arithmetic::is_zero(left)){
+                throw report_runtime_error("SECD", current, "division by zero");
+            }
+            stack.push_front(arithmetic::remainder(right, left));
+        }
+        else if(command == "REM_N"){
+            auto left = stack.front();
+            stack.erase(stack.begin());
+            auto right = stack.front();
+            stack.erase(stack.begin());
+            if(arithmetic::is_zero(left)){
+                throw report_runtime_error("SECD", current, "division by zero");
+            }
+            stack.push_front(arithmetic::remainder(right, left));
         }
         else if(command == "LEQ"){
             auto left = stack.front();
             stack.erase(stack.begin());
             auto right = stack.front();
             stack.erase(stack.begin());
-            if(!left.is_num() || !right.is_num()){
+            if(!left.is_number() || !right.is_number()){
                 throw report_runtime_error("SECD", current, "arguments should be numbers");
             }
-            if(right.to_num() <= left.to_num()){
+            if(arithmetic::less_equal(right, left)){
                 stack.push_front(AST_node::TRUE());
             }
             else{
                 stack.push_front(AST_node::FALSE());
             }
         }
+        else if(command == "LEQ_N"){
+            auto left = stack.front();
+            stack.erase(stack.begin());
+            auto right = stack.front();
+            stack.erase(stack.begin());
+            stack.push_front(arithmetic::less_equal(right, left) ? AST_node::TRUE() : AST_node::FALSE());
+        }
         else if(command == "EQ"){
             auto left = stack.front();
             stack.erase(stack.begin());
@@ -621,21 +1072,31 @@ AST_node Interpreter::execute_secd_internal() {
             if(left.is_list() && right.is_list()){
                 throw report_runtime_error("SECD", current, "both arguments cant be lists");
             }
-            if(left.value.index() != right.value.index()){
-                stack.push_front(AST_node::FALSE());
-            }
-            if(left.is_num()){
-               if(left.to_num() == right.to_num())
+            if(left.is_number() && right.is_number()){
+               if(arithmetic::equal(left, right))
                    stack.push_front(AST_node::TRUE());
                else
                    stack.push_front(AST_node::FALSE());
             }
+            else if(left.value.index() != right.value.index()){
+                stack.push_front(AST_node::FALSE());
+            }
             else if(left.is_string()){
                 if(left.to_string() == right.to_string())
                     stack.push_front(AST_node::TRUE());
                 else
                     stack.push_front(AST_node::FALSE());
             }
+            else if(left.is_vector()){
+                stack.push_front(left == right ? AST_node::TRUE() : AST_node::FALSE());
+            }
+        }
+        else if(command == "EQ_N"){
+            auto left = stack.front();
+            stack.erase(stack.begin());
+            auto right = stack.front();
+            stack.erase(stack.begin());
+            stack.push_front(arithmetic::equal(left, right) ? AST_node::TRUE() : AST_node::FALSE());
         }
         else if(command == "LDC"){
             auto constant = command_list.front();
@@ -662,7 +1123,7 @@ AST_node Interpreter::execute_secd_internal() {
             stack.push_front(b);
         }
         else if(command == "CAR"){
-            auto list_node = stack.front();
+            const auto list_node = stack.front();
             stack.erase(stack.begin());
             if(!list_node.is_list()){
                 throw report_runtime_error("SECD CAR", current, "CAR argument must be list");
@@ -683,13 +1144,24 @@ AST_node Interpreter::execute_secd_internal() {
         else if(command == "LDF"){
             auto function = command_list.front();
             command_list.erase(command_list.begin());
+            if(profile)
+                profile->closure_created(function);
             auto closure = AST_node{};
             closure.to_list().push_front(function);
             closure.to_list().push_back(enviroment);
             stack.push_front(closure);
         }
+        else if(command == "LDE"){
+            auto code = command_list.front();
+            command_list.erase(command_list.begin());
+            promises.push_back({code, enviroment, AST_node{}, false});
+            auto marker = AST_node{};
+            marker.to_list().push_back(AST_node{std::string{"#PROMISE"}});
+            marker.to_list().push_back(AST_node{static_cast<AST_node::num_t>(promises.size() - 1)});
+            stack.push_front(marker);
+        }
         else if(command == "LD"){
-            auto index_pair = command_list.front();
+            const auto index_pair = command_list.front();
             command_list.erase(command_list.begin());
             if(!index_pair.is_list()){
                 throw report_runtime_error("SECD LD", current, "index pair must be list");
@@ -706,7 +1178,7 @@ AST_node Interpreter::execute_secd_internal() {
             auto&& x_num = x.to_num();
             auto&& y_num = y.to_num();
 
-            auto&& enviroment_list = enviroment.to_list();
+            auto&& enviroment_list = std::as_const(enviroment).to_list();
 
             if(enviroment_list.size() < (x_num + 1)){
                 throw report_runtime_error("SECD LD", current, "cant find");
@@ -726,6 +1198,18 @@ AST_node Interpreter::execute_secd_internal() {
             std::advance(second_iterator, y_num);
             stack.push_front(*second_iterator);
         }
+        else if(command == "LDS"){
+            const auto index = command_list.front();
+            command_list.erase(command_list.begin());
+            if(!index.is_num()){
+                throw report_runtime_error("SECD LDS", current, "index must be numeric value");
+            }
+            if(frame_bases.empty() || index.to_num() < 0 ||
+               frame_bases.back() + static_cast<std::size_t>(index.to_num()) >= frame_slots.size()){
+                throw report_runtime_error("SECD LDS", current, "cant find");
+            }
+            stack.push_front(frame_slots[frame_bases.back() + static_cast<std::size_t>(index.to_num())]);
+        }
         else if(command == "SEL"){
             auto true_branch = command_list.front();
             command_list.erase(command_list.begin());
@@ -750,6 +1234,18 @@ AST_node Interpreter::execute_secd_internal() {
                 throw report_runtime_error("SECD SEL", current, "condition must be boolean");
             }
         }
+        else if(command == "SEL_B"){
+            //условие - заведомо TRUE или FALSE
+            auto true_branch = command_list.front();
+            command_list.erase(command_list.begin());
+            auto false_branch = command_list.front();
+            command_list.erase(command_list.begin());
+
+            auto condition = stack.front();
+            stack.erase(stack.begin());
+            dump.push_front(commands);
+            commands = condition.to_string().size() == 4 ? true_branch : false_branch;
+        }
         else if(command == "JOIN"){
             commands = dump.front();
             dump.erase(dump.begin());
@@ -762,10 +1258,30 @@ AST_node Interpreter::execute_secd_internal() {
             if(!closure.is_list()){
                 throw report_runtime_error("SECD AP", current, "closure must be list");
             }
-            auto&& closure_list = closure.to_list();
+            auto&& closure_list = std::as_const(closure).to_list();
             if(closure_list.size() != 2){
                 throw report_runtime_error("SECD AP", current, "closure list size must be 2");
             }
+            if(profile)
+                profile->closure_called(closure_list.front());
+            if(memoize_calls){
+                auto key = MemoTable::make_key(closure, additional_env);
+                if(auto memoized = memo_table.find(key, closure, additional_env)){
+                    stack.push_front(std::move(*memoized));
+                    continue;
+                }
+                pending_calls.push_back({key, closure, additional_env, dump.size()});
+            }
+            else if(jit){
+                AST_node native_result;
+                if(secd_jit.try_call(closure_list.front(), additional_env, guard ? &*guard : nullptr, native_result)){
+                    stack.push_front(std::move(native_result));
+                    continue;
+                }
+            }
+            if(!additional_env.is_list()){
+                throw report_runtime_error("SECD AP", current, "arguments must be list");
+            }
             auto&& code = closure_list.front();
             auto&& env = closure_list.back();
 
@@ -773,13 +1289,49 @@ AST_node Interpreter::execute_secd_internal() {
             dump.push_front(enviroment);
             dump.push_front(commands);
 
-            enviroment = env;
-            enviroment.to_list().push_front(additional_env);
-            commands = code;
+            enter(code, env, std::move(additional_env));
+        }
+        else if((command == "RTN" || command == "RTS") && !loops.empty() && loops.back().dump_depth == dump.size()){
+            //возврат из замыкания MAP/FILTER/FOLD - сразу следующий вызов
+            if(command == "RTS"){
+                frame_slots.resize(frame_bases.back());
+                frame_bases.pop_back();
+            }
+            accept(loops.back(), stack.front());
+            advance(loops.back());
         }
-        else if(command == "RTN"){
+        else if(command == "MAP" || command == "FILTER" || command == "FOLD"){
+            auto list_node = stack.front();
+            stack.erase(stack.begin());
+            auto initial = AST_node{};
+            if(command == "FOLD"){
+                initial = stack.front();
+                stack.erase(stack.begin());
+            }
+            auto closure = stack.front();
+            stack.erase(stack.begin());
+            if(!list_node.is_list()){
+                throw report_runtime_error("SECD " + command, current, "the list argument must be list");
+            }
+            if(!closure.is_list() || std::as_const(closure).to_list().size() != 2){
+                throw report_runtime_error("SECD " + command, current, "closure list size must be 2");
+            }
+            auto&& closure_list = std::as_const(closure).to_list();
+            auto&& elements = std::as_const(list_node).to_list();
+            loops.push_back({command, current, closure_list.front(), closure_list.back(), list_node,
+                             elements.begin(), elements.end(), AST_node{}, std::move(initial),
+                             stack_node, enviroment, commands, dump.size()});
+            advance(loops.back());
+        }
+        else if(command == "RTN" || command == "RTS"){
             auto ret = stack.front();
             stack.erase(stack.begin());
+            if(command == "RTS"){
+                if(frame_bases.empty())
+                    throw report_runtime_error("SECD RTS", current, "no frame on the frame stack");
+                frame_slots.resize(frame_bases.back());
+                frame_bases.pop_back();
+            }
             commands = dump.front();
             dump.erase(dump.begin());
             enviroment = dump.front();
@@ -790,15 +1342,87 @@ AST_node Interpreter::execute_secd_internal() {
                 throw report_runtime_error("SECD RET", current, "cant return from function - stack corrupted");
             }
             auto&& stack = stack_node.to_list();
+            if(!pending_calls.empty() && pending_calls.back().dump_depth == dump.size()){
+                auto&& call = pending_calls.back();
+                memo_table.insert(call.key, std::move(call.closure), std::move(call.arguments), ret);
+                pending_calls.pop_back();
+            }
             stack.push_front(ret);
         }
+        else if(command == "AP0"){
+            //не обещание - значение уже вычислено
+            auto&& top = std::as_const(stack).front();
+            if(!top.is_list())
+                continue;
+            auto&& marker = top.to_list();
+            if(marker.size() != 2 || !marker.front().is_string() || marker.front().to_string() != "#PROMISE")
+                continue;
+            auto index = marker.back().to_num();
+            auto&& delayed = promises[static_cast<std::size_t>(index)];
+            if(delayed.forced){
+                stack.front() = delayed.value;
+                continue;
+            }
+            stack.erase(stack.begin());
+            dump.push_front(AST_node{index});
+            dump.push_front(stack_node);
+            dump.push_front(enviroment);
+            dump.push_front(commands);
+
+            stack_node = AST_node{};
+            enviroment = std::move(delayed.enviroment);
+            commands = delayed.code;
+        }
+        else if(command == "UPD"){
+            auto value = stack.front();
+            commands = dump.front();
+            dump.erase(dump.begin());
+            enviroment = dump.front();
+            dump.erase(dump.begin());
+            stack_node = dump.front();
+            dump.erase(dump.begin());
+            auto index = dump.front();
+            dump.erase(dump.begin());
+            if(!stack_node.is_list() || !index.is_num()){
+                throw report_runtime_error("SECD UPD", current, "cant update promise - dump corrupted");
+            }
+            auto&& delayed = promises[static_cast<std::size_t>(index.to_num())];
+            delayed.value = value;
+            delayed.forced = true;
+            delayed.code = AST_node{};
+            stack_node.to_list().push_front(std::move(value));
+        }
+        else if(auto vector_builtin = packed::find(command)){
+            //последний аргумент на вершине стека
+            AST_node arguments[2];
+            for(int i = vector_builtin->arguments - 1; i >= 0; i--){
+                arguments[i] = std::move(stack.front());
+                stack.erase(stack.begin());
+            }
+            try{
+                stack.push_front(vector_builtin->apply(arguments));
+            }
+            catch(const packed::vector_error& error){
+                throw report_runtime_error("SECD " + command, current, error.what());
+            }
+        }
     }
 }
 
 void Interpreter::compile() {
+    //в кэше лежит код строгого режима с настройками компилятора по умолчанию
+    const bool cached_code = cached_entry && !lazy && typed_secd && stack_frames;
+    if(cached_code && cached_entry->secd_code){
+        (*output_stream) << *cached_entry->secd_code << std::endl;
+        return;
+    }
     try{
+        known_kinds.clear();
         auto result = this->compile(AST, AST_node{});
-        (*output_stream) << '(' << result << " STOP)" <<  std::endl;
+        auto code = '(' + result + " STOP)";
+        (*output_stream) << code <<  std::endl;
+        if(cached_code)
+            program_cache->store_compiled(cached_entry->source, check_number_of_arguments, std::move(code));
     }
     catch(const std::runtime_error& ex){
         (*output_stream) << "Error in compiling: " << ex.what() << std::endl;
@@ -806,34 +1430,454 @@ void Interpreter::compile() {
     }
 }
 
-std::string Interpreter::compile(AST_node &current, AST_node enviroment) {
-    std::stringstream result;
-    if(current.is_num())
-        throw report_runtime_error("compilation", current, "cant resolve ID");
-    else if(current.is_string()){
-        auto&& symbol_name = current.to_string();
-        if(!enviroment.is_list())
+AST_node Interpreter::read_code(const std::string &code) {
+    //SECD-код - это тоже s-выражение, разбираем его обычным парсером
+    std::istringstream code_input{code};
+    std::stringstream messages;
+    Interpreter code_parser{};
+    code_parser.switch_streams(&code_input, &messages);
+    code_parser.check_number_of_arguments = false;
+    if(code_parser.parse() != 0 || code_parser.is_error())
+        throw std::runtime_error{"cannot read generated code: " + messages.str()};
+    return std::move(code_parser.get_AST());
+}
+
+void Interpreter::compile_image(const std::string &path) {
+    try{
+        known_kinds.clear();
+        auto code = '(' + this->compile(AST, AST_node{}) + " STOP)";
+        image::save(path, read_code(code));
+        (*output_stream) << "Image written to " << path << std::endl;
+    }
+    catch(const std::runtime_error& ex){
+        (*output_stream) << "Error in compiling: " << ex.what() << std::endl;
+        m_error = true;
+    }
+}
+
+void Interpreter::compile_cpp(const std::string &path) {
+    try{
+        CppBackend backend{file_name};
+        auto source = backend.generate(AST);
+        std::ofstream file{path, std::ios::binary};
+        if(!file || !(file << source) || !file.flush())
+            throw std::runtime_error{"cannot write " + path};
+        (*output_stream) << "C++ source written to " << path << std::endl;
+    }
+    catch(const std::runtime_error& ex){
+        (*output_stream) << "Error in compiling: " << ex.what() << std::endl;
+        m_error = true;
+    }
+}
+
+void Interpreter::execute_register() {
+    register_program program;
+    try{
+        program = RegisterCompiler{file_name}.compile(AST);
+    }
+    catch(const std::runtime_error& ex){
+        (*output_stream) << "Error in compiling: " << ex.what() << std::endl;
+        m_error = true;
+        return;
+    }
+    try{
+        std::optional<LimitGuard> guard;
+        if(limits.any())
+            guard.emplace(limits);
+        auto result = RegisterVM{file_name}.run(program, guard ? &*guard : nullptr);
+        result.print(*output_stream, print_depth, print_length);
+        (*output_stream) << ' ' << std::endl;
+    }
+    catch(const std::runtime_error& err){
+        (*output_stream) << "Execution error: " << err.what() << std::endl;
+        m_error = true;
+    }
+    catch(const std::bad_alloc&){
+        (*output_stream) << "Execution error: out of memory" << std::endl;
+        m_error = true;
+    }
+}
+
+void Interpreter::execute_session() {
+    try{
+        //(DEFINE ИМЯ ВЫРАЖЕНИЕ) - определение, любая другая форма - выражение
+        auto expression = AST;
+        std::optional<std::string> defined_name;
+        if(AST.is_list()){
+            auto&& list = std::as_const(AST).to_list();
+            if(!list.empty() && list.front().is_string() && list.front().to_string() == "DEFINE"){
+                if(list.size() != 3 || !std::next(list.begin())->is_string())
+                    throw report_runtime_error("DEFINE", AST, "definition must be (DEFINE NAME EXPRESSION)");
+                defined_name = std::next(list.begin())->to_string();
+                expression = list.back();
+            }
+        }
+        //глобальный кадр - самый внешний кадр окружения любой формы сеанса
+        auto enviroment = AST_node{};
+        enviroment.to_list().push_back(session_names);
+        auto value = execute_in_session(compile_strict(expression, enviroment));
+        if(!defined_name){
+            value.print(*output_stream, print_depth, print_length);
+            (*output_stream) << std::endl;
+            return;
+        }
+        //переопределение занимает старый слот, чтобы кадр не рос; замыкания, сделанные раньше,
+        //держат свой снимок кадра и по-прежнему видят старое значение
+        auto&& names = session_names.to_list();
+        auto&& slots = session_values.to_list();
+        auto slot = slots.begin();
+        auto name = names.begin();
+        for(; name != names.end() && name->to_string() != *defined_name; ++name, ++slot);
+        if(name == names.end()){
+            names.emplace_back(*defined_name);
+            slots.push_back(value);
+        }
+        else
+            *slot = value;
+        (*output_stream) << "Defined " << *defined_name << std::endl;
+    }
+    catch(std::runtime_error& err){
+        (*output_stream) << "Execution error: " << err.what() << std::endl;
+        m_error = true;
+    }
+    catch(std::bad_alloc&){
+        (*output_stream) << "Execution error: out of memory" << std::endl;
+        m_error = true;
+    }
+    if(profile_secd)
+        secd_profile.finish();
+}
+
+AST_node Interpreter::execute_in_session(const AST_node &code) {
+    auto values = AST_node{};
+    values.to_list().push_back(session_values);
+    auto result = execute_secd_internal(code, std::move(values));
+    auto&& stack = std::as_const(result).to_list();
+    if(stack.empty())
+        throw std::runtime_error{"SECD - the program left no value"};
+    return stack.front();
+}
+
+AST_node Interpreter::compile_strict(const AST_node &current, const AST_node &enviroment) {
+    known_kinds.clear();
+    //обещания живут только до STOP, а значения кадра переживают программу
+    auto lazy_mode = std::exchange(lazy, false);
+    std::string compiled;
+    try{
+        compiled = this->compile(current, enviroment);
+    }
+    catch(...){
+        lazy = lazy_mode;
+        throw;
+    }
+    lazy = lazy_mode;
+    return read_code('(' + compiled + " STOP)");
+}
+
+std::optional<module_unit> Interpreter::compile_module(const std::string &name) {
+    try{
+        module_unit unit;
+        unit.name = name;
+        //сначала объявления: таблица символов нужна до компиляции определений
+        std::vector<const AST_node*> definitions;
+        const AST_node* program = nullptr;
+        for(std::size_t i = 0; i < forms.size(); i++){
+            auto&& form = forms[i];
+            auto keyword = form.is_list() && !form.to_list().empty() && form.to_list().front().is_string()
+                           ? form.to_list().front().to_string() : std::string{};
+            if(keyword == "IMPORT" || keyword == "EXPORT"){
+                auto&& names = keyword == "IMPORT" ? unit.imports : unit.exports;
+                for(auto&& symbol : form.to_list() | std::views::drop(1)){
+                    if(!symbol.is_string())
+                        throw report_runtime_error(keyword, form, "names must be symbols");
+                    names.push_back(symbol.to_string());
+                }
+            }
+            else if(keyword == "DEFINE"){
+                auto&& list = form.to_list();
+                if(list.size() != 3 || !std::next(list.begin())->is_string())
+                    throw report_runtime_error("DEFINE", form, "definition must be (DEFINE NAME EXPRESSION)");
+                auto&& defined = std::next(list.begin())->to_string();
+                for(auto&& other : unit.definitions)
+                    if(other.name == defined)
+                        throw report_runtime_error("DEFINE", form, std::format("{} is already defined in the module", defined));
+                unit.definitions.push_back({defined, AST_node{}});
+                definitions.push_back(&form);
+            }
+            else if(i + 1 != forms.size())
+                throw report_runtime_error("module", form, "only the last form of a module may be an expression");
+            else
+                program = &form;
+        }
+        for(auto&& imported : unit.imports)
+            for(auto&& definition : unit.definitions)
+                if(definition.name == imported)
+                    throw std::runtime_error{std::format("{} is both imported and defined", imported)};
+
+        //кадр модуля: свои определения, затем импорт; еще не определенные имена не видны
+        auto symbols = AST_node{};
+        symbols.to_list().insert(symbols.to_list().end(), unit.definitions.size(), AST_node{std::string{"#UNDEFINED"}});
+        for(auto&& imported : unit.imports)
+            symbols.to_list().emplace_back(imported);
+        auto enviroment = AST_node{};
+        enviroment.to_list().push_back(AST_node{});
+        for(std::size_t j = 0; j < unit.definitions.size(); j++){
+            enviroment.to_list().front() = symbols;
+            try{
+                unit.definitions[j].code = compile_strict(definitions[j]->to_list().back(), enviroment);
+            }
+            catch(const execution_error& error){
+                //у атома нет места в исходнике - берем место определения
+                if(error.is_located())
+                    throw;
+                throw report_runtime_error(error.get_command(), *definitions[j], error.get_description());
+            }
+            *std::next(symbols.to_list().begin(), static_cast<std::ptrdiff_t>(j)) = AST_node{unit.definitions[j].name};
+        }
+        enviroment.to_list().front() = symbols;
+        if(program)
+            unit.program = compile_strict(*program, enviroment);
+        return unit;
+    }
+    catch(const std::runtime_error& ex){
+        (*output_stream) << "Error in compiling: " << ex.what() << std::endl;
+        m_error = true;
+    }
+    return std::nullopt;
+}
+
+void Interpreter::execute_linked(const linked_program &program) {
+    try{
+        reset_session();
+        auto&& names = std::as_const(program.names).to_list();
+        auto name = names.begin();
+        //определение видит слоты, заполненные до него
+        for(auto&& code : program.definitions){
+            auto value = execute_in_session(code);
+            session_names.to_list().push_back(*name++);
+            session_values.to_list().push_back(std::move(value));
+        }
+        if(program.program){
+            execute_in_session(*program.program).print(*output_stream, print_depth, print_length);
+            (*output_stream) << std::endl;
+        }
+    }
+    catch(std::runtime_error& err){
+        (*output_stream) << "Execution error: " << err.what() << std::endl;
+        m_error = true;
+    }
+    catch(std::bad_alloc&){
+        (*output_stream) << "Execution error: out of memory" << std::endl;
+        m_error = true;
+    }
+    if(profile_secd)
+        secd_profile.finish();
+}
+
+void Interpreter::reset_session() {
+    session_names = AST_node{};
+    session_values = AST_node{};
+}
+
+const AST_node &Interpreter::get_session_names() const {
+    return session_names;
+}
+
+void Interpreter::compile_register() {
+    try{
+        RegisterCompiler{file_name}.compile(AST).disassemble(*output_stream);
+    }
+    catch(const std::runtime_error& ex){
+        (*output_stream) << "Error in compiling: " << ex.what() << std::endl;
+        m_error = true;
+    }
+}
+
+int Interpreter::load_image(const std::string &path) {
+    try{
+        AST = image::load(path);
+        if(hash_consing)
+            AST = intern_table.intern(std::move(AST));
+        cached_entry.reset();
+        return 0;
+    }
+    catch(const std::runtime_error& ex){
+        (*output_stream) << "Error in loading: " << ex.what() << std::endl;
+        m_error = true;
+        return 1;
+    }
+}
+
+Interpreter::value_kind Interpreter::known_kind(const AST_node &signature, std::ptrdiff_t index) const {
+    auto found = known_kinds.find({std::get<AST_node::list_ptr>(signature.value).get(), index});
+    return found == known_kinds.end() ? value_kind::unknown : found->second;
+}
+
+void Interpreter::prove_kind(const AST_node &current, const AST_node &enviroment, value_kind kind) {
+    if(!current.is_string())
+        return;
+    auto&& symbol_name = current.to_string();
+    for(auto&& frame : std::as_const(enviroment).to_list()){
+        auto&& signature = frame_names(frame);
+        auto&& names = signature.to_list();
+        auto found = std::find_if(names.begin(), names.end(), [&symbol_name](const AST_node& symbol){
+            return symbol.is_string() && symbol.to_string() == symbol_name;
+        });
+        if(found != names.end()){
+            known_kinds[{std::get<AST_node::list_ptr>(signature.value).get(), std::distance(names.begin(), found)}] = kind;
+            return;
+        }
+    }
+}
+
+void Interpreter::forget_kinds(const AST_node &signature) {
+    if(!signature.is_list())
+        return;
+    auto storage = static_cast<const void*>(std::get<AST_node::list_ptr>(signature.value).get());
+    known_kinds.erase(known_kinds.lower_bound({storage, std::numeric_limits<std::ptrdiff_t>::min()}),
+                      known_kinds.upper_bound({storage, std::numeric_limits<std::ptrdiff_t>::max()}));
+}
+
+AST_node Interpreter::stack_frame(const AST_node &names) {
+    auto frame = AST_node{};
+    frame.to_list().push_back(AST_node{std::string{"#STACK"}});
+    frame.to_list().push_back(names);
+    return frame;
+}
+
+const AST_node &Interpreter::frame_names(const AST_node &frame, bool *on_stack) {
+    //в кадре из имен нет списков, так что ("#STACK" имена) с ним не спутать
+    auto&& list = frame.to_list();
+    bool marked = list.size() == 2 && list.front().is_string() && list.front().to_string() == "#STACK" && list.back().is_list();
+    if(on_stack)
+        *on_stack = marked;
+    return marked ? list.back() : frame;
+}
+
+bool Interpreter::captures(const AST_node &current, const AST_node &names, std::vector<std::string> &shadowed, bool nested) {
+    if(current.is_string()){
+        if(!nested || std::find(shadowed.begin(), shadowed.end(), current.to_string()) != shadowed.end())
+            return false;
+        auto&& list = names.to_list();
+        return std::any_of(list.begin(), list.end(), [&current](const AST_node& name){
+            return name.is_string() && name.to_string() == current.to_string();
+        });
+    }
+    if(!current.is_list() || current.to_list().empty())
+        return false;
+    auto&& list = current.to_list();
+    auto keyword = list.front().is_string() ? list.front().to_string() : std::string{};
+    if(keyword == "QUOTE")
+        return false;
+    if(keyword == "LAMBDA" && list.size() == 3 && std::next(list.begin())->is_list()){
+        auto&& parameters = std::next(list.begin())->to_list();
+        auto mark = shadowed.size();
+        for(auto&& parameter : parameters)
+            if(parameter.is_string())
+                shadowed.push_back(parameter.to_string());
+        bool result = captures(list.back(), names, shadowed, true);
+        shadowed.resize(mark);
+        return result;
+    }
+    if(keyword == "LET" && list.size() >= 2){
+        //значения вычисляются снаружи и все сразу, имена LET видны только в теле
+        for(auto&& binding : list | std::views::drop(2))
+            if(binding.is_list() && !binding.to_list().empty() && captures(binding.to_list().back(), names, shadowed, nested))
+                return true;
+        auto mark = shadowed.size();
+        for(auto&& binding : list | std::views::drop(2))
+            if(binding.is_list() && !binding.to_list().empty() && binding.to_list().front().is_string())
+                shadowed.push_back(binding.to_list().front().to_string());
+        bool result = captures(*std::next(list.begin()), names, shadowed, true);
+        shadowed.resize(mark);
+        return result;
+    }
+    return std::any_of(list.begin(), list.end(), [&](const AST_node& item){
+        return captures(item, names, shadowed, nested);
+    });
+}
+
+bool Interpreter::frame_on_stack(const AST_node &body, const AST_node &names) const {
+    if(!stack_frames || lazy || !names.is_list())
+        return false;
+    std::vector<std::string> shadowed;
+    return !captures(body, names, shadowed, false);
+}
+
+bool Interpreter::load_variable(const AST_node &current, const AST_node &enviroment, std::stringstream &result, value_kind *kind) {
+    auto&& symbol_name = current.to_string();
+    if(!enviroment.is_list())
+        throw report_runtime_error("compilation", current, "bad env");
+    auto&& env_list = enviroment.to_list();
+    int i = 0;
+
+    //поиск переменной в окружении
+    for(auto&& frame : env_list){
+        if(!frame.is_list())
             throw report_runtime_error("compilation", current, "bad env");
-        auto&& env_list = enviroment.to_list();
-        int i = 0;
-
-        //поиск переменной в окружении
-        for(auto&& internal_list : env_list){
-            if(!internal_list.is_list())
-                throw report_runtime_error("compilation", current, "bad env");
-            auto&& int_list = internal_list.to_list();
-            const AST_node symbol = AST_node{symbol_name};
-            auto find_result = std::find(int_list.begin(), int_list.end(), symbol);
-            if(find_result != int_list.end()) {
-                int j = std::distance(int_list.begin(), find_result);
+        //кадр на стеке кадров в окружение VM не входит и номер не занимает
+        bool on_stack = false;
+        auto&& internal_list = frame_names(frame, &on_stack);
+        auto&& int_list = internal_list.to_list();
+        auto find_result = std::find_if(int_list.begin(), int_list.end(), [&symbol_name](const AST_node& symbol){
+            return symbol.is_string() && symbol.to_string() == symbol_name;
+        });
+        if(find_result != int_list.end()) {
+            int j = std::distance(int_list.begin(), find_result);
 
+            if(on_stack)
+                result << "LDS " << j;
+            else
                 result << "LD (" << i << ' ' << j << ')';
-                return result.str();
-            }
-            i++;
+            if(kind)
+                *kind = known_kind(internal_list, j);
+            return true;
         }
+        if(!on_stack)
+            i++;
+    }
+    return false;
+}
+
+std::string Interpreter::compile_delayed(const AST_node &current, const AST_node &enviroment, value_kind *kind) {
+    std::stringstream result;
+    if(kind)
+        *kind = value_kind::unknown;
+    //переменная передается как есть: значение или уже созданное обещание
+    if(current.is_string() && load_variable(current, enviroment, result, kind))
+        return result.str();
+    //константу и замыкание дешевле построить сразу
+    if(current.is_list()){
+        auto&& list = current.to_list();
+        if(!list.empty() && list.front().is_string() &&
+           (list.front().to_string() == "QUOTE" || list.front().to_string() == "LAMBDA"))
+            return compile(current, enviroment, kind);
+    }
+    if(!current.is_list())
+        return compile(current, enviroment, kind);
+    //код обещания выполнится позже или никогда - доказанное в нем не переносится наружу
+    auto before_promise = known_kinds;
+    result << "LDE (" << compile(current, enviroment, kind) << " UPD)";
+    known_kinds = std::move(before_promise);
+    return result.str();
+}
+
+std::string Interpreter::compile(const AST_node &current, AST_node enviroment, value_kind* kind) try {
+    std::stringstream result;
+    //вид значения выражения, если его удалось доказать
+    auto proven = value_kind::unknown;
+    if(kind)
+        *kind = value_kind::unknown;
+    if(current.is_number())
+        throw report_runtime_error("compilation", current, "cant resolve ID");
+    else if(current.is_string()){
         //если не нашли переменную то ошибка
-        throw report_runtime_error("ID", current, "using undeclared symbol");
+        if(!load_variable(current, enviroment, result, kind))
+            throw report_runtime_error("ID", current, std::format("using undeclared symbol {}", current.to_string()));
+        //в lazy-режиме в переменной может лежать обещание - вычисляем его
+        if(lazy)
+            result << " AP0";
+        return result.str();
     }
     //тут остались только списки
 
@@ -845,7 +1889,14 @@ std::string Interpreter::compile(AST_node &current, AST_node enviroment) {
     auto&& command = command_node.to_string();
 
     if(command == "QUOTE"){
-        result << "LDC " << current_list.back().print_tree();
+        auto&& constant = current_list.back();
+        result << "LDC " << constant.print_tree();
+        if(constant.is_number())
+            proven = value_kind::number;
+        else if(constant.is_list())
+            proven = value_kind::list;
+        else if(constant.to_string() == "TRUE" || constant.to_string() == "FALSE")
+            proven = value_kind::boolean;
     }
     else if(command == "ADD" ||
             command == "SUB" ||
@@ -859,18 +1910,31 @@ std::string Interpreter::compile(AST_node &current, AST_node enviroment) {
         auto iterator = current_list.begin(); ++iterator;
         auto&& left = *iterator; ++iterator;
         auto&& right = *iterator;
+        auto left_kind = value_kind::unknown;
+        auto right_kind = value_kind::unknown;
         if(command == "CONS"){
-            result << compile(right, enviroment) << ' ' << compile(left, enviroment) << ' ';
+            result << compile(right, enviroment, &right_kind) << ' ' << compile(left, enviroment, &left_kind) << ' ';
         }
         else{
-            result << compile(left, enviroment) << ' ' << compile(right, enviroment) << ' ';
+            result << compile(left, enviroment, &left_kind) << ' ' << compile(right, enviroment, &right_kind) << ' ';
         }
-        if(command == "EQUAL"){
-            result << "EQ";
+        auto opcode = command == "EQUAL" ? std::string{"EQ"} : command;
+        if(command == "CONS"){
+            proven = value_kind::list;
+            prove_kind(right, enviroment, value_kind::list);
         }
         else{
-            result << command;
+            //оба операнда - заведомо числа: проверка тегов не нужна
+            if(typed_secd && left_kind == value_kind::number && right_kind == value_kind::number)
+                opcode += "_N";
+            proven = command == "EQUAL" || command == "LEQ" ? value_kind::boolean : value_kind::number;
+            //после выполнения без ошибки переменные-операнды - числа
+            if(command != "EQUAL"){
+                prove_kind(left, enviroment, value_kind::number);
+                prove_kind(right, enviroment, value_kind::number);
+            }
         }
+        result << opcode;
     }
     else if(command == "ATOM" ||
             command == "CAR" ||
@@ -878,25 +1942,46 @@ std::string Interpreter::compile(AST_node &current, AST_node enviroment) {
     ){
         auto&& argument = current_list.back();
         result << compile(argument, enviroment) << ' ' << command;
+        if(command == "ATOM")
+            proven = value_kind::boolean;
+        else{
+            proven = command == "CDR" ? value_kind::list : value_kind::unknown;
+            prove_kind(argument, enviroment, value_kind::list);
+        }
     }
     else if(command == "COND"){
         auto iterator = current_list.begin(); ++iterator;
         auto&& condition = *iterator; ++iterator;
         auto&& true_branch = *iterator; ++iterator;
         auto&& false_branch = *iterator;
-        result << compile(condition, enviroment)
-               << " SEL "
-               << '(' << compile(true_branch, enviroment) << " JOIN) "
-               << '(' << compile(false_branch, enviroment) << " JOIN)";
+        auto condition_kind = value_kind::unknown;
+        auto true_kind = value_kind::unknown;
+        auto false_kind = value_kind::unknown;
+        result << compile(condition, enviroment, &condition_kind)
+               << (typed_secd && condition_kind == value_kind::boolean ? " SEL_B " : " SEL ");
+        //выполняется только одна ветка - то, что доказано в ней, после COND неверно
+        auto before_branches = known_kinds;
+        result << '(' << compile(true_branch, enviroment, &true_kind) << " JOIN) ";
+        known_kinds = before_branches;
+        result << '(' << compile(false_branch, enviroment, &false_kind) << " JOIN)";
+        known_kinds = std::move(before_branches);
+        if(true_kind == false_kind)
+            proven = true_kind;
     }
     else if(command == "LAMBDA"){
         auto iterator = current_list.begin(); ++iterator;
         auto&& lambda_arguments = *iterator; ++iterator;
         auto&& lambda_body = *iterator;
 
-        enviroment.to_list().push_front(lambda_arguments);
+        bool on_stack = frame_on_stack(lambda_body, lambda_arguments);
+        enviroment.to_list().push_front(on_stack ? stack_frame(lambda_arguments) : lambda_arguments);
 
-        result << "LDF (" << compile(lambda_body, enviroment) << " RTN)";
+        //тело выполнится позже: доказанное в нем не переносится наружу,
+        //а об аргументах ничего не известно (тот же список может быть и у внешней функции)
+        auto at_creation = known_kinds;
+        forget_kinds(lambda_arguments);
+        result << "LDF (" << compile(lambda_body, enviroment) << (on_stack ? " RTS)" : " RTN)");
+        known_kinds = std::move(at_creation);
     }
     else if(command == "LET"){
         //(LET (ADD X Y) (X (QUOTE 5)) (Y (QUOTE 4)))
@@ -904,22 +1989,58 @@ std::string Interpreter::compile(AST_node &current, AST_node enviroment) {
         result << "LDC () ";
         auto new_enviroment = AST_node{};
         auto&& new_enviroment_list = new_enviroment.to_list();
+        std::vector<value_kind> argument_kinds;
         for(auto arg_iterator = current_list.rbegin();
             arg_iterator != arguments_end;
             ++arg_iterator
         ){
             auto&& pair_list = arg_iterator->to_list();
-            result << compile(pair_list.back(), enviroment) << " CONS ";
+            auto&& value = pair_list.back();
+            result << (lazy ? compile_delayed(value, enviroment, &argument_kinds.emplace_back())
+                            : compile(value, enviroment, &argument_kinds.emplace_back())) << " CONS ";
             new_enviroment_list.push_front(pair_list.front());
         }
         //добавили вычисление аргументов, занесли их в контекст..
         //а, не занесли еще
         //значит надо!
-        enviroment.to_list().push_front(new_enviroment);
-
         auto function_node = current_list.begin(); ++function_node;
+        bool on_stack = frame_on_stack(*function_node, new_enviroment);
+        enviroment.to_list().push_front(on_stack ? stack_frame(new_enviroment) : new_enviroment);
+        //замыкание LET вызывается только здесь - виды аргументов точные
+        for(std::size_t j = 0; j < argument_kinds.size(); j++)
+            if(argument_kinds[j] != value_kind::unknown)
+                known_kinds[{std::get<AST_node::list_ptr>(new_enviroment.value).get(), argument_kinds.size() - 1 - j}] = argument_kinds[j];
+
         //здесь уже окружение изменено
-        result << "LDF (" << compile(*function_node, enviroment) << " RTN) AP";
+        result << "LDF (" << compile(*function_node, enviroment, &proven) << (on_stack ? " RTS) AP" : " RTN) AP");
+        //кадр LET больше нигде не встретится, а его адрес может достаться следующему
+        forget_kinds(new_enviroment);
+    }
+    else if(command == "MAP" || command == "FILTER" || command == "FOLD"){
+        //(MAP F L) -> F L MAP, (FOLD F INIT L) -> F INIT L FOLD
+        if(current_list.size() != (command == "FOLD" ? 4u : 3u))
+            throw report_runtime_error("compilation", current, "wrong number of arguments");
+        for(auto iterator = ++current_list.begin(); iterator != current_list.end(); ++iterator)
+            result << compile(*iterator, enviroment) << ' ';
+        result << command;
+        if(command != "FOLD"){
+            proven = value_kind::list;
+            prove_kind(current_list.back(), enviroment, value_kind::list);
+        }
+    }
+    else if(auto vector_builtin = packed::find(command)){
+        if(static_cast<int>(current_list.size()) != vector_builtin->arguments + 1)
+            throw report_runtime_error("compilation", current, "wrong number of arguments");
+        //аргументы по порядку, последний окажется на вершине стека
+        for(auto iterator = ++current_list.begin(); iterator != current_list.end(); ++iterator)
+            result << compile(*iterator, enviroment) << ' ';
+        result << command;
+        if(command == "VLIST")
+            proven = value_kind::list;
+        else if(command == "VLEN" || command == "VSUM" || command == "VDOT" || command == "VMIN" || command == "VMAX")
+            proven = value_kind::number;
+        else if(command == "VEC")
+            prove_kind(current_list.back(), enviroment, value_kind::list);
     }
     else{ //вызов функции
         result << "LDC () ";
@@ -927,15 +2048,23 @@ std::string Interpreter::compile(AST_node &current, AST_node enviroment) {
         for(auto&& item : current_list | std::views::reverse){
             if(!is_first)
                 result << "CONS ";
-            result << compile(item, enviroment) << ' ';
+            //в lazy-режиме аргументы откладываются, сама функция вычисляется сразу
+            bool is_function = &item == &current_list.front();
+            result << (lazy && !is_function ? compile_delayed(item, enviroment) : compile(item, enviroment)) << ' ';
             is_first = false;
         }
         result << "AP";
     }
 
-
+    if(kind)
+        *kind = proven;
     return result.str();
 
 
 }
+catch(const execution_error& error){
+    if(error.is_located() || !current.location().known())
+        throw;
+    throw report_runtime_error(error.get_command(), current, error.get_description());
+}
 
@@ -11,8 +11,20 @@
 #include <stack>
 #include <ranges>
 #include <iterator>
+#include <map>
+#include <deque>
+#include <optional>
+#include <cstdint>
 
 #include "AST.hpp"
+#include "program_cache.hpp"
+#include "memo_table.hpp"
+#include "secd_profile.hpp"
+#include "sampling_profiler.hpp"
+#include "resource_limits.hpp"
+#include "secd_jit.hpp"
+#include "register_vm.hpp"
+#include "module_linker.hpp"
 
 #include "scanner.hpp"
 
@@ -22,6 +34,33 @@
 
 namespace yy {
 
+/**
+ * Error of the program being run or compiled. The message starts with
+ * file:line:col when the failing form has a source location. Errors on
+ * atoms and run-time values have none; execute() and compile() give them
+ * the location of the nearest enclosing parsed form while they propagate.
+ */
+class execution_error : public std::runtime_error {
+public:
+    execution_error(const std::string& message, std::string command, std::string description, bool located);
+
+    const std::string& get_command() const;
+    const std::string& get_description() const;
+    bool is_located() const;
+private:
+    std::string command;
+    std::string description;
+    bool located;
+};
+
+/**
+ * Error of command on node in file_name, in the format of all the
+ * evaluators and compilers: with file:line:col if node has a source
+ * location, with the node itself printed otherwise.
+ */
+execution_error make_execution_error(const std::string& file_name, std::string command, const AST_node& node,
+                                     std::string description);
+
 // forward declare our simplistic AST node class so we
 // can declare container for it without the header
 
@@ -44,6 +83,13 @@ public:
      * \returns 0 on success, 1 on failure
      */
     int parse();
+    /**
+     * Parse source text through the program cache. On a hit the AST
+     * (and the compiled code, if any) comes from the cache and neither
+     * the scanner nor the parser is run.
+     * \returns 0 on success, 1 on failure
+     */
+    int parse(const std::string& source, ProgramCache& cache);
     /**
      * Switch scanner input stream. Default is standard input (std::cin).
      * It will also reset AST.
@@ -53,6 +99,19 @@ public:
     void set_file_name(const std::string& str);
 
     bool is_error();
+
+    /**
+     * Syntax error of the last parse(), also printed to the output stream.
+     * The position is the one the scanner reports: line and the column
+     * where the offending token ends, both from 1.
+     */
+    struct diagnostic {
+        unsigned int line;
+        unsigned int column;
+        std::string message;
+    };
+
+    const std::vector<diagnostic>& get_diagnostics() const;
     
     /**
      * This is needed so that Scanner and Parser can call some
@@ -61,7 +120,19 @@ public:
     friend class Parser;
     friend class Scanner;
 
+    // the mutable AST is no longer the one of the cache entry of parse(source, cache)
     AST_node& get_AST();
+    const AST_node& get_AST() const;
+
+    /**
+     * Top-level forms of the last parse(), in source order. AST is the
+     * last of them. More than one form is a syntax error unless
+     * multiple_forms is set.
+     */
+    const std::vector<AST_node>& get_forms() const;
+
+    // accept several top-level forms, for modules and sessions
+    bool multiple_forms = false;
 
     void execute();
 
@@ -69,9 +140,162 @@ public:
 
     void compile();
 
+    /**
+     * Session mode of the SECD pipeline, for a REPL. AST is either a
+     * definition (DEFINE NAME EXPRESSION) or an expression. Both are
+     * compiled against the global frame of the session and run with it; a
+     * definition puts its value into the frame, an expression prints its
+     * value. The frame is the outermost one of every compiled form, so a
+     * library of definitions is sent, parsed and compiled once and later
+     * forms only refer to its slots. A definition does not see its own
+     * name (recursion passes the function to itself, as in a LET). Every
+     * form runs with a snapshot of the frame, and a closure keeps the
+     * snapshot it was made with: a redefinition reaches the forms after
+     * it, not the functions defined before it, which go on calling the
+     * old value. The slot of a redefined name is reused only so that the
+     * frame does not grow. The session ignores lazy, its values outlive
+     * the promises of one run.
+     */
+    void execute_session();
+
+    // forget all definitions of the session
+    void reset_session();
+
+    // names of the global frame, in slot order
+    const AST_node& get_session_names() const;
+
+    /**
+     * Compile the forms of the last parse() as the module called name
+     * (see module_linker.hpp). Errors are printed like the ones of
+     * compile(). The source hash of the unit is left 0.
+     */
+    std::optional<module_unit> compile_module(const std::string& name);
+
+    /**
+     * Run a linked program: the definitions fill the global frame of the
+     * session in slot order, then the program expression is run and its
+     * value printed. Afterwards execute_session() can use the definitions.
+     */
+    void execute_linked(const linked_program& program);
+
+    /**
+     * Compile AST for the register machine (see register_vm.hpp) and run
+     * it, the result is printed like the one of execute_secd.
+     */
+    void execute_register();
+
+    // print the register machine code of AST
+    void compile_register();
+
+    /**
+     * Compile AST and save the resulting SECD program as a binary image
+     * (see secd_image.hpp). The image can be run with load_image() +
+     * execute_secd() without the scanner and parser.
+     */
+    void compile_image(const std::string& path);
+
+    /**
+     * Compile AST ahead of time to C++ source for the runtime library
+     * (see cpp_backend.hpp) and write it to path.
+     */
+    void compile_cpp(const std::string& path);
+
+    /**
+     * Replace AST with the SECD program stored in a binary image.
+     * \returns 0 on success, 1 on failure
+     */
+    int load_image(const std::string& path);
+
     bool check_number_of_arguments;
+
+    /**
+     * Memoize user function calls (execute) and closure applications
+     * (execute_secd). Off by default, results are kept in get_memo_table().
+     */
+    bool memoize = false;
+
+    MemoTable& get_memo_table();
+
+    /**
+     * Hash-consing: after parsing (or loading) identical subtrees of the
+     * AST share one storage, see AST_intern_table.
+     */
+    bool hash_consing = false;
+
+    const AST_intern_table& get_intern_table() const;
+
+    /**
+     * Collect per-instruction counters during execute_secd, the report
+     * is available from get_secd_profile() after the run.
+     */
+    bool profile_secd = false;
+
+    const SECDProfile& get_secd_profile() const;
+
+    /**
+     * Sample the LispKit call stack during execute, the collapsed stacks
+     * are written by get_sampling_profiler().write_collapsed().
+     */
+    bool profile_execute = false;
+
+    SamplingProfiler& get_sampling_profiler();
+
+    /**
+     * Compile hot closures of execute_secd to native code, see SECDJit.
+     * Off by default and ignored together with memoize or where the
+     * platform has no code generator.
+     */
+    bool jit = false;
+
+    const SECDJit& get_secd_jit() const;
+
+    /**
+     * compile() emits unchecked instructions (ADD_N, LEQ_N, SEL_B...)
+     * where it can prove the kind of the operands from constants, the
+     * result kinds of the operations and earlier uses of a variable.
+     * The machine still tests the tags once and runs the checked
+     * instruction when they do not match: SECD code may also come from
+     * an image, a module or the SECD pane, not only from compile().
+     */
+    bool typed_secd = true;
+
+    /**
+     * compile() puts the frame of a function (LAMBDA or LET) on the frame
+     * stack of the SECD machine when no function nested in its body uses
+     * its variables, so no closure can keep the frame. Such a function
+     * ends with RTS instead of RTN and reads its arguments with LDS j; AP
+     * pushes them onto one contiguous vector, RTS drops them, and the
+     * environment of the closure is used as it is instead of a copy with
+     * the new frame in front. Ignored in lazy mode, a promise keeps the
+     * frame it was made in.
+     */
+    bool stack_frames = true;
+
+    /**
+     * Call-by-need: execute and compile delay the arguments of user
+     * functions and the values of LET until their first use, a delayed
+     * value is evaluated at most once. compile() emits LDE, AP0 and UPD
+     * for it, set the flag for execute_secd of such code too. Memoization
+     * is off in this mode, execute_register and compile_cpp stay strict.
+     */
+    bool lazy = false;
+
+    /**
+     * Step, heap, depth and time limits of every execute, execute_secd and
+     * execute_register run. A run over a limit stops with an execution
+     * error, the interpreter stays usable for the next program. Unlimited
+     * by default.
+     */
+    resource_limits limits;
+
+    /**
+     * Truncation of the printed result of the execute* methods, see
+     * AST_node::print. Negative means unlimited, the default.
+     */
+    int print_depth = -1;
+    std::int64_t print_length = -1;
 private:
-    using command = std::function<AST_node(AST_node&, std::unordered_map<std::string, AST_node>)>;
+    using command = std::function<AST_node(const AST_node&, std::unordered_map<std::string, AST_node>)>;
     using context_t = std::unordered_map<std::string, AST_node>;
     using enviroment_t = std::list<std::list<std::string>>;
     // Used internally by Scanner YY_USER_ACTION to update location indicator
@@ -84,17 +308,64 @@ private:
     // Used to get last Scanner location. Used in error messages.
     unsigned int location() const;
 
-    AST_node execute(AST_node& current, std::unordered_map<std::string, AST_node> context);
+    void add_diagnostic(const yy::position& position, std::string message);
 
-    AST_node execute_secd_internal();
+    AST_node execute(const AST_node& current, std::unordered_map<std::string, AST_node> context);
 
-    std::string compile(AST_node& current, AST_node enviroment);
+    // runs program with enviroment as the initial environment, returns the stack at STOP
+    AST_node execute_secd_internal(const AST_node& program, AST_node enviroment);
+
+    // parse compiled SECD code back into the AST the machine runs
+    static AST_node read_code(const std::string& code);
+
+    // run code with the global frame of the session, returns the value it leaves on the stack
+    AST_node execute_in_session(const AST_node& code);
+
+    // compile with lazy off and the SECD code parsed, enviroment as for compile()
+    AST_node compile_strict(const AST_node& current, const AST_node& enviroment);
+
+    // parameters of function_value ((args) (body)) called with count arguments by MAP, FILTER or FOLD
+    const AST_node::AST_node_list& function_parameters(const AST_node& function_value, std::size_t count,
+                                                       const std::string& command, const AST_node& node);
+
+    // lazy mode of execute: a thunk for expression in context, or the value itself if it is cheap
+    AST_node delay(const AST_node& expression, const context_t& context);
+    // the value of a thunk, evaluated on the first call; any other value is returned as it is
+    const AST_node& force(const AST_node& value);
+
+    // kind of a value as far as compile() can prove it
+    enum class value_kind : std::uint8_t { unknown, number, boolean, list };
+
+    // kind, when not null, receives the kind of the compiled expression
+    std::string compile(const AST_node& current, AST_node enviroment, value_kind* kind = nullptr);
+    // lazy mode of compile: code pushing a promise of current (LDE) or a variable without forcing it
+    std::string compile_delayed(const AST_node& current, const AST_node& enviroment, value_kind* kind = nullptr);
+    // LD of variable current, false if it is not in enviroment
+    bool load_variable(const AST_node& current, const AST_node& enviroment, std::stringstream& result, value_kind* kind);
+
+    value_kind known_kind(const AST_node& signature, std::ptrdiff_t index) const;
+    // remember the kind of variable current, if it is a variable
+    void prove_kind(const AST_node& current, const AST_node& enviroment, value_kind kind);
+    void forget_kinds(const AST_node& signature);
+
+    // entry of the compile environment for a frame on the frame stack: ("#STACK" names)
+    static AST_node stack_frame(const AST_node& names);
+    // names of an entry of the compile environment, whether it is on the frame stack or not
+    static const AST_node& frame_names(const AST_node& frame, bool* on_stack = nullptr);
+    /**
+     * Escape analysis: whether a function nested in current (a LAMBDA or
+     * the body of a LET) uses one of names. shadowed are the names bound
+     * by the nested functions around current, they hide names.
+     */
+    static bool captures(const AST_node& current, const AST_node& names, std::vector<std::string>& shadowed, bool nested);
+    // frame of a new function with body on the frame stack
+    bool frame_on_stack(const AST_node& body, const AST_node& names) const;
 
     bool is_existing_symbol(const std::string& symbol, const context_t& context);
 
-    std::runtime_error report_runtime_error(std::string command, AST_node& node, std::string error_description);
+    execution_error report_runtime_error(std::string command, const AST_node& node, std::string error_description);
 
-    void report_runtime_warning(std::string command, AST_node& node, std::string error_description);
+    void report_runtime_warning(std::string command, const AST_node& node, std::string error_description);
 private:
     Scanner m_scanner;
     Parser m_parser;
@@ -103,10 +374,35 @@ private:
     unsigned int m_column;
     std::unordered_map<std::string, command> functions;
     bool m_error;
+    std::vector<diagnostic> diagnostics;
     AST_node AST;
     std::istream* input_stream;
     std::ostream* output_stream;
     std::string file_name = "input";
+    std::istringstream source_input;
+    ProgramCache* program_cache = nullptr;
+    std::shared_ptr<const cached_program> cached_entry;
+    MemoTable memo_table;
+    AST_intern_table intern_table;
+    SECDProfile secd_profile;
+    SamplingProfiler sampling_profiler;
+    SECDJit secd_jit;
+    std::vector<AST_node> forms;
+    // глобальный кадр сеанса: имена и значения в одном порядке
+    AST_node session_names;
+    AST_node session_values;
+    // отложенные вычисления lazy-режима execute, узел ("#THUNK" номер) ссылается сюда
+    struct thunk {
+        AST_node expression;
+        context_t context;
+        AST_node value;
+        bool forced = false;
+    };
+    std::deque<thunk> thunks;
+    // виды переменных, доказанные в текущей точке compile(): (сигнатура, индекс)
+    std::map<std::pair<const void*, std::ptrdiff_t>, value_kind> known_kinds;
+    SamplingProfiler* active_sampler = nullptr;   // только во время execute
+    LimitGuard* active_limits = nullptr;          // только во время execute, если есть ограничения
 };
 
 }
@@ -0,0 +1,258 @@
+#include "lispkit_runtime.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace lispkit_runtime {
+
+const std::string true_name = "TRUE";
+const std::string false_name = "FALSE";
+
+namespace {
+    constexpr std::size_t chunk_size = 1 << 20;
+
+    // куски арены не освобождаются до выхода
+    struct arena {
+        std::vector<std::unique_ptr<char[]>> chunks;
+        char* next = nullptr;
+        std::size_t left = 0;
+    };
+
+    arena& heap() {
+        static arena instance;
+        return instance;
+    }
+
+    std::unordered_map<std::string_view, const std::string*>& symbols() {
+        static std::unordered_map<std::string_view, const std::string*> table{
+                {true_name, &true_name},
+                {false_name, &false_name}
+        };
+        return table;
+    }
+
+    std::deque<big_int>& big_numbers() {
+        static std::deque<big_int> storage;
+        return storage;
+    }
+
+    value from_big(big_int number) {
+        if(number.fits_int64())
+            return lispkit_runtime::number(number.to_int64());
+        value result;
+        result.type = value::kind::big;
+        result.big = &big_numbers().emplace_back(std::move(number));
+        return result;
+    }
+
+    big_int to_big(const value& number) {
+        return number.type == value::kind::big ? *number.big : big_int{number.number};
+    }
+
+    void check_numbers(const char* command, const value& left, const value& right) {
+        if(!left.is_number() || !right.is_number())
+            throw error{command, "arguments should be numbers"};
+    }
+
+    bool is_zero(const value& number) {
+        return number.type == value::kind::number && number.number == 0; // big_int не бывает нулем
+    }
+
+    int compare(const value& left, const value& right) {
+        auto order = to_big(left) <=> to_big(right);
+        return order < 0 ? -1 : (order > 0 ? 1 : 0);
+    }
+}
+
+error::error(std::string_view command, std::string_view description) :
+        std::runtime_error{"Error in " + std::string{command} + " expression - " + std::string{description}}
+{}
+
+void* allocate(std::size_t bytes) {
+    auto&& current = heap();
+    bytes = (bytes + 15) & ~std::size_t{15};
+    if(bytes > current.left){
+        auto size = std::max(chunk_size, bytes);
+        current.chunks.emplace_back(new char[size]);
+        current.next = current.chunks.back().get();
+        current.left = size;
+    }
+    auto result = current.next;
+    current.next += bytes;
+    current.left -= bytes;
+    return result;
+}
+
+value symbol(std::string_view name) {
+    auto&& table = symbols();
+    auto found = table.find(name);
+    if(found == table.end()){
+        auto interned = new std::string{name};
+        found = table.emplace(*interned, interned).first;
+    }
+    value result;
+    result.type = value::kind::symbol;
+    result.symbol = found->second;
+    return result;
+}
+
+value big(std::string_view decimal) {
+    return from_big(big_int{decimal});
+}
+
+value list(std::initializer_list<value> items) {
+    value result;
+    for(auto it = items.end(); it != items.begin();)
+        result = cons(*--it, result);
+    return result;
+}
+
+value make_closure(code_t code, const frame* env) {
+    auto function = new(allocate(sizeof(closure))) closure{code, env};
+    value result;
+    result.type = value::kind::closure;
+    result.function = function;
+    return result;
+}
+
+const frame* make_frame(const frame* parent, const value* arguments, std::size_t count) {
+    auto slots = static_cast<value*>(allocate(sizeof(value) * std::max<std::size_t>(count, 1)));
+    std::copy(arguments, arguments + count, slots);
+    return new(allocate(sizeof(frame))) frame{parent, slots};
+}
+
+value add_slow(const value& left, const value& right) {
+    check_numbers("ADD", left, right);
+    return from_big(to_big(left) + to_big(right));
+}
+
+value subtract_slow(const value& left, const value& right) {
+    check_numbers("SUB", left, right);
+    return from_big(to_big(left) - to_big(right));
+}
+
+value multiply_slow(const value& left, const value& right) {
+    check_numbers("MUL", left, right);
+    return from_big(to_big(left) * to_big(right));
+}
+
+value divide_slow(const value& left, const value& right) {
+    check_numbers("DIVE", left, right);
+    if(is_zero(right))
+        throw error{"DIVE", "division by zero"};
+    return from_big(to_big(left) / to_big(right));
+}
+
+value remainder_slow(const value& left, const value& right) {
+    check_numbers("REM", left, right);
+    if(is_zero(right))
+        throw error{"REM", "division by zero"};
+    if(right.type == value::kind::number && right.number == -1)
+        return number(0);
+    return from_big(to_big(left) % to_big(right));
+}
+
+value less_equal_slow(const value& left, const value& right) {
+    check_numbers("LEQ", left, right);
+    return boolean(compare(left, right) <= 0);
+}
+
+value equal_slow(const value& left, const value& right) {
+    if(left.is_list() && right.is_list())
+        throw error{"EQ", "both arguments cant be lists"};
+    if(left.is_number() && right.is_number())
+        return boolean(compare(left, right) == 0);
+    if(left.type == value::kind::symbol && right.type == value::kind::symbol)
+        return boolean(left.symbol == right.symbol);
+    return boolean(false);
+}
+
+value car_slow(const value& list) {
+    if(list.type != value::kind::nil)
+        throw error{"CAR", "CAR argument must be list"};
+    return {};
+}
+
+value cdr_slow(const value& list) {
+    if(list.type != value::kind::nil)
+        throw error{"CDR", "CDR argument must be list"};
+    return {};
+}
+
+value cons_slow(const value&, const value&) {
+    throw error{"CONS", "SECD CONS second argument must be list"};
+}
+
+value apply_slow(const value&) {
+    throw error{"AP", "closure must be list"};
+}
+
+bool truth_slow(const value&) {
+    throw error{"SEL", "condition must be boolean"};
+}
+
+void arity_error(std::size_t count, std::size_t arity) {
+    throw error{"AP", "function of " + std::to_string(arity) + " arguments applied to " + std::to_string(count)};
+}
+
+void print(std::ostream& out, const value& result) {
+    //незакрытые списки - хвосты, которые осталось напечатать
+    std::vector<value> open;
+    auto current = result;
+    while(true){
+        switch(current.type){
+            case value::kind::nil:
+                out << "()";
+                break;
+            case value::kind::number:
+                out << current.number;
+                break;
+            case value::kind::symbol:
+                out << *current.symbol;
+                break;
+            case value::kind::big:
+                out << current.big->to_string();
+                break;
+            case value::kind::closure:
+                out << "(closure)";
+                break;
+            case value::kind::pair:
+                out << '(';
+                open.push_back(current.cell->tail);
+                current = current.cell->head;
+                continue;
+        }
+        while(!open.empty() && open.back().type == value::kind::nil){
+            out << ')';
+            open.pop_back();
+        }
+        if(open.empty())
+            return;
+        out << ' ';
+        current = open.back().cell->head;
+        open.back() = open.back().cell->tail;
+    }
+}
+
+int run(void (*init_constants)(), value (*program)()) {
+    try{
+        init_constants();
+        auto result = program();
+        print(std::cout, result);
+        std::cout << ' ' << std::endl;
+        return 0;
+    }
+    catch(const std::runtime_error& err){
+        std::cout << "Execution error: " << err.what() << std::endl;
+    }
+    catch(const std::bad_alloc&){
+        std::cout << "Execution error: out of memory" << std::endl;
+    }
+    return 1;
+}
+
+}
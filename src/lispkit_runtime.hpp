@@ -0,0 +1,228 @@
+#ifndef LISPKIT_COMPILER_LISPKIT_RUNTIME_HPP
+#define LISPKIT_COMPILER_LISPKIT_RUNTIME_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "big_int.hpp"
+
+/**
+ * Support library of the programs produced by CppBackend (cpp_backend.hpp).
+ *
+ * Values are 16 byte tagged unions: the empty list, a number (int64_t,
+ * promoted to big_int on overflow like in the interpreter), an interned
+ * symbol, a cons cell or a closure. Cells, closures and captured frames
+ * are bump-allocated and live until the program exits - a LispKit program
+ * computes one value and has no use for a collector.
+ *
+ * The operations have an inline fast path for small numbers and take the
+ * out of line one for big numbers and errors. Errors have the messages of
+ * the SECD machine and stop the program through run().
+ */
+namespace lispkit_runtime {
+
+struct pair;
+struct closure;
+struct frame;
+
+class error : public std::runtime_error {
+public:
+    error(std::string_view command, std::string_view description);
+};
+
+struct value {
+    enum class kind : std::uint8_t { nil, number, symbol, big, pair, closure };
+
+    kind type = kind::nil;
+    union {
+        std::int64_t number = 0;
+        const std::string* symbol;      // интернированный, сравниваем адреса
+        const big_int* big;             // только вне диапазона int64_t
+        const pair* cell;
+        const closure* function;
+    };
+
+    // a closure is a list for ATOM and EQ, as in the SECD machine
+    bool is_list() const {
+        return type == kind::nil || type == kind::pair || type == kind::closure;
+    }
+
+    bool is_number() const {
+        return type == kind::number || type == kind::big;
+    }
+};
+
+struct pair {
+    value head;
+    value tail;     // nil или pair
+};
+
+// arguments of one call, kept only when a closure made inside the call can see them
+struct frame {
+    const frame* parent;
+    const value* slots;
+};
+
+using code_t = value (*)(const frame* env, const value* arguments, std::size_t count);
+
+struct closure {
+    code_t code;
+    const frame* env;
+};
+
+extern const std::string true_name;
+extern const std::string false_name;
+
+void* allocate(std::size_t bytes);
+
+inline value number(std::int64_t n) {
+    value result;
+    result.type = value::kind::number;
+    result.number = n;
+    return result;
+}
+
+inline value boolean(bool condition) {
+    value result;
+    result.type = value::kind::symbol;
+    result.symbol = condition ? &true_name : &false_name;
+    return result;
+}
+
+// constants, built once before the program runs
+value symbol(std::string_view name);
+value big(std::string_view decimal);
+value list(std::initializer_list<value> items);
+
+value make_closure(code_t code, const frame* env);
+const frame* make_frame(const frame* parent, const value* arguments, std::size_t count);
+
+value add_slow(const value& left, const value& right);
+value subtract_slow(const value& left, const value& right);
+value multiply_slow(const value& left, const value& right);
+value divide_slow(const value& left, const value& right);
+value remainder_slow(const value& left, const value& right);
+value less_equal_slow(const value& left, const value& right);
+value equal_slow(const value& left, const value& right);
+value car_slow(const value& list);
+value cdr_slow(const value& list);
+value cons_slow(const value& head, const value& tail);
+value apply_slow(const value& function);
+bool truth_slow(const value& condition);
+void arity_error(std::size_t count, std::size_t arity);
+
+inline bool small(const value& left, const value& right) {
+    return left.type == value::kind::number && right.type == value::kind::number;
+}
+
+inline value add(const value& left, const value& right) {
+    std::int64_t result;
+    if(small(left, right) && !__builtin_add_overflow(left.number, right.number, &result))
+        return number(result);
+    return add_slow(left, right);
+}
+
+inline value subtract(const value& left, const value& right) {
+    std::int64_t result;
+    if(small(left, right) && !__builtin_sub_overflow(left.number, right.number, &result))
+        return number(result);
+    return subtract_slow(left, right);
+}
+
+inline value multiply(const value& left, const value& right) {
+    std::int64_t result;
+    if(small(left, right) && !__builtin_mul_overflow(left.number, right.number, &result))
+        return number(result);
+    return multiply_slow(left, right);
+}
+
+inline value divide(const value& left, const value& right) {
+    //ноль, -1 (min / -1) и большие числа - медленный путь
+    if(small(left, right) && right.number != 0 && right.number != -1)
+        return number(left.number / right.number);
+    return divide_slow(left, right);
+}
+
+inline value remainder(const value& left, const value& right) {
+    if(small(left, right) && right.number != 0 && right.number != -1)
+        return number(left.number % right.number);
+    return remainder_slow(left, right);
+}
+
+inline value less_equal(const value& left, const value& right) {
+    if(small(left, right))
+        return boolean(left.number <= right.number);
+    return less_equal_slow(left, right);
+}
+
+inline value equal(const value& left, const value& right) {
+    if(small(left, right))
+        return boolean(left.number == right.number);
+    return equal_slow(left, right);
+}
+
+inline value atom(const value& argument) {
+    return boolean(!argument.is_list());
+}
+
+inline value car(const value& list) {
+    if(list.type == value::kind::pair)
+        return list.cell->head;
+    return car_slow(list);
+}
+
+inline value cdr(const value& list) {
+    if(list.type == value::kind::pair)
+        return list.cell->tail;
+    return cdr_slow(list);
+}
+
+inline value cons(const value& head, const value& tail) {
+    if(tail.type != value::kind::nil && tail.type != value::kind::pair)
+        return cons_slow(head, tail);
+    auto cell = new(allocate(sizeof(pair))) pair{head, tail};
+    value result;
+    result.type = value::kind::pair;
+    result.cell = cell;
+    return result;
+}
+
+// condition of COND
+inline bool truth(const value& condition) {
+    if(condition.type == value::kind::symbol && condition.symbol == &true_name)
+        return true;
+    if(condition.type == value::kind::symbol && condition.symbol == &false_name)
+        return false;
+    return truth_slow(condition);
+}
+
+inline value apply(const value& function, const value* arguments, std::size_t count) {
+    if(function.type != value::kind::closure)
+        return apply_slow(function);
+    return function.function->code(function.function->env, arguments, count);
+}
+
+inline void check_arity(std::size_t count, std::size_t arity) {
+    if(count != arity)
+        arity_error(count, arity);
+}
+
+// the format of AST_node::print
+void print(std::ostream& out, const value& result);
+
+/**
+ * Build the constants, run the program and print its value the way
+ * execute_secd does, or the error.
+ * \returns exit code of the program: 0 or 1 after an error
+ */
+int run(void (*init_constants)(), value (*program)());
+
+}
+
+#endif //LISPKIT_COMPILER_LISPKIT_RUNTIME_HPP
@@ -4,13 +4,33 @@
 
 #include "main_window.hpp"
 
+#include <cstdlib>
+#include <format>
+#include <utility>
+
 MainWindow::MainWindow() :
         paned(Gtk::Orientation::HORIZONTAL),
+        side_paned(Gtk::Orientation::VERTICAL),
         execute_button("Запустить интерпретатор"),
         execute_secd_button("Запустить SECD-машину"),
         compile_button("Скомпилировать Lisp-Kit в код SECD-машины"),
+        cancel_button("Остановить"),
+        memoize_check("Мемоизация вызовов функций"),
+        profile_check("Профилирование"),
+        jit_check("Компиляция горячих функций SECD в машинный код"),
+        lazy_check("Ленивые вычисления (вызов по необходимости)"),
         interpreter(new yy::Interpreter)
 {
+    //кэш на диске включается переменной окружения
+    if(auto cache_directory = std::getenv("LISPKIT_CACHE_DIR"))
+        program_cache.set_disk_directory(cache_directory);
+
+    //зациклившуюся программу останавливает кнопка, но уронить окно она не должна
+    run_limits.max_heap_bytes = std::uint64_t{1} << 30;
+    run_limits.max_stack_bytes = 6 << 20;  // у рабочего потока обычно 8 МиБ
+    run_limits.cancel = &cancel_requested;
+    jit_check.set_sensitive(yy::SECDJit::available());
+
     set_title("Lispkit compiler");
     set_default_size(800, 600);
 
@@ -22,6 +42,13 @@ MainWindow::MainWindow() :
     code_window.set_child(code_view);
     code_window.set_policy(Gtk::PolicyType::AUTOMATIC, Gtk::PolicyType::AUTOMATIC);
     code_window.set_expand();
+    code_view.get_buffer()->signal_changed().connect(
+            sigc::mem_fun(*this, &MainWindow::on_source_changed));
+
+    //синтаксические ошибки текста в редакторе
+    diagnostics_label.set_xalign(0);
+    diagnostics_label.set_wrap();
+    diagnostics_label.set_selectable();
 
     //поле вывода результата трансляции (read-only)
     result_view.set_editable(false);
@@ -29,16 +56,23 @@ MainWindow::MainWindow() :
     result_window.set_policy(Gtk::PolicyType::AUTOMATIC, Gtk::PolicyType::AUTOMATIC);
     result_window.set_expand();
 
-    //вывод дерева трансляции через tree view
-    AST_buffer = Gtk::TreeStore::create(AST_columns);
-    AST_view.set_model(AST_buffer);
-    AST_view.append_column("command", AST_columns.operation);
-    AST_view.append_column("arg_count", AST_columns.arg_count);
+    //вывод дерева трансляции, строки детей создаются только при раскрытии узла
+    AST_history = Gio::ListStore<AstItem>::create();
+    AST_view.set_model(Gtk::NoSelection::create(make_AST_tree_model(AST_history)));
+    append_AST_columns(AST_view);
     AST_window.set_child(AST_view);
     AST_window.set_policy(Gtk::PolicyType::AUTOMATIC, Gtk::PolicyType::AUTOMATIC);
     AST_window.set_expand();
     AST_window.set_margin(10);
 
+    structure_roots = Gio::ListStore<AstItem>::create();
+    structure_view.set_model(Gtk::NoSelection::create(make_AST_tree_model(structure_roots)));
+    append_AST_columns(structure_view);
+    structure_window.set_child(structure_view);
+    structure_window.set_policy(Gtk::PolicyType::AUTOMATIC, Gtk::PolicyType::AUTOMATIC);
+    structure_window.set_expand();
+    structure_window.set_margin(10);
+
     // связывание сигналов-слотов
     execute_button.signal_clicked().connect(
             sigc::mem_fun(*this, &MainWindow::on_execute_button_clicked));
@@ -46,13 +80,24 @@ MainWindow::MainWindow() :
             sigc::mem_fun(*this, &MainWindow::on_execute_secd_button_clicked));
     compile_button.signal_clicked().connect(
             sigc::mem_fun(*this, &MainWindow::on_compile_button_clicked));
+    cancel_button.signal_clicked().connect(
+            sigc::mem_fun(*this, &MainWindow::on_cancel_button_clicked));
+    output_ready.connect(sigc::mem_fun(*this, &MainWindow::on_output_ready));
+    run_finished.connect(sigc::mem_fun(*this, &MainWindow::on_run_finished));
+    cancel_button.set_sensitive(false);
 
     //прикрепление элементов к сетке
     grid.attach(code_window, 0, 0, 2, 1);
-    grid.attach(execute_button, 0, 1);
-    grid.attach(execute_secd_button, 1, 1);
-    grid.attach(compile_button, 0, 2, 2, 1);
-    grid.attach(result_window, 0, 4, 2, 1);
+    grid.attach(diagnostics_label, 0, 1, 2, 1);
+    grid.attach(execute_button, 0, 2);
+    grid.attach(execute_secd_button, 1, 2);
+    grid.attach(compile_button, 0, 3);
+    grid.attach(cancel_button, 1, 3);
+    grid.attach(memoize_check, 0, 4, 2, 1);
+    grid.attach(profile_check, 0, 5, 2, 1);
+    grid.attach(jit_check, 0, 6, 2, 1);
+    grid.attach(lazy_check, 0, 7, 2, 1);
+    grid.attach(result_window, 0, 8, 2, 1);
     //grid.attach(AST_window, 2, 0, 1, 3);
 
     //изначально углы скругленные, хочу квадратные
@@ -64,94 +109,204 @@ MainWindow::MainWindow() :
     AST_frame.set_child(AST_window);
     AST_frame.add_css_class("squared");
     AST_frame.set_label("Execution history");
+    structure_frame.set_child(structure_window);
+    structure_frame.add_css_class("squared");
+    structure_frame.set_label("Program structure");
 
+    side_paned.set_start_child(structure_frame);
+    side_paned.set_end_child(AST_frame);
     paned.set_start_child(grid);
-    paned.set_end_child(AST_frame);
+    paned.set_end_child(side_paned);
+    show_diagnostics();
 
     set_child(paned);
 }
 
+MainWindow::~MainWindow() {
+    //окно закрыли во время запуска - останавливаем и ждем рабочий поток
+    if(worker.joinable()){
+        cancel_requested = true;
+        worker.join();
+    }
+}
+
 void MainWindow::on_execute_button_clicked() {
     auto text = std::string{code_view.get_buffer()->get_text()};
-    interpreter_input = std::istringstream{text};
-    std::stringstream result;
-    (*interpreter).switch_streams(&interpreter_input, &result);
-    (*interpreter).parse();
-    if((*interpreter).is_error()){
-        result_view.get_buffer()->set_text(result.str());
-    }
-    else{
-        result << "Generated from AST: " << (*interpreter).get_AST().print_tree() << std::endl;
+    (*interpreter).memoize = memoize_check.get_active();
+    (*interpreter).lazy = lazy_check.get_active();
+    (*interpreter).profile_execute = profile_check.get_active();
+    (*interpreter).limits = run_limits;
+    (*interpreter).print_depth = result_print_depth;
+    (*interpreter).print_length = result_print_length;
+    start_run([this, text](std::ostream& result){
+        (*interpreter).switch_streams(nullptr, &result);
+        (*interpreter).parse(text, program_cache);
+        if((*interpreter).is_error())
+            return;
+        run_parsed = true;
+        result << "Generated from AST: ";
+        std::as_const(*interpreter).get_AST().print(result, result_print_depth, result_print_length);
+        result << std::endl;
         (*interpreter).execute();
-        fill_AST_buffer();
-    }
-    result_view.get_buffer()->set_text(result.str());
-    interpreter = std::make_unique<yy::Interpreter>();
+        report_memo_statistics(result);
+        if((*interpreter).profile_execute){
+            //формат collapsed stacks, можно сразу отдать flamegraph.pl
+            result << "Collapsed stacks (" << (*interpreter).get_sampling_profiler().get_samples() << " samples):" << std::endl;
+            (*interpreter).get_sampling_profiler().write_collapsed(result);
+        }
+    }, [this]{
+        if(run_parsed)
+            fill_AST_buffer("execute");
+    });
 }
 
 void MainWindow::on_execute_secd_button_clicked() {
     auto text = std::string{code_view.get_buffer()->get_text()};
-    interpreter_input = std::istringstream{text};
-    std::stringstream result;
-    (*interpreter).switch_streams(&interpreter_input, &result);
     (*interpreter).check_number_of_arguments = false;
-    (*interpreter).parse();
-    fill_AST_buffer();
-    (*interpreter).execute_secd();
-    result_view.get_buffer()->set_text(result.str());
-    interpreter = std::make_unique<yy::Interpreter>();
+    (*interpreter).memoize = memoize_check.get_active();
+    (*interpreter).profile_secd = profile_check.get_active();
+    (*interpreter).jit = jit_check.get_active();
+    (*interpreter).lazy = lazy_check.get_active();
+    (*interpreter).limits = run_limits;
+    (*interpreter).print_depth = result_print_depth;
+    (*interpreter).print_length = result_print_length;
+    start_run([this, text](std::ostream& result){
+        (*interpreter).switch_streams(nullptr, &result);
+        (*interpreter).parse(text, program_cache);
+        (*interpreter).execute_secd();
+        report_memo_statistics(result);
+        report_jit_statistics(result);
+        if((*interpreter).profile_secd)
+            (*interpreter).get_secd_profile().report_text(result);
+    }, [this]{
+        fill_AST_buffer("SECD");
+    });
 }
 
 void MainWindow::on_compile_button_clicked() {
     auto text = std::string{code_view.get_buffer()->get_text()};
-    interpreter_input = std::istringstream{text};
-    std::stringstream result;
-    (*interpreter).switch_streams(&interpreter_input, &result);
     (*interpreter).check_number_of_arguments = false;
-    (*interpreter).parse();
-    fill_AST_buffer();
-    (*interpreter).compile();
-    result_view.get_buffer()->set_text(result.str());
-    interpreter = std::make_unique<yy::Interpreter>();
+    (*interpreter).lazy = lazy_check.get_active();
+    start_run([this, text](std::ostream& result){
+        (*interpreter).switch_streams(nullptr, &result);
+        (*interpreter).parse(text, program_cache);
+        (*interpreter).compile();
+    }, [this]{
+        fill_AST_buffer("compile");
+    });
 }
 
-void MainWindow::fill_AST_buffer() {
-    AST_node& current = (*interpreter).get_AST();
-    auto row = *AST_buffer->append();
-    if(std::holds_alternative<std::string>(current.value)){
-        row[AST_columns.operation] = std::get<std::string>(current.value);
-        row[AST_columns.arg_count] = 0;
-    }
-    else if(std::holds_alternative<AST_node::num_t>(current.value)){
-        row[AST_columns.operation] = std::to_string(std::get<AST_node::num_t>(current.value));
-        row[AST_columns.arg_count] = 0;
-    }
-    else{
-        auto&& list = std::get<AST_node::AST_node_list>(current.value);
-        row[AST_columns.operation] = "()";
-        row[AST_columns.arg_count] = list.size();
-        for(auto&& node : list){
-            AST_traversal(node, row);
+void MainWindow::on_cancel_button_clicked() {
+    //исполнение проверяет флаг вместе с ограничениями, разбор и компиляция доработают до конца
+    cancel_requested = true;
+    cancel_button.set_sensitive(false);
+}
+
+void MainWindow::start_run(std::function<void(std::ostream&)> job, std::function<void()> finished) {
+    if(worker.joinable())
+        return;
+    result_view.get_buffer()->set_text("");
+    cancel_requested = false;
+    run_parsed = false;
+    after_run = std::move(finished);
+    output_channel = std::make_unique<yy::OutputChannel>([this]{ output_ready.emit(); });
+    run_output = std::make_unique<std::ostream>(output_channel.get());
+    set_running(true);
+    worker = std::thread{[this, job = std::move(job)]{
+        try{
+            job(*run_output);
         }
-    }
+        catch(const std::exception& ex){
+            (*run_output) << "Error: " << ex.what() << std::endl;
+        }
+        run_output->flush();
+        run_finished.emit();
+    }};
 }
 
-void MainWindow::AST_traversal(AST_node& current, Gtk::TreeRow& parent_row) {
-    auto row = *AST_buffer->append(parent_row.children());
-    if(std::holds_alternative<std::string>(current.value)){
-        row[AST_columns.operation] = std::get<std::string>(current.value);
-        row[AST_columns.arg_count] = 0;
-    }
-    else if(std::holds_alternative<AST_node::num_t>(current.value)){
-        row[AST_columns.operation] = std::to_string(std::get<AST_node::num_t>(current.value));
-        row[AST_columns.arg_count] = 0;
+void MainWindow::on_output_ready() {
+    if(!output_channel)
+        return;
+    auto text = output_channel->take();
+    if(text.empty())
+        return;
+    auto buffer = result_view.get_buffer();
+    buffer->insert(buffer->end(), text);
+}
+
+void MainWindow::on_run_finished() {
+    worker.join();
+    on_output_ready();
+    if(after_run)
+        after_run();
+    after_run = nullptr;
+    run_output.reset();
+    output_channel.reset();
+    interpreter = std::make_unique<yy::Interpreter>();
+    set_running(false);
+}
+
+void MainWindow::set_running(bool running) {
+    execute_button.set_sensitive(!running);
+    execute_secd_button.set_sensitive(!running);
+    compile_button.set_sensitive(!running);
+    cancel_button.set_sensitive(running);
+}
+
+void MainWindow::report_memo_statistics(std::ostream &out) {
+    if(!(*interpreter).memoize)
+        return;
+    auto stats = (*interpreter).get_memo_table().get_statistics();
+    out << "Memoization: " << stats.hits << " hits, " << stats.misses << " misses, "
+        << stats.evictions << " evictions, " << stats.size << " entries" << std::endl;
+}
+
+void MainWindow::report_jit_statistics(std::ostream &out) {
+    if(!(*interpreter).jit || (*interpreter).memoize)
+        return;
+    auto&& stats = (*interpreter).get_secd_jit().get_statistics();
+    out << "JIT: " << stats.compiled << " compiled, " << stats.rejected << " rejected, "
+        << stats.native_calls << " native calls, " << stats.bailouts << " bailouts" << std::endl;
+}
+
+void MainWindow::fill_AST_buffer(const std::string& title) {
+    //строка держит только ссылку на дерево, но старые запуски все равно отбрасываем
+    constexpr unsigned int history_size = 32;
+    if(AST_history->get_n_items() >= history_size)
+        AST_history->remove(0);
+    AST_history->append(AstItem::create(std::as_const(*interpreter).get_AST(), std::format("#{} {}", ++runs, title)));
+}
+
+void MainWindow::on_source_changed() {
+    //правки одной итерации главного цикла (вставка, отмена) разбираются одним проходом
+    if(!reparse_connection.connected())
+        reparse_connection = Glib::signal_idle().connect(sigc::mem_fun(*this, &MainWindow::on_source_idle));
+}
+
+bool MainWindow::on_source_idle() {
+    auto change = live_parser.update(std::string{code_view.get_buffer()->get_text()});
+    patch_structure(change);
+    show_diagnostics();
+    return false;
+}
+
+void MainWindow::patch_structure(const yy::IncrementalParser::change &change) {
+    //строка верхнего уровня - сегмент, меняются только затронутые правкой
+    auto&& segments = live_parser.get_segments();
+    std::vector<Glib::RefPtr<AstItem>> inserted;
+    for(std::size_t i = 0; i < change.inserted; i++){
+        auto&& segment = segments[change.first + i];
+        inserted.push_back(segment.ok ? AstItem::create(segment.AST) : AstItem::create(AST_node{std::string{}}, "syntax error"));
     }
-    else{
-        auto&& list = std::get<AST_node::AST_node_list>(current.value);
-        row[AST_columns.operation] = "()";
-        row[AST_columns.arg_count] = list.size();
-        for(auto&& node : list){
-            AST_traversal(node, row);
-        }
+    structure_roots->splice(change.first, change.removed, inserted);
+}
+
+void MainWindow::show_diagnostics() {
+    std::ostringstream text;
+    for(auto&& diagnostic : live_parser.get_diagnostics()){
+        if(text.tellp() > 0)
+            text << '\n';
+        text << diagnostic.line << ':' << diagnostic.column << ": " << diagnostic.message;
     }
+    diagnostics_label.set_text(text.tellp() > 0 ? text.str() : "Синтаксических ошибок нет");
 }
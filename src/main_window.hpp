@@ -9,30 +9,29 @@
 #include <string>
 #include <stack>
 #include <memory>
+#include <atomic>
+#include <functional>
+#include <thread>
 
 #include <gtkmm.h>
 
 #include "interpreter.hpp"
+#include "incremental_parser.hpp"
+#include "output_channel.hpp"
+#include "ast_list_model.hpp"
 
 class MainWindow : public Gtk::Window {
-private:
-    class ast_model_columns : public Gtk::TreeModel::ColumnRecord {
-    public:
-        ast_model_columns(){
-            add(operation); add(arg_count);
-        }
-        Gtk::TreeModelColumn<std::string> operation;
-        Gtk::TreeModelColumn<unsigned long long> arg_count;
-    };
 public:
     explicit MainWindow();
-    ~MainWindow() override = default;
+    ~MainWindow() override;
     void on_compile_button_clicked();
 protected:
     void on_execute_button_clicked();
 
     void on_execute_secd_button_clicked();
 
+    void on_cancel_button_clicked();
+
 
     //gui components
     Gtk::Grid grid;
@@ -41,26 +40,74 @@ protected:
 
     Gtk::ScrolledWindow code_window;
     Gtk::TextView code_view;
+    Gtk::Label diagnostics_label;
 
     Gtk::ScrolledWindow result_window;
     Gtk::TextView result_view;
 
+    Gtk::Paned side_paned;
+
+    //дерево текста в редакторе, обновляется при каждой правке
+    Gtk::Frame structure_frame;
+    Gtk::ScrolledWindow structure_window;
+    Gtk::ColumnView structure_view;
+    Glib::RefPtr<Gio::ListStore<AstItem>> structure_roots;  // по строке на сегмент
+
     Gtk::Frame AST_frame;
     Gtk::ScrolledWindow AST_window;
-    Gtk::TreeView AST_view;
-    Glib::RefPtr<Gtk::TreeStore> AST_buffer;
-    ast_model_columns AST_columns;
+    Gtk::ColumnView AST_view;
+    Glib::RefPtr<Gio::ListStore<AstItem>> AST_history;      // по строке на запуск
+    unsigned int runs = 0;
 
     Gtk::Button execute_button;
     Gtk::Button execute_secd_button;
     Gtk::Button compile_button;
+    Gtk::Button cancel_button;
+    Gtk::CheckButton memoize_check;
+    Gtk::CheckButton profile_check;
+    Gtk::CheckButton jit_check;
+    Gtk::CheckButton lazy_check;
 
 private:
-    void fill_AST_buffer();
-    void AST_traversal(AST_node& current, Gtk::TreeRow& parent_row);
+    // add the AST of the finished run to the history
+    void fill_AST_buffer(const std::string& title);
+    void report_memo_statistics(std::ostream& out);
+    void report_jit_statistics(std::ostream& out);
+
+    void on_source_changed();
+    bool on_source_idle();
+    void patch_structure(const yy::IncrementalParser::change& change);
+    void show_diagnostics();
+
+    /**
+     * Run job on the worker thread. The job writes to the stream it gets,
+     * the text appears in result_view while it runs. finished is called
+     * on the GTK thread after the job, before the interpreter is reset.
+     */
+    void start_run(std::function<void(std::ostream&)> job, std::function<void()> finished);
+    void on_output_ready();
+    void on_run_finished();
+    void set_running(bool running);
+
+    //огромный результат TextView не покажет, печатаем его начало
+    static constexpr int result_print_depth = 256;
+    static constexpr std::int64_t result_print_length = 10000;
 
     std::unique_ptr<yy::Interpreter> interpreter;
-    std::istringstream interpreter_input;
+    yy::ProgramCache program_cache;
+    yy::resource_limits run_limits;
+    yy::IncrementalParser live_parser;
+    sigc::connection reparse_connection;
+
+    //во время запуска interpreter принадлежит рабочему потоку
+    std::thread worker;
+    std::atomic<bool> cancel_requested{false};
+    Glib::Dispatcher output_ready;
+    Glib::Dispatcher run_finished;
+    std::unique_ptr<yy::OutputChannel> output_channel;
+    std::unique_ptr<std::ostream> run_output;
+    std::function<void()> after_run;
+    bool run_parsed = false;
 };
 
 
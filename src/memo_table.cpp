@@ -0,0 +1,68 @@
+#include "memo_table.hpp"
+
+#include "hash.hpp"
+
+using namespace yy;
+
+MemoTable::MemoTable(std::size_t capacity) :
+        capacity(capacity == 0 ? 1 : capacity)
+{}
+
+std::uint64_t MemoTable::make_key(const AST_node &function, const AST_node &arguments) {
+    auto function_hash = function.hash();
+    auto arguments_hash = arguments.hash();
+    return hashing::fnv1a(&arguments_hash, sizeof(arguments_hash),
+                          hashing::fnv1a(&function_hash, sizeof(function_hash)));
+}
+
+std::optional<AST_node> MemoTable::find(std::uint64_t key, const AST_node &function, const AST_node &arguments) {
+    auto find = entries.find(key);
+    // при коллизии хэшей считаем, что результата нет
+    if(find == entries.end() || find->second.arguments != arguments || find->second.function != function){
+        stats.misses++;
+        return std::nullopt;
+    }
+    stats.hits++;
+    lru.splice(lru.begin(), lru, find->second.lru_position);
+    return find->second.result;
+}
+
+void MemoTable::insert(std::uint64_t key, AST_node function, AST_node arguments, AST_node result) {
+    auto find = entries.find(key);
+    if(find != entries.end()){
+        auto&& found = find->second;
+        found.function = std::move(function);
+        found.arguments = std::move(arguments);
+        found.result = std::move(result);
+        lru.splice(lru.begin(), lru, found.lru_position);
+        return;
+    }
+    evict_to(capacity - 1);
+    lru.push_front(key);
+    entries.insert({key, entry{std::move(function), std::move(arguments), std::move(result), lru.begin()}});
+}
+
+void MemoTable::set_capacity(std::size_t new_capacity) {
+    capacity = new_capacity == 0 ? 1 : new_capacity;
+    evict_to(capacity);
+}
+
+void MemoTable::clear() {
+    lru.clear();
+    entries.clear();
+    stats = {};
+}
+
+MemoTable::statistics MemoTable::get_statistics() const {
+    auto result = stats;
+    result.size = entries.size();
+    return result;
+}
+
+void MemoTable::evict_to(std::size_t size) {
+    while(entries.size() > size){
+        entries.erase(lru.back());
+        lru.pop_back();
+        stats.evictions++;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef LISPKIT_COMPILER_MEMO_TABLE_HPP
+#define LISPKIT_COMPILER_MEMO_TABLE_HPP
+
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <unordered_map>
+
+#include "AST.hpp"
+
+namespace yy {
+
+/**
+ * Bounded LRU table of function call results. LispKit has no side
+ * effects, so (function, arguments) fully determines the result.
+ * For the tree-walking interpreter the function is its ((args) body)
+ * value, for the SECD machine it is the closure (code env).
+ */
+class MemoTable {
+public:
+    explicit MemoTable(std::size_t capacity = 4096);
+
+    static std::uint64_t make_key(const AST_node& function, const AST_node& arguments);
+
+    std::optional<AST_node> find(std::uint64_t key, const AST_node& function, const AST_node& arguments);
+
+    void insert(std::uint64_t key, AST_node function, AST_node arguments, AST_node result);
+
+    void set_capacity(std::size_t new_capacity);
+
+    void clear();
+
+    struct statistics {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+        std::size_t size = 0;
+    };
+    statistics get_statistics() const;
+
+private:
+    using lru_list_t = std::list<std::uint64_t>;
+    struct entry {
+        AST_node function;
+        AST_node arguments;
+        AST_node result;
+        lru_list_t::iterator lru_position;
+    };
+
+    void evict_to(std::size_t size);
+
+    std::size_t capacity;
+    lru_list_t lru;
+    std::unordered_map<std::uint64_t, entry> entries;
+    statistics stats;
+};
+
+}
+
+#endif //LISPKIT_COMPILER_MEMO_TABLE_HPP
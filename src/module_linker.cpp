@@ -0,0 +1,237 @@
+#include "module_linker.hpp"
+
+#include <algorithm>
+#include <format>
+#include <unordered_map>
+#include <utility>
+
+#include "secd_image.hpp"
+
+using namespace yy;
+
+namespace {
+    // (UNIT name hash (imports) (exports) ((name code)...) (program) или ())
+    AST_node names_node(const std::vector<std::string>& names){
+        auto result = AST_node{};
+        for(auto&& name : names)
+            result.to_list().emplace_back(name);
+        return result;
+    }
+
+    std::vector<std::string> read_names(const AST_node& node){
+        if(!node.is_list())
+            throw std::runtime_error{"module unit: malformed file"};
+        std::vector<std::string> result;
+        for(auto&& name : node.to_list()){
+            if(!name.is_string())
+                throw std::runtime_error{"module unit: malformed file"};
+            result.push_back(name.to_string());
+        }
+        return result;
+    }
+
+    // операнд инструкции, на которой стоит instruction
+    AST_node& operand(AST_node::AST_node_list& code, AST_node::AST_node_list::iterator& instruction){
+        if(++instruction == code.end())
+            throw link_error{std::format("{} without an operand in the code", std::prev(instruction)->to_string())};
+        return *instruction;
+    }
+
+    // код функции, чей кадр на стеке кадров (RTS): окружение у него то же, что при LDF
+    bool frame_on_stack(const AST_node& code){
+        auto&& list = code.to_list();
+        return !list.empty() && list.back().is_string() && list.back().to_string() == "RTS";
+    }
+
+    /**
+     * LD (i j) of the unit frame becomes LD (i slot). The unit frame is
+     * the outermost one, i counts the frames made by the LDF around the
+     * instruction, except the frames on the frame stack; SEL and LDE code
+     * runs in the frame of its instruction.
+     */
+    void relocate(AST_node& code, std::size_t depth, const std::vector<std::size_t>& slots){
+        if(!code.is_list())
+            throw link_error{"malformed code"};
+        auto&& list = code.to_list();
+        for(auto instruction = list.begin(); instruction != list.end(); ++instruction){
+            if(!instruction->is_string())
+                continue;
+            auto&& command = instruction->to_string();
+            if(command == "LDC")
+                operand(list, instruction);
+            else if(command == "LD"){
+                auto&& address = operand(list, instruction);
+                if(!address.is_list() || address.to_list().size() != 2 ||
+                   !address.to_list().front().is_num() || !address.to_list().back().is_num())
+                    throw link_error{"malformed LD in the code"};
+                auto&& frame = address.to_list().front().to_num();
+                auto&& index = address.to_list().back().to_num();
+                if(frame != static_cast<AST_node::num_t>(depth))
+                    continue;
+                if(index < 0 || static_cast<std::size_t>(index) >= slots.size())
+                    throw link_error{"LD outside of the symbol table of the unit"};
+                index = static_cast<AST_node::num_t>(slots[static_cast<std::size_t>(index)]);
+            }
+            else if(command == "LDF"){
+                auto&& function = operand(list, instruction);
+                if(!function.is_list())
+                    throw link_error{"malformed code"};
+                relocate(function, frame_on_stack(function) ? depth : depth + 1, slots);
+            }
+            else if(command == "LDE")
+                relocate(operand(list, instruction), depth, slots);
+            else if(command == "SEL" || command == "SEL_B"){
+                relocate(operand(list, instruction), depth, slots);
+                relocate(operand(list, instruction), depth, slots);
+            }
+        }
+    }
+}
+
+std::size_t module_unit::symbol_count() const {
+    return definitions.size() + imports.size();
+}
+
+void module_unit::save(const std::filesystem::path &path) const {
+    auto unit = AST_node{};
+    auto&& items = unit.to_list();
+    items.emplace_back(std::string{"UNIT"});
+    items.emplace_back(name);
+    items.emplace_back(static_cast<AST_node::num_t>(source_hash));
+    items.push_back(names_node(imports));
+    items.push_back(names_node(exports));
+    auto&& definitions_node = items.emplace_back();
+    for(auto&& [definition_name, code] : definitions){
+        auto&& pair = definitions_node.to_list().emplace_back();
+        pair.to_list().emplace_back(definition_name);
+        pair.to_list().push_back(code);
+    }
+    auto&& program_node = items.emplace_back();
+    if(program)
+        program_node.to_list().push_back(*program);
+    image::save(path, unit);
+}
+
+module_unit module_unit::load(const std::filesystem::path &path) {
+    auto unit = image::load(path);
+    auto malformed = std::runtime_error{std::format("module unit {}: malformed file", path.string())};
+    if(!unit.is_list() || unit.to_list().size() != 7)
+        throw malformed;
+    auto item = std::as_const(unit).to_list().begin();
+    if(!item->is_string() || item->to_string() != "UNIT")
+        throw malformed;
+    module_unit result;
+    if(!(++item)->is_string())
+        throw malformed;
+    result.name = item->to_string();
+    if(!(++item)->is_num())
+        throw malformed;
+    result.source_hash = static_cast<std::uint64_t>(item->to_num());
+    result.imports = read_names(*++item);
+    result.exports = read_names(*++item);
+    if(!(++item)->is_list())
+        throw malformed;
+    for(auto&& pair : item->to_list()){
+        if(!pair.is_list() || pair.to_list().size() != 2 || !pair.to_list().front().is_string())
+            throw malformed;
+        result.definitions.push_back({pair.to_list().front().to_string(), pair.to_list().back()});
+    }
+    if(!(++item)->is_list() || item->to_list().size() > 1)
+        throw malformed;
+    if(!item->to_list().empty())
+        result.program = item->to_list().front();
+    return result;
+}
+
+linked_program yy::link(const std::vector<module_unit> &units) {
+    //кто экспортирует имя: модуль и номер определения в нем
+    struct exported{
+        std::size_t unit;
+        std::size_t definition;
+    };
+    std::unordered_map<std::string, exported> exporters;
+    for(std::size_t u = 0; u < units.size(); u++){
+        auto&& unit = units[u];
+        for(auto&& name : unit.exports){
+            auto definition = std::find_if(unit.definitions.begin(), unit.definitions.end(),
+                                           [&name](auto&& item){ return item.name == name; });
+            if(definition == unit.definitions.end())
+                throw link_error{std::format("module {} exports {} but does not define it", unit.name, name)};
+            auto [found, inserted] = exporters.try_emplace(name, exported{u, static_cast<std::size_t>(definition - unit.definitions.begin())});
+            if(!inserted)
+                throw link_error{std::format("{} is exported by both {} and {}", name, units[found->second.unit].name, unit.name)};
+        }
+    }
+    std::vector<std::vector<std::size_t>> dependencies(units.size());
+    for(std::size_t u = 0; u < units.size(); u++){
+        for(auto&& name : units[u].imports){
+            auto found = exporters.find(name);
+            if(found == exporters.end())
+                throw link_error{std::format("module {} imports {}, no module exports it", units[u].name, name)};
+            dependencies[u].push_back(found->second.unit);
+        }
+    }
+
+    //порядок: модуль после тех, из которых он импортирует, иначе как в units
+    enum class state{ unvisited, visiting, placed };
+    std::vector<state> states(units.size(), state::unvisited);
+    std::vector<std::size_t> order;
+    std::vector<std::pair<std::size_t, std::size_t>> path;     // модуль и следующая зависимость
+    for(std::size_t root = 0; root < units.size(); root++){
+        if(states[root] != state::unvisited)
+            continue;
+        states[root] = state::visiting;
+        path.emplace_back(root, 0);
+        while(!path.empty()){
+            auto&& [u, next] = path.back();
+            if(next == dependencies[u].size()){
+                states[u] = state::placed;
+                order.push_back(u);
+                path.pop_back();
+                continue;
+            }
+            auto dependency = dependencies[u][next++];
+            if(states[dependency] == state::visiting)
+                throw link_error{std::format("modules {} and {} import from each other", units[u].name, units[dependency].name)};
+            if(states[dependency] == state::unvisited){
+                states[dependency] = state::visiting;
+                path.emplace_back(dependency, 0);
+            }
+        }
+    }
+
+    linked_program result;
+    std::vector<std::size_t> base(units.size());
+    for(auto u : order){
+        base[u] = result.definitions.size();
+        for(auto&& definition : units[u].definitions){
+            result.names.to_list().emplace_back(definition.name);
+            result.definitions.push_back(definition.code);
+        }
+    }
+    for(auto u : order){
+        auto&& unit = units[u];
+        std::vector<std::size_t> slots;
+        slots.reserve(unit.symbol_count());
+        for(std::size_t j = 0; j < unit.definitions.size(); j++)
+            slots.push_back(base[u] + j);
+        for(auto&& name : unit.imports){
+            auto&& source = exporters.at(name);
+            slots.push_back(base[source.unit] + source.definition);
+        }
+        try{
+            for(std::size_t j = 0; j < unit.definitions.size(); j++)
+                relocate(result.definitions[base[u] + j], 0, slots);
+            if(unit.program){
+                if(result.program)
+                    throw link_error{"more than one module has a program expression"};
+                result.program = *unit.program;
+                relocate(*result.program, 0, slots);
+            }
+        }
+        catch(const link_error& error){
+            throw link_error{std::format("module {}: {}", unit.name, error.what())};
+        }
+    }
+    return result;
+}
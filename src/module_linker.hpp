@@ -0,0 +1,74 @@
+#ifndef LISPKIT_COMPILER_MODULE_LINKER_HPP
+#define LISPKIT_COMPILER_MODULE_LINKER_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "AST.hpp"
+
+namespace yy {
+
+/**
+ * Separate compilation. A module is a source file of several top-level
+ * forms:
+ *
+ *     (IMPORT NAME...)              names defined by other modules
+ *     (EXPORT NAME...)              definitions other modules may import
+ *     (DEFINE NAME EXPRESSION)
+ *     EXPRESSION                    the program, only as the last form
+ *
+ * Interpreter::compile_module turns it into a module_unit of SECD code.
+ * The code does not know where the definitions of other modules are: the
+ * outermost frame of every definition is the symbol table of the unit,
+ * its own definitions followed by its imports, and LD (i j) of that frame
+ * names entry j of the table. link() lays the definitions of all units
+ * out in one global frame and rewrites those LD into slots of it, so a
+ * changed module is the only one to compile again.
+ */
+struct module_unit {
+    struct definition {
+        std::string name;
+        AST_node code;          // SECD program ending with STOP, leaves the value on the stack
+    };
+
+    std::string name;
+    std::uint64_t source_hash = 0;
+    std::vector<std::string> imports;
+    std::vector<std::string> exports;
+    std::vector<definition> definitions;
+    std::optional<AST_node> program;
+
+    // entries of the symbol table: definitions, then imports
+    std::size_t symbol_count() const;
+
+    // the unit in the binary image format of secd_image.hpp, throws std::runtime_error
+    void save(const std::filesystem::path& path) const;
+    static module_unit load(const std::filesystem::path& path);
+};
+
+struct linked_program {
+    AST_node names;                     // the global frame, in slot order
+    std::vector<AST_node> definitions;  // code of every slot, run in slot order
+    std::optional<AST_node> program;
+};
+
+class link_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * Units are laid out so that every unit comes after the ones it imports
+ * from, otherwise in the given order. Throws link_error on an import no
+ * unit exports, a name exported twice, an import cycle or more than one
+ * program.
+ */
+linked_program link(const std::vector<module_unit>& units);
+
+}
+
+#endif //LISPKIT_COMPILER_MODULE_LINKER_HPP
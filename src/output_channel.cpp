@@ -0,0 +1,49 @@
+#include "output_channel.hpp"
+
+#include <utility>
+
+using namespace yy;
+
+OutputChannel::OutputChannel(std::function<void()> notify) :
+        notify(std::move(notify))
+{}
+
+std::string OutputChannel::take() {
+    std::lock_guard lock{mutex};
+    notified.store(false);
+    return std::exchange(published, {});
+}
+
+OutputChannel::int_type OutputChannel::overflow(int_type ch) {
+    if(traits_type::eq_int_type(ch, traits_type::eof()))
+        return traits_type::not_eof(ch);
+    local += traits_type::to_char_type(ch);
+    if(local.size() >= publish_size)
+        publish();
+    return ch;
+}
+
+std::streamsize OutputChannel::xsputn(const char *s, std::streamsize count) {
+    local.append(s, static_cast<std::size_t>(count));
+    if(local.size() >= publish_size)
+        publish();
+    return count;
+}
+
+int OutputChannel::sync() {
+    publish();
+    return 0;
+}
+
+void OutputChannel::publish() {
+    if(local.empty())
+        return;
+    {
+        std::lock_guard lock{mutex};
+        published += local;
+    }
+    local.clear();
+    //читатель еще не забрал прошлую порцию - он заберет и эту
+    if(!notified.exchange(true))
+        notify();
+}
@@ -0,0 +1,47 @@
+#ifndef LISPKIT_COMPILER_OUTPUT_CHANNEL_HPP
+#define LISPKIT_COMPILER_OUTPUT_CHANNEL_HPP
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <streambuf>
+#include <string>
+
+namespace yy {
+
+/**
+ * Stream buffer that hands the output of a run on one thread to another.
+ *
+ * The writer thread uses it through an std::ostream. Text is published on
+ * every flush (std::endl) and when a large chunk has collected. After
+ * publishing, notify is called once until the reader takes the text, so a
+ * chatty program does not flood the reader with wakeups. take() is called
+ * by the reader thread.
+ */
+class OutputChannel : public std::streambuf {
+public:
+    explicit OutputChannel(std::function<void()> notify);
+
+    // everything published since the last call
+    std::string take();
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize count) override;
+    int sync() override;
+
+private:
+    static constexpr std::size_t publish_size = 64 * 1024;
+
+    void publish();
+
+    std::string local;        // только поток-писатель
+    std::mutex mutex;
+    std::string published;    // под mutex
+    std::atomic<bool> notified{false};
+    std::function<void()> notify;
+};
+
+}
+
+#endif //LISPKIT_COMPILER_OUTPUT_CHANNEL_HPP
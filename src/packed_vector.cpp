@@ -0,0 +1,392 @@
+#include "packed_vector.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "arithmetic.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define LISPKIT_PACKED_AVX2 1
+#endif
+
+namespace {
+    using element_t = AST_node::num_t;
+    using elements_t = std::vector<element_t>;
+
+    // operand of an elementwise loop: an array or one number repeated
+    struct operand{
+        const element_t* data;
+        bool repeated;
+
+        element_t at(std::size_t i) const { return repeated ? *data : data[i]; }
+        operand from(std::size_t i) const { return {repeated ? data : data + i, repeated}; }
+    };
+
+    enum class operation{ add, subtract, multiply, less_equal, equal };
+
+    // false on overflow
+    template<operation op>
+    bool apply(element_t left, element_t right, element_t& result){
+        if constexpr(op == operation::add)
+            return !__builtin_add_overflow(left, right, &result);
+        else if constexpr(op == operation::subtract)
+            return !__builtin_sub_overflow(left, right, &result);
+        else if constexpr(op == operation::multiply)
+            return !__builtin_mul_overflow(left, right, &result);
+        else if constexpr(op == operation::less_equal)
+            result = left <= right;
+        else
+            result = left == right;
+        return true;
+    }
+
+    template<operation op>
+    bool elementwise_scalar(operand left, operand right, element_t* result, std::size_t size){
+        bool fits = true;
+        for(std::size_t i = 0; i < size; i++)
+            fits &= apply<op>(left.at(i), right.at(i), result[i]);
+        return fits;
+    }
+
+    // nullopt when the sum does not fit, the caller counts it exactly
+    std::optional<element_t> sum_scalar(const element_t* data, std::size_t size){
+        element_t total = 0;
+        for(std::size_t i = 0; i < size; i++)
+            if(__builtin_add_overflow(total, data[i], &total))
+                return std::nullopt;
+        return total;
+    }
+
+    std::optional<element_t> dot_scalar(const element_t* left, const element_t* right, std::size_t size){
+        element_t total = 0;
+        for(std::size_t i = 0; i < size; i++){
+            element_t product;
+            if(__builtin_mul_overflow(left[i], right[i], &product) || __builtin_add_overflow(total, product, &total))
+                return std::nullopt;
+        }
+        return total;
+    }
+
+    // size > 0
+    element_t minimum_scalar(const element_t* data, std::size_t size){
+        return *std::min_element(data, data + size);
+    }
+
+    element_t maximum_scalar(const element_t* data, std::size_t size){
+        return *std::max_element(data, data + size);
+    }
+
+#ifdef LISPKIT_PACKED_AVX2
+#define LISPKIT_AVX2 __attribute__((target("avx2")))
+
+    LISPKIT_AVX2 inline __m256i load(const element_t* data){
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    }
+
+    LISPKIT_AVX2 inline void store(element_t* data, __m256i value){
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data), value);
+    }
+
+    LISPKIT_AVX2 inline bool any_sign(__m256i value){
+        return _mm256_movemask_pd(_mm256_castsi256_pd(value)) != 0;
+    }
+
+    // lanes outside of int32: _mm256_mul_epi32 multiplies only the low halves
+    LISPKIT_AVX2 inline __m256i outside_int32(__m256i value){
+        auto max = _mm256_set1_epi64x(std::numeric_limits<std::int32_t>::max());
+        auto min = _mm256_set1_epi64x(std::numeric_limits<std::int32_t>::min());
+        return _mm256_or_si256(_mm256_cmpgt_epi64(value, max), _mm256_cmpgt_epi64(min, value));
+    }
+
+    template<operation op>
+    LISPKIT_AVX2 bool elementwise_avx2(operand left, operand right, element_t* result, std::size_t size){
+        //у пустого вектора data() может быть нулевым
+        auto left_repeated = _mm256_set1_epi64x(left.repeated ? *left.data : 0);
+        auto right_repeated = _mm256_set1_epi64x(right.repeated ? *right.data : 0);
+        auto overflow = _mm256_setzero_si256();
+        auto one = _mm256_set1_epi64x(1);
+        std::size_t i = 0;
+        for(; i + 4 <= size; i += 4){
+            auto a = left.repeated ? left_repeated : load(left.data + i);
+            auto b = right.repeated ? right_repeated : load(right.data + i);
+            __m256i r;
+            if constexpr(op == operation::add){
+                r = _mm256_add_epi64(a, b);
+                //переполнение - у результата знак не как у обоих слагаемых
+                overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(a, r), _mm256_xor_si256(b, r)));
+            }
+            else if constexpr(op == operation::subtract){
+                r = _mm256_sub_epi64(a, b);
+                overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, r)));
+            }
+            else if constexpr(op == operation::multiply){
+                //умножения 64x64 в AVX2 нет: большие множители считаем по одному
+                auto wide = _mm256_or_si256(outside_int32(a), outside_int32(b));
+                if(!_mm256_testz_si256(wide, wide)){
+                    if(!elementwise_scalar<op>(left.from(i), right.from(i), result + i, 4))
+                        return false;
+                    continue;
+                }
+                r = _mm256_mul_epi32(a, b);
+            }
+            else if constexpr(op == operation::less_equal)
+                r = _mm256_andnot_si256(_mm256_cmpgt_epi64(a, b), one);
+            else
+                r = _mm256_and_si256(_mm256_cmpeq_epi64(a, b), one);
+            store(result + i, r);
+        }
+        if(any_sign(overflow))
+            return false;
+        return elementwise_scalar<op>(left.from(i), right.from(i), result + i, size - i);
+    }
+
+    // adds the lanes and the tail to total
+    LISPKIT_AVX2 std::optional<element_t> finish_sum(__m256i lanes, element_t total){
+        alignas(32) element_t parts[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(parts), lanes);
+        for(auto part : parts)
+            if(__builtin_add_overflow(total, part, &total))
+                return std::nullopt;
+        return total;
+    }
+
+    LISPKIT_AVX2 std::optional<element_t> sum_avx2(const element_t* data, std::size_t size){
+        auto total = _mm256_setzero_si256();
+        auto overflow = _mm256_setzero_si256();
+        std::size_t i = 0;
+        for(; i + 4 <= size; i += 4){
+            auto x = load(data + i);
+            auto r = _mm256_add_epi64(total, x);
+            overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(total, r), _mm256_xor_si256(x, r)));
+            total = r;
+        }
+        //переполнение частичной суммы еще не значит, что не поместится вся - это решит точный подсчет
+        if(any_sign(overflow))
+            return std::nullopt;
+        auto tail = sum_scalar(data + i, size - i);
+        if(!tail)
+            return std::nullopt;
+        return finish_sum(total, *tail);
+    }
+
+    LISPKIT_AVX2 std::optional<element_t> dot_avx2(const element_t* left, const element_t* right, std::size_t size){
+        auto total = _mm256_setzero_si256();
+        auto overflow = _mm256_setzero_si256();
+        element_t rest = 0;     // блоки с большими множителями и хвост
+        std::size_t i = 0;
+        for(; i + 4 <= size; i += 4){
+            auto a = load(left + i);
+            auto b = load(right + i);
+            auto wide = _mm256_or_si256(outside_int32(a), outside_int32(b));
+            if(!_mm256_testz_si256(wide, wide)){
+                auto block = dot_scalar(left + i, right + i, 4);
+                if(!block || __builtin_add_overflow(rest, *block, &rest))
+                    return std::nullopt;
+                continue;
+            }
+            auto p = _mm256_mul_epi32(a, b);
+            auto r = _mm256_add_epi64(total, p);
+            overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(total, r), _mm256_xor_si256(p, r)));
+            total = r;
+        }
+        if(any_sign(overflow))
+            return std::nullopt;
+        auto tail = dot_scalar(left + i, right + i, size - i);
+        if(!tail || __builtin_add_overflow(rest, *tail, &rest))
+            return std::nullopt;
+        return finish_sum(total, rest);
+    }
+
+    template<bool maximum>
+    LISPKIT_AVX2 element_t extremum_avx2(const element_t* data, std::size_t size){
+        auto best = _mm256_set1_epi64x(data[0]);
+        std::size_t i = 0;
+        for(; i + 4 <= size; i += 4){
+            auto x = load(data + i);
+            auto better = maximum ? _mm256_cmpgt_epi64(x, best) : _mm256_cmpgt_epi64(best, x);
+            best = _mm256_blendv_epi8(best, x, better);
+        }
+        alignas(32) element_t parts[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(parts), best);
+        auto result = maximum ? *std::max_element(parts, parts + 4) : *std::min_element(parts, parts + 4);
+        for(; i < size; i++)
+            result = maximum ? std::max(result, data[i]) : std::min(result, data[i]);
+        return result;
+    }
+
+    element_t minimum_avx2(const element_t* data, std::size_t size){
+        return extremum_avx2<false>(data, size);
+    }
+
+    element_t maximum_avx2(const element_t* data, std::size_t size){
+        return extremum_avx2<true>(data, size);
+    }
+#endif
+
+    struct kernels{
+        const char* name;
+        std::array<bool (*)(operand, operand, element_t*, std::size_t), 5> elementwise;
+        std::optional<element_t> (*sum)(const element_t*, std::size_t);
+        std::optional<element_t> (*dot)(const element_t*, const element_t*, std::size_t);
+        element_t (*minimum)(const element_t*, std::size_t);
+        element_t (*maximum)(const element_t*, std::size_t);
+    };
+
+    kernels choose_kernels(){
+#ifdef LISPKIT_PACKED_AVX2
+        if(__builtin_cpu_supports("avx2"))
+            return {"avx2",
+                    {elementwise_avx2<operation::add>, elementwise_avx2<operation::subtract>,
+                     elementwise_avx2<operation::multiply>, elementwise_avx2<operation::less_equal>,
+                     elementwise_avx2<operation::equal>},
+                    sum_avx2, dot_avx2, minimum_avx2, maximum_avx2};
+#endif
+        return {"scalar",
+                {elementwise_scalar<operation::add>, elementwise_scalar<operation::subtract>,
+                 elementwise_scalar<operation::multiply>, elementwise_scalar<operation::less_equal>,
+                 elementwise_scalar<operation::equal>},
+                sum_scalar, dot_scalar, minimum_scalar, maximum_scalar};
+    }
+
+    //выбираются один раз, при первом обращении
+    const kernels& selected(){
+        static const kernels chosen = choose_kernels();
+        return chosen;
+    }
+
+    const elements_t& vector_argument(const AST_node& node){
+        if(!node.is_vector())
+            throw packed::vector_error{"the argument must be a vector"};
+        return node.to_vector();
+    }
+
+    operand operand_of(const AST_node& node){
+        if(node.is_vector())
+            return {node.to_vector().data(), false};
+        if(node.is_num())
+            return {&node.to_num(), true};
+        if(node.is_big())
+            throw packed::vector_error{"numbers must fit in 64 bits"};
+        throw packed::vector_error{"arguments must be vectors or numbers"};
+    }
+
+    AST_node make_vector(const AST_node* arguments){
+        auto&& list_node = arguments[0];
+        if(!list_node.is_list())
+            throw packed::vector_error{"the argument must be a list of numbers"};
+        auto&& list = list_node.to_list();
+        elements_t elements;
+        elements.reserve(list.size());
+        for(auto&& elem : list){
+            if(elem.is_big())
+                throw packed::vector_error{"numbers must fit in 64 bits"};
+            if(!elem.is_num())
+                throw packed::vector_error{"the argument must be a list of numbers"};
+            elements.push_back(elem.to_num());
+        }
+        return AST_node{std::move(elements)};
+    }
+
+    AST_node vector_list(const AST_node* arguments){
+        AST_node result{};
+        auto&& list = result.to_list();
+        for(auto elem : vector_argument(arguments[0]))
+            list.emplace_back(elem);
+        return result;
+    }
+
+    AST_node vector_length(const AST_node* arguments){
+        return AST_node{static_cast<element_t>(vector_argument(arguments[0]).size())};
+    }
+
+    template<operation op>
+    AST_node elementwise(const AST_node* arguments){
+        auto&& left = arguments[0];
+        auto&& right = arguments[1];
+        if(!left.is_vector() && !right.is_vector())
+            throw packed::vector_error{"at least one argument must be a vector"};
+        auto left_operand = operand_of(left);
+        auto right_operand = operand_of(right);
+        if(left.is_vector() && right.is_vector() && left.to_vector().size() != right.to_vector().size())
+            throw packed::vector_error{"vectors must have the same length"};
+        auto size = (left.is_vector() ? left : right).to_vector().size();
+        elements_t result(size);
+        if(!selected().elementwise[static_cast<std::size_t>(op)](left_operand, right_operand, result.data(), size))
+            throw packed::vector_error{"an element of the result does not fit in 64 bits"};
+        return AST_node{std::move(result)};
+    }
+
+    AST_node vector_sum(const AST_node* arguments){
+        auto&& elements = vector_argument(arguments[0]);
+        if(auto total = selected().sum(elements.data(), elements.size()))
+            return AST_node{*total};
+        //не поместилось в 64 бита - считаем точно, как ADD
+        auto total = AST_node{element_t{0}};
+        for(auto elem : elements)
+            total = arithmetic::add(total, AST_node{elem});
+        return total;
+    }
+
+    AST_node vector_dot(const AST_node* arguments){
+        auto&& left = vector_argument(arguments[0]);
+        auto&& right = vector_argument(arguments[1]);
+        if(left.size() != right.size())
+            throw packed::vector_error{"vectors must have the same length"};
+        if(auto total = selected().dot(left.data(), right.data(), left.size()))
+            return AST_node{*total};
+        auto total = AST_node{element_t{0}};
+        for(std::size_t i = 0; i < left.size(); i++)
+            total = arithmetic::add(total, arithmetic::multiply(AST_node{left[i]}, AST_node{right[i]}));
+        return total;
+    }
+
+    AST_node vector_minimum(const AST_node* arguments){
+        auto&& elements = vector_argument(arguments[0]);
+        if(elements.empty())
+            throw packed::vector_error{"the vector is empty"};
+        return AST_node{selected().minimum(elements.data(), elements.size())};
+    }
+
+    AST_node vector_maximum(const AST_node* arguments){
+        auto&& elements = vector_argument(arguments[0]);
+        if(elements.empty())
+            throw packed::vector_error{"the vector is empty"};
+        return AST_node{selected().maximum(elements.data(), elements.size())};
+    }
+
+    const std::array<packed::builtin, 12> all_builtins{{
+        {"VEC", 1, make_vector},
+        {"VLIST", 1, vector_list},
+        {"VLEN", 1, vector_length},
+        {"VADD", 2, elementwise<operation::add>},
+        {"VSUB", 2, elementwise<operation::subtract>},
+        {"VMUL", 2, elementwise<operation::multiply>},
+        {"VLEQ", 2, elementwise<operation::less_equal>},
+        {"VEQ", 2, elementwise<operation::equal>},
+        {"VDOT", 2, vector_dot},
+        {"VSUM", 1, vector_sum},
+        {"VMIN", 1, vector_minimum},
+        {"VMAX", 1, vector_maximum}
+    }};
+}
+
+const packed::builtin* packed::find(std::string_view name) {
+    auto found = std::find_if(all_builtins.begin(), all_builtins.end(), [name](const builtin& candidate){
+        return candidate.name == name;
+    });
+    return found == all_builtins.end() ? nullptr : &*found;
+}
+
+std::span<const packed::builtin> packed::builtins() {
+    return all_builtins;
+}
+
+const char* packed::kernel_set() {
+    return selected().name;
+}
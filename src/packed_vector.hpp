@@ -0,0 +1,49 @@
+#ifndef LISPKIT_COMPILER_PACKED_VECTOR_HPP
+#define LISPKIT_COMPILER_PACKED_VECTOR_HPP
+
+#include <span>
+#include <stdexcept>
+#include <string_view>
+
+#include "AST.hpp"
+
+/**
+ * Packed vectors: numbers in one contiguous int64 array instead of a list
+ * of nodes, for bulk arithmetic without an interpreted instruction per
+ * element. A vector is an atom made at run time, printed as [1 2 3].
+ *
+ * Builtins of both evaluators (execute and the SECD machine):
+ *
+ *     (VEC list) (VLIST v) (VLEN v)
+ *     (VADD a b) (VSUB a b) (VMUL a b)   elementwise, a number operand is repeated
+ *     (VLEQ a b) (VEQ a b)               elementwise, 1 where it holds, 0 where not
+ *     (VDOT a b) (VSUM v) (VMIN v) (VMAX v)
+ *
+ * Elements of an elementwise result must fit in 64 bits, reductions are
+ * exact and become big numbers the way ADD does. The loops use AVX2 when
+ * the processor has it and plain C++ otherwise.
+ */
+namespace packed{
+    struct builtin{
+        std::string_view name;
+        int arguments;
+        // arguments are already evaluated, throws vector_error
+        AST_node (*apply)(const AST_node* arguments);
+    };
+
+    // builtin called name, nullptr if there is none
+    const builtin* find(std::string_view name);
+
+    std::span<const builtin> builtins();
+
+    // the message is the description for the error report of the evaluator
+    class vector_error : public std::runtime_error{
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // loops in use: "avx2" or "scalar"
+    const char* kernel_set();
+}
+
+#endif //LISPKIT_COMPILER_PACKED_VECTOR_HPP
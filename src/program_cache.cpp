@@ -0,0 +1,219 @@
+#include "program_cache.hpp"
+
+#include <fstream>
+#include <format>
+#include <new>
+#include <stdexcept>
+
+#include "hash.hpp"
+#include "secd_image.hpp"
+
+using namespace yy;
+
+namespace {
+    constexpr char disk_magic[4] = {'L', 'K', 'P', 'C'};
+    constexpr std::uint32_t disk_version = 2;
+
+    template<typename T>
+    void write_raw(std::ostream& out, const T& value){
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    bool read_raw(std::istream& in, T& value){
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    void write_string(std::ostream& out, std::string_view str){
+        write_raw(out, static_cast<std::uint64_t>(str.size()));
+        out.write(str.data(), static_cast<std::streamsize>(str.size()));
+    }
+
+    bool read_string(std::istream& in, std::string& str){
+        std::uint64_t size;
+        if(!read_raw(in, size))
+            return false;
+        //длина из битого файла может быть любой - больше, чем в файле осталось, не читаем
+        auto position = in.tellg();
+        if(position < 0 || !in.seekg(0, std::ios::end))
+            return false;
+        auto left = static_cast<std::uint64_t>(in.tellg() - position);
+        if(!in.seekg(position) || size > left)
+            return false;
+        str.resize(size);
+        return static_cast<bool>(in.read(str.data(), static_cast<std::streamsize>(size)));
+    }
+}
+
+ProgramCache::ProgramCache(std::size_t capacity, std::filesystem::path disk_directory) :
+        capacity(capacity == 0 ? 1 : capacity)
+{
+    set_disk_directory(std::move(disk_directory));
+}
+
+// FNV-1a, the parse mode is mixed in as one extra byte
+ProgramCache::key_t ProgramCache::make_key(std::string_view source, bool check_number_of_arguments) {
+    char mode = check_number_of_arguments ? 1 : 2;
+    return hashing::fnv1a(&mode, 1, hashing::fnv1a(source));
+}
+
+std::shared_ptr<const cached_program> ProgramCache::find(std::string_view source, bool check_number_of_arguments) {
+    auto key = make_key(source, check_number_of_arguments);
+    std::lock_guard lock{mutex};
+    if(auto program = find_in_memory(key, source)){
+        stats.hits++;
+        return program;
+    }
+    if(auto program = load_from_disk(key, source)){
+        stats.disk_hits++;
+        put_in_memory(key, program);
+        return program;
+    }
+    stats.misses++;
+    return nullptr;
+}
+
+std::shared_ptr<const cached_program>
+ProgramCache::insert(std::string_view source, bool check_number_of_arguments, AST_node AST) {
+    auto key = make_key(source, check_number_of_arguments);
+    auto program = std::make_shared<cached_program>(cached_program{std::string{source}, std::move(AST), std::nullopt});
+    std::lock_guard lock{mutex};
+    put_in_memory(key, program);
+    save_to_disk(key, *program);
+    return program;
+}
+
+void ProgramCache::store_compiled(std::string_view source, bool check_number_of_arguments, std::string secd_code) {
+    auto key = make_key(source, check_number_of_arguments);
+    std::lock_guard lock{mutex};
+    auto program = find_in_memory(key, source);
+    if(!program)
+        return;
+    auto updated = std::make_shared<cached_program>(*program);
+    updated->secd_code = std::move(secd_code);
+    put_in_memory(key, updated);
+    save_to_disk(key, *updated);
+}
+
+void ProgramCache::set_disk_directory(std::filesystem::path directory) {
+    std::lock_guard lock{mutex};
+    disk_directory = std::move(directory);
+    if(!disk_directory.empty()){
+        std::error_code ec;
+        std::filesystem::create_directories(disk_directory, ec);
+        if(ec)
+            disk_directory.clear(); // работаем только в памяти
+    }
+}
+
+void ProgramCache::clear() {
+    std::lock_guard lock{mutex};
+    lru.clear();
+    entries.clear();
+}
+
+ProgramCache::statistics ProgramCache::get_statistics() const {
+    std::lock_guard lock{mutex};
+    return stats;
+}
+
+std::shared_ptr<const cached_program> ProgramCache::find_in_memory(key_t key, std::string_view source) {
+    auto find = entries.find(key);
+    if(find == entries.end())
+        return nullptr;
+    auto&& found = find->second;
+    // hash collision - treat as miss
+    if(found.program->source != source)
+        return nullptr;
+    lru.splice(lru.begin(), lru, found.lru_position);
+    return found.program;
+}
+
+void ProgramCache::put_in_memory(key_t key, std::shared_ptr<const cached_program> program) {
+    auto find = entries.find(key);
+    if(find != entries.end()){
+        find->second.program = std::move(program);
+        lru.splice(lru.begin(), lru, find->second.lru_position);
+        return;
+    }
+    if(entries.size() >= capacity){
+        entries.erase(lru.back());
+        lru.pop_back();
+    }
+    lru.push_front(key);
+    entries.insert({key, entry{std::move(program), lru.begin()}});
+}
+
+std::filesystem::path ProgramCache::disk_path(key_t key) const {
+    return disk_directory / std::format("{:016x}.lkpc", key);
+}
+
+std::shared_ptr<const cached_program> ProgramCache::load_from_disk(key_t key, std::string_view source) const {
+    if(disk_directory.empty())
+        return nullptr;
+    std::ifstream in{disk_path(key), std::ios::binary};
+    if(!in)
+        return nullptr;
+    char magic[4];
+    std::uint32_t version;
+    if(!in.read(magic, 4) || !std::equal(magic, magic + 4, disk_magic))
+        return nullptr;
+    if(!read_raw(in, version) || version != disk_version)
+        return nullptr;
+    // битый файл - просто промах
+    try{
+        auto program = std::make_shared<cached_program>();
+        if(!read_string(in, program->source) || program->source != source)
+            return nullptr;
+        std::string AST_image;
+        if(!read_string(in, AST_image))
+            return nullptr;
+        program->AST = image::decode(AST_image);
+        char has_code;
+        if(!in.get(has_code))
+            return nullptr;
+        if(has_code){
+            std::string code;
+            if(!read_string(in, code))
+                return nullptr;
+            program->secd_code = std::move(code);
+        }
+        return program;
+    }
+    catch(const std::runtime_error&){
+        return nullptr;
+    }
+    catch(const std::length_error&){
+        return nullptr;
+    }
+    catch(const std::bad_alloc&){
+        return nullptr;
+    }
+}
+
+void ProgramCache::save_to_disk(key_t key, const cached_program& program) const {
+    if(disk_directory.empty())
+        return;
+    // пишем во временный файл и переименовываем, чтобы не оставить половину записи
+    auto path = disk_path(key);
+    auto temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream out{temp_path, std::ios::binary | std::ios::trunc};
+        if(!out)
+            return;
+        out.write(disk_magic, 4);
+        write_raw(out, disk_version);
+        write_string(out, program.source);
+        write_string(out, image::encode(program.AST));
+        out.put(program.secd_code ? 1 : 0);
+        if(program.secd_code)
+            write_string(out, *program.secd_code);
+        if(!out)
+            return;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if(ec)
+        std::filesystem::remove(temp_path, ec);
+}
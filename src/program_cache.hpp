@@ -0,0 +1,92 @@
+#ifndef LISPKIT_COMPILER_PROGRAM_CACHE_HPP
+#define LISPKIT_COMPILER_PROGRAM_CACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <filesystem>
+#include <unordered_map>
+
+#include "AST.hpp"
+
+namespace yy {
+
+/**
+ * Everything the front end and the compiler produce for one source text.
+ * secd_code is filled lazily, the first time the program is compiled,
+ * and only with the default compiler settings (strict, typed_secd and
+ * stack_frames); other settings compile without the cache.
+ * Entries are immutable once they are in the cache.
+ */
+struct cached_program {
+    std::string source;
+    AST_node AST;
+    std::optional<std::string> secd_code;
+};
+
+/**
+ * Content-addressed cache of parsed (and compiled) programs.
+ * The key is a hash of the source text together with the parse mode
+ * (argument count checking changes what the parser accepts).
+ *
+ * Two tiers: an in-memory LRU of `capacity` entries and an optional
+ * directory on disk. Disk entries are promoted to memory on hit.
+ */
+class ProgramCache {
+public:
+    using key_t = std::uint64_t;
+
+    explicit ProgramCache(std::size_t capacity = 64, std::filesystem::path disk_directory = {});
+
+    static key_t make_key(std::string_view source, bool check_number_of_arguments);
+
+    /**
+     * \returns cached entry or nullptr on miss
+     */
+    std::shared_ptr<const cached_program> find(std::string_view source, bool check_number_of_arguments);
+
+    std::shared_ptr<const cached_program> insert(std::string_view source, bool check_number_of_arguments, AST_node AST);
+
+    void store_compiled(std::string_view source, bool check_number_of_arguments, std::string secd_code);
+
+    // empty path turns the disk tier off
+    void set_disk_directory(std::filesystem::path directory);
+
+    void clear();
+
+    struct statistics {
+        std::size_t hits = 0;
+        std::size_t disk_hits = 0;
+        std::size_t misses = 0;
+    };
+    statistics get_statistics() const;
+
+private:
+    using lru_list_t = std::list<key_t>;
+    struct entry {
+        std::shared_ptr<const cached_program> program;
+        lru_list_t::iterator lru_position;
+    };
+
+    std::shared_ptr<const cached_program> find_in_memory(key_t key, std::string_view source);
+    void put_in_memory(key_t key, std::shared_ptr<const cached_program> program);
+
+    std::filesystem::path disk_path(key_t key) const;
+    std::shared_ptr<const cached_program> load_from_disk(key_t key, std::string_view source) const;
+    void save_to_disk(key_t key, const cached_program& program) const;
+
+    mutable std::mutex mutex;
+    std::size_t capacity;
+    std::filesystem::path disk_directory;
+    lru_list_t lru;
+    std::unordered_map<key_t, entry> entries;
+    statistics stats;
+};
+
+}
+
+#endif //LISPKIT_COMPILER_PROGRAM_CACHE_HPP
@@ -0,0 +1,630 @@
+#include "register_vm.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include "arithmetic.hpp"
+#include "interpreter.hpp"
+
+using namespace yy;
+
+namespace {
+    using opcode = register_instruction::opcode;
+    constexpr auto constant_operand = register_instruction::constant_operand;
+
+    const char* mnemonic(opcode op) {
+        switch(op){
+            case opcode::move: return "MOVE";
+            case opcode::add: return "ADD";
+            case opcode::subtract: return "SUB";
+            case opcode::multiply: return "MUL";
+            case opcode::divide: return "DIVE";
+            case opcode::remainder: return "REM";
+            case opcode::less_equal: return "LEQ";
+            case opcode::equal: return "EQ";
+            case opcode::atom: return "ATOM";
+            case opcode::car: return "CAR";
+            case opcode::cdr: return "CDR";
+            case opcode::cons: return "CONS";
+            case opcode::jump: return "JUMP";
+            case opcode::jump_unless: return "JUMP_UNLESS";
+            case opcode::jump_unless_less_equal: return "JUMP_UNLESS_LEQ";
+            case opcode::jump_unless_equal: return "JUMP_UNLESS_EQ";
+            case opcode::closure: return "CLOSURE";
+            case opcode::call: return "CALL";
+            case opcode::ret: return "RET";
+        }
+        return "?";
+    }
+
+    std::string operand_name(std::uint32_t operand) {
+        if(operand & constant_operand)
+            return std::format("k{}", operand & ~constant_operand);
+        return std::format("r{}", operand);
+    }
+
+    bool is_binary(const std::string& command) {
+        return command == "ADD" || command == "SUB" || command == "MUL" || command == "DIVE" || command == "REM" ||
+               command == "EQUAL" || command == "LEQ" || command == "CONS";
+    }
+
+    bool is_form(const std::string& command) {
+        return is_binary(command) || command == "QUOTE" || command == "ATOM" || command == "CAR" || command == "CDR" ||
+               command == "COND" || command == "LAMBDA" || command == "LET";
+    }
+
+    /**
+     * Names used in current and not bound inside it, in the order of the
+     * first use. bound is the stack of names bound on the way down.
+     */
+    void free_variables(const AST_node& current, std::vector<std::string>& bound, std::vector<std::string>& result) {
+        if(current.is_string()){
+            auto&& name = current.to_string();
+            if(std::find(bound.rbegin(), bound.rend(), name) == bound.rend() &&
+               std::find(result.begin(), result.end(), name) == result.end())
+                result.push_back(name);
+            return;
+        }
+        if(!current.is_list() || current.to_list().empty())
+            return;
+        auto&& list = current.to_list();
+        auto&& head = list.front();
+        if(!head.is_string() || !is_form(head.to_string())){
+            for(auto&& item : list)
+                free_variables(item, bound, result);
+            return;
+        }
+        auto&& command = head.to_string();
+        if(command == "QUOTE")
+            return;
+        auto bound_size = bound.size();
+        if(command == "LAMBDA" && list.size() == 3){
+            auto&& parameters = *std::next(list.begin());
+            if(parameters.is_list())
+                for(auto&& parameter : parameters.to_list())
+                    if(parameter.is_string())
+                        bound.push_back(parameter.to_string());
+            free_variables(list.back(), bound, result);
+        }
+        else if(command == "LET" && list.size() >= 2){
+            for(auto it = std::next(list.begin(), 2); it != list.end(); ++it)
+                if(it->is_list() && !it->to_list().empty())
+                    free_variables(it->to_list().back(), bound, result);
+            for(auto it = std::next(list.begin(), 2); it != list.end(); ++it)
+                if(it->is_list() && !it->to_list().empty() && it->to_list().front().is_string())
+                    bound.push_back(it->to_list().front().to_string());
+            free_variables(*std::next(list.begin()), bound, result);
+        }
+        else{
+            for(auto it = std::next(list.begin()); it != list.end(); ++it)
+                free_variables(*it, bound, result);
+        }
+        bound.resize(bound_size);
+    }
+
+    // EQ of the SECD machine
+    bool equal_values(const AST_node& left, const AST_node& right, bool& both_lists) {
+        both_lists = left.is_list() && right.is_list();
+        if(both_lists)
+            return false;
+        if(left.is_number() && right.is_number())
+            return arithmetic::equal(left, right);
+        if(left.value.index() != right.value.index())
+            return false;
+        return left.to_string() == right.to_string();
+    }
+}
+
+void register_program::disassemble(std::ostream &out) const {
+    for(std::size_t i = 0; i < constants.size(); i++)
+        out << 'k' << i << " = " << constants[i].print_tree(3) << '\n';
+    for(std::size_t i = 0; i < functions.size(); i++){
+        auto&& function = functions[i];
+        out << "function " << i << ": " << function.arity << " arguments, " << function.captures << " captured, "
+            << function.registers << " registers\n";
+        for(std::size_t pc = 0; pc < function.code.size(); pc++){
+            auto&& instruction = function.code[pc];
+            out << std::format("{:5}  {:<16}", pc, mnemonic(instruction.op));
+            switch(instruction.op){
+                case opcode::jump:
+                    out << instruction.a;
+                    break;
+                case opcode::jump_unless:
+                    out << instruction.a << ' ' << operand_name(instruction.b);
+                    break;
+                case opcode::jump_unless_less_equal:
+                case opcode::jump_unless_equal:
+                    out << instruction.a << ' ' << operand_name(instruction.b) << ' ' << operand_name(instruction.c);
+                    break;
+                case opcode::closure:{
+                    out << operand_name(instruction.a) << " f" << instruction.b;
+                    for(auto captured : functions[instruction.b].capture_operands)
+                        out << ' ' << operand_name(captured);
+                    break;
+                }
+                case opcode::call:
+                    out << operand_name(instruction.a) << ' ' << operand_name(instruction.b);
+                    for(std::uint32_t k = 0; k < instruction.d; k++)
+                        out << ' ' << operand_name(instruction.c + k);
+                    break;
+                case opcode::ret:
+                    out << operand_name(instruction.a);
+                    break;
+                case opcode::move:
+                case opcode::atom:
+                case opcode::car:
+                case opcode::cdr:
+                    out << operand_name(instruction.a) << ' ' << operand_name(instruction.b);
+                    break;
+                default:
+                    out << operand_name(instruction.a) << ' ' << operand_name(instruction.b) << ' '
+                        << operand_name(instruction.c);
+            }
+            out << '\n';
+        }
+    }
+}
+
+RegisterCompiler::RegisterCompiler(std::string file_name) :
+        file_name(std::move(file_name))
+{}
+
+register_program RegisterCompiler::compile(const AST_node &source) {
+    program = {};
+    active.clear();
+    program.functions.emplace_back();
+    active.push_back({});
+    auto result = expression(source, nullptr);
+    emit(source, opcode::ret, result);
+    active.clear();
+    return std::move(program);
+}
+
+std::uint32_t RegisterCompiler::expression(const AST_node &current, const std::uint32_t *destination) {
+    if(current.is_number())
+        throw make_execution_error(file_name, "compilation", current, "cant resolve ID");
+    if(current.is_string())
+        return variable(current);
+
+    auto&& current_list = current.to_list();
+    if(current_list.empty() || !current_list.front().is_string())
+        throw make_execution_error(file_name, "compilation", current, "command name must be string");
+    auto&& command = current_list.front().to_string();
+    //active растет при компиляции LAMBDA, ссылки на active.back() не держим
+    auto mark = active.back().next_register;
+
+    if(command == "QUOTE"){
+        return constant(current_list.back());
+    }
+    else if(is_binary(command)){
+        auto iterator = current_list.begin(); ++iterator;
+        auto&& left_node = *iterator; ++iterator;
+        auto&& right_node = *iterator;
+        auto result = target(destination);
+        auto keep = active.back().next_register;
+        //порядок вычисления - как в коде SECD, первый операнд можно считать сразу в результат
+        if(command == "CONS"){
+            auto tail = expression(right_node, &result);
+            auto head = expression(left_node, nullptr);
+            emit(current, opcode::cons, result, head, tail);
+        }
+        else{
+            auto left = expression(left_node, &result);
+            auto right = expression(right_node, nullptr);
+            static const std::unordered_map<std::string, opcode> operations = {
+                    {"ADD", opcode::add}, {"SUB", opcode::subtract}, {"MUL", opcode::multiply},
+                    {"DIVE", opcode::divide}, {"REM", opcode::remainder}, {"EQUAL", opcode::equal},
+                    {"LEQ", opcode::less_equal}
+            };
+            emit(current, operations.at(command), result, left, right);
+        }
+        release(keep);
+        return result;
+    }
+    else if(command == "ATOM" ||
+            command == "CAR" ||
+            command == "CDR"
+    ){
+        auto result = target(destination);
+        auto keep = active.back().next_register;
+        auto argument = expression(current_list.back(), &result);
+        auto op = command == "ATOM" ? opcode::atom : (command == "CAR" ? opcode::car : opcode::cdr);
+        emit(current, op, result, argument);
+        release(keep);
+        return result;
+    }
+    else if(command == "COND"){
+        auto iterator = current_list.begin(); ++iterator;
+        auto&& condition_node = *iterator; ++iterator;
+        auto&& true_branch = *iterator; ++iterator;
+        auto&& false_branch = *iterator;
+        auto result = target(destination);
+        auto keep = active.back().next_register;
+        auto skip_true = condition(condition_node);
+        move(result, expression(true_branch, &result), true_branch);
+        release(keep);
+        auto skip_false = emit(current, opcode::jump);
+        current_function().code[skip_true].a = static_cast<std::uint32_t>(current_function().code.size());
+        move(result, expression(false_branch, &result), false_branch);
+        release(keep);
+        current_function().code[skip_false].a = static_cast<std::uint32_t>(current_function().code.size());
+        return result;
+    }
+    else if(command == "LAMBDA"){
+        return lambda(current, destination);
+    }
+    else if(command == "LET"){
+        //(LET (ADD X Y) (X (QUOTE 5)) (Y (QUOTE 4)))
+        auto result = target(destination);
+        auto keep = active.back().next_register;
+        scope bindings;
+        auto&& names = bindings.names.to_list();
+        auto arguments_end = current_list.rend(); arguments_end--; arguments_end--;
+        for(auto arg_iterator = current_list.rbegin();
+            arg_iterator != arguments_end;
+            ++arg_iterator
+        ){
+            auto&& pair_list = arg_iterator->to_list();
+            auto value_register = allocate();
+            auto value = expression(pair_list.back(), &value_register);
+            //переменная или константа - LET только дает ей второе имя
+            release(value == value_register ? value_register + 1 : value_register);
+            names.push_front(pair_list.front());
+            bindings.operands.insert(bindings.operands.begin(), value);
+        }
+        active.back().scopes.push_back(std::move(bindings));
+        auto function_node = current_list.begin(); ++function_node;
+        auto body = expression(*function_node, &result);
+        active.back().scopes.pop_back();
+        if(body != result && !(body & constant_operand) && body >= keep){
+            //значение в регистре LET, который сейчас освободится
+            move(result, body, *function_node);
+            body = result;
+        }
+        release(body == result ? keep : mark);
+        return body;
+    }
+    else{ //вызов функции
+        auto result = target(destination);
+        auto keep = active.back().next_register;
+        auto count = static_cast<std::uint32_t>(current_list.size() - 1);
+        auto first = allocate(count);
+        //аргументы с конца, последней - сама функция
+        auto argument_register = first + count;
+        for(auto it = current_list.rbegin(); it != std::prev(current_list.rend()); ++it){
+            --argument_register;
+            move(argument_register, expression(*it, &argument_register), *it);
+            release(first + count);
+        }
+        auto function = expression(current_list.front(), nullptr);
+        emit(current, opcode::call, result, function, first, count);
+        release(keep);
+        return result;
+    }
+}
+
+std::uint32_t RegisterCompiler::variable(const AST_node &current) {
+    std::uint32_t operand;
+    if(!lookup(current.to_string(), operand))
+        throw make_execution_error(file_name, "ID", current, std::format("using undeclared symbol {}", current.to_string()));
+    return operand;
+}
+
+bool RegisterCompiler::lookup(const std::string &name, std::uint32_t &operand) const {
+    auto&& scopes = active.back().scopes;
+    for(auto it = scopes.rbegin(); it != scopes.rend(); ++it){
+        auto&& names = it->names.to_list();
+        auto found = std::find_if(names.begin(), names.end(), [&name](const AST_node& symbol){
+            return symbol.is_string() && symbol.to_string() == name;
+        });
+        if(found != names.end()){
+            operand = it->operands[std::distance(names.begin(), found)];
+            return true;
+        }
+    }
+    return false;
+}
+
+std::uint32_t RegisterCompiler::constant(const AST_node &quoted) {
+    program.constants.push_back(quoted);
+    return static_cast<std::uint32_t>(program.constants.size() - 1) | constant_operand;
+}
+
+std::uint32_t RegisterCompiler::lambda(const AST_node &current, const std::uint32_t *destination) {
+    auto iterator = current.to_list().begin(); ++iterator;
+    auto&& lambda_arguments = *iterator; ++iterator;
+    auto&& lambda_body = *iterator;
+    if(!lambda_arguments.is_list())
+        throw make_execution_error(file_name, "compilation", current, "bad env");
+
+    std::vector<std::string> bound;
+    for(auto&& argument : lambda_arguments.to_list())
+        if(argument.is_string())
+            bound.push_back(argument.to_string());
+    std::vector<std::string> free;
+    free_variables(lambda_body, bound, free);
+
+    //константы подставляются в тело, переменные копируются в замыкание
+    scope outer;
+    std::vector<std::uint32_t> captured;
+    for(auto&& name : free){
+        std::uint32_t operand;
+        if(!lookup(name, operand))
+            continue; // ошибку сообщит компиляция тела
+        outer.names.to_list().push_back(AST_node{name});
+        if(operand & constant_operand)
+            outer.operands.push_back(operand);
+        else{
+            outer.operands.push_back(0);
+            captured.push_back(operand);
+        }
+    }
+    auto arity = static_cast<std::uint32_t>(lambda_arguments.to_list().size());
+    auto index = program.functions.size();
+    auto&& created = program.functions.emplace_back();
+    created.arity = arity;
+    created.captures = static_cast<std::uint32_t>(captured.size());
+    created.registers = arity + created.captures;
+    created.capture_operands = std::move(captured);
+    std::uint32_t capture_register = arity;
+    for(auto&& operand : outer.operands)
+        if(!(operand & constant_operand))
+            operand = capture_register++;
+
+    scope parameters{lambda_arguments, {}};
+    for(std::uint32_t i = 0; i < arity; i++)
+        parameters.operands.push_back(i);
+    active.push_back({index, program.functions[index].registers, {}});
+    active.back().scopes.push_back(std::move(outer));
+    active.back().scopes.push_back(std::move(parameters));
+    auto body = expression(lambda_body, nullptr);
+    emit(lambda_body, opcode::ret, body);
+    active.pop_back();
+
+    auto result = target(destination);
+    emit(current, opcode::closure, result, static_cast<std::uint32_t>(index));
+    return result;
+}
+
+std::size_t RegisterCompiler::condition(const AST_node &current) {
+    auto mark = active.back().next_register;
+    std::size_t jump;
+    auto comparison = [](const AST_node& node){
+        if(!node.is_list() || node.to_list().size() != 3 || !node.to_list().front().is_string())
+            return false;
+        auto&& command = node.to_list().front().to_string();
+        return command == "LEQ" || command == "EQUAL";
+    };
+    if(comparison(current)){
+        //сравнение сразу в условный переход, без TRUE/FALSE в регистре
+        auto&& list = current.to_list();
+        auto left = expression(*std::next(list.begin()), nullptr);
+        auto right = expression(list.back(), nullptr);
+        auto op = list.front().to_string() == "LEQ" ? opcode::jump_unless_less_equal : opcode::jump_unless_equal;
+        jump = emit(current, op, 0, left, right);
+    }
+    else
+        jump = emit(current, opcode::jump_unless, 0, expression(current, nullptr));
+    release(mark);
+    return jump;
+}
+
+std::uint32_t RegisterCompiler::target(const std::uint32_t *destination) {
+    return destination ? *destination : allocate();
+}
+
+void RegisterCompiler::move(std::uint32_t destination, std::uint32_t operand, const AST_node &source) {
+    if(operand != destination)
+        emit(source, opcode::move, destination, operand);
+}
+
+std::size_t RegisterCompiler::emit(const AST_node &source, register_instruction::opcode op, std::uint32_t a,
+                                   std::uint32_t b, std::uint32_t c, std::uint32_t d) {
+    auto&& function = current_function();
+    function.code.push_back({op, a, b, c, d});
+    function.sources.push_back(source);
+    return function.code.size() - 1;
+}
+
+std::uint32_t RegisterCompiler::allocate(std::uint32_t count) {
+    auto&& state = active.back();
+    auto first = state.next_register;
+    state.next_register += count;
+    auto&& function = current_function();
+    function.registers = std::max(function.registers, state.next_register);
+    return first;
+}
+
+void RegisterCompiler::release(std::uint32_t first) {
+    active.back().next_register = first;
+}
+
+register_function &RegisterCompiler::current_function() {
+    return program.functions[active.back().index];
+}
+
+RegisterVM::RegisterVM(std::string file_name) :
+        file_name(std::move(file_name))
+{}
+
+void RegisterVM::fail(const register_function &function, std::size_t pc, const std::string &command,
+                      const std::string &description) const {
+    throw make_execution_error(file_name, command, function.sources[pc], description);
+}
+
+AST_node RegisterVM::run(const register_program &program, LimitGuard *guard) {
+    auto&& constants = program.constants;
+    const auto* function = &program.functions.front();
+    std::size_t pc = 0;
+    std::size_t base = 0;
+    std::vector<AST_node> registers(std::max<std::size_t>(function->registers, 64));
+    std::vector<call_frame> calls;
+    auto* r = registers.data();
+    auto value = [&](std::uint32_t operand) -> const AST_node& {
+        return operand & constant_operand ? constants[operand & ~constant_operand] : r[operand];
+    };
+    auto numbers = [&](const register_instruction& instruction) {
+        if(!value(instruction.b).is_number() || !value(instruction.c).is_number())
+            fail(*function, pc - 1, mnemonic(instruction.op), "arguments should be numbers");
+    };
+
+    while(true){
+        auto&& instruction = function->code[pc++];
+        if(guard && !guard->step(calls.size()))
+            fail(*function, pc - 1, mnemonic(instruction.op), guard->reason());
+        switch(instruction.op){
+            case opcode::move:
+                r[instruction.a] = value(instruction.b);
+                break;
+            case opcode::add:
+                numbers(instruction);
+                r[instruction.a] = arithmetic::add(value(instruction.b), value(instruction.c));
+                break;
+            case opcode::subtract:
+                numbers(instruction);
+                r[instruction.a] = arithmetic::subtract(value(instruction.b), value(instruction.c));
+                break;
+            case opcode::multiply:
+                numbers(instruction);
+                r[instruction.a] = arithmetic::multiply(value(instruction.b), value(instruction.c));
+                break;
+            case opcode::divide:
+            case opcode::remainder:
+                numbers(instruction);
+                if(arithmetic::is_zero(value(instruction.c)))
+                    fail(*function, pc - 1, mnemonic(instruction.op), "division by zero");
+                r[instruction.a] = instruction.op == opcode::divide ?
+                                   arithmetic::divide(value(instruction.b), value(instruction.c)) :
+                                   arithmetic::remainder(value(instruction.b), value(instruction.c));
+                break;
+            case opcode::less_equal:
+                numbers(instruction);
+                r[instruction.a] = arithmetic::less_equal(value(instruction.b), value(instruction.c)) ?
+                                   AST_node::TRUE() : AST_node::FALSE();
+                break;
+            case opcode::equal:
+            case opcode::jump_unless_equal:{
+                bool both_lists;
+                bool equal = equal_values(value(instruction.b), value(instruction.c), both_lists);
+                if(both_lists)
+                    fail(*function, pc - 1, mnemonic(instruction.op), "both arguments cant be lists");
+                if(instruction.op == opcode::equal)
+                    r[instruction.a] = equal ? AST_node::TRUE() : AST_node::FALSE();
+                else if(!equal)
+                    pc = instruction.a;
+                break;
+            }
+            case opcode::atom:
+                r[instruction.a] = value(instruction.b).is_list() ? AST_node::FALSE() : AST_node::TRUE();
+                break;
+            case opcode::car:{
+                auto&& list = value(instruction.b);
+                if(!list.is_list())
+                    fail(*function, pc - 1, "CAR", "CAR argument must be list");
+                auto head = list.to_list().empty() ? AST_node{} : list.to_list().front();
+                r[instruction.a] = std::move(head);
+                break;
+            }
+            case opcode::cdr:{
+                if(!value(instruction.b).is_list())
+                    fail(*function, pc - 1, "CDR", "CDR argument must be list");
+                if(instruction.a != instruction.b)
+                    r[instruction.a] = value(instruction.b);
+                //хранилище копируется, только если оно общее
+                if(!std::as_const(r[instruction.a]).to_list().empty())
+                    r[instruction.a].to_list().pop_front();
+                break;
+            }
+            case opcode::cons:{
+                if(!value(instruction.c).is_list())
+                    fail(*function, pc - 1, "CONS", "SECD CONS second argument must be list");
+                auto head = value(instruction.b);
+                if(instruction.a != instruction.c)
+                    r[instruction.a] = value(instruction.c);
+                r[instruction.a].to_list().push_front(std::move(head));
+                break;
+            }
+            case opcode::jump:
+                pc = instruction.a;
+                break;
+            case opcode::jump_unless:{
+                auto&& condition = value(instruction.b);
+                if(!condition.is_string())
+                    fail(*function, pc - 1, "SEL", "condition must be boolean");
+                if(condition.to_string() == "FALSE")
+                    pc = instruction.a;
+                else if(condition.to_string() != "TRUE")
+                    fail(*function, pc - 1, "SEL", "condition must be boolean");
+                break;
+            }
+            case opcode::jump_unless_less_equal:
+                numbers(instruction);
+                if(!arithmetic::less_equal(value(instruction.b), value(instruction.c)))
+                    pc = instruction.a;
+                break;
+            case opcode::closure:{
+                auto&& created = program.functions[instruction.b];
+                AST_node closure{};
+                auto&& items = closure.to_list();
+                items.emplace_back(static_cast<AST_node::num_t>(instruction.b));
+                for(auto operand : created.capture_operands)
+                    items.push_back(value(operand));
+                r[instruction.a] = std::move(closure);
+                break;
+            }
+            case opcode::call:{
+                const auto closure = value(instruction.b);
+                if(!closure.is_list())
+                    fail(*function, pc - 1, "AP", "closure must be list");
+                auto&& items = closure.to_list();
+                if(items.empty() || !items.front().is_num() || items.front().to_num() <= 0 ||
+                   static_cast<std::size_t>(items.front().to_num()) >= program.functions.size())
+                    fail(*function, pc - 1, "AP", "list is not a closure");
+                auto&& callee = program.functions[items.front().to_num()];
+                if(items.size() != callee.captures + 1)
+                    fail(*function, pc - 1, "AP", "list is not a closure");
+                if(instruction.d != callee.arity)
+                    fail(*function, pc - 1, "AP", std::format("function of {} arguments applied to {}", callee.arity,
+                                                              instruction.d));
+                auto callee_base = base + function->registers;
+                if(registers.size() < callee_base + callee.registers){
+                    registers.resize(std::max(callee_base + callee.registers, registers.size() * 2));
+                    r = registers.data() + base;
+                }
+                auto* frame = registers.data() + callee_base;
+                //регистры аргументов вызывающему больше не нужны
+                for(std::uint32_t k = 0; k < instruction.d; k++)
+                    frame[k] = std::move(r[instruction.c + k]);
+                auto captured = frame + callee.arity;
+                for(auto it = std::next(items.begin()); it != items.end(); ++it)
+                    *captured++ = *it;
+                calls.push_back({function, pc, base, instruction.a});
+                function = &callee;
+                pc = 0;
+                base = callee_base;
+                r = frame;
+                break;
+            }
+            case opcode::ret:{
+                AST_node result;
+                if(instruction.a & constant_operand)
+                    result = value(instruction.a);
+                else
+                    result = std::move(r[instruction.a]);
+                if(calls.empty())
+                    return result;
+                auto&& caller = calls.back();
+                function = caller.function;
+                pc = caller.pc;
+                base = caller.base;
+                r = registers.data() + base;
+                r[caller.result] = std::move(result);
+                calls.pop_back();
+                break;
+            }
+        }
+    }
+}
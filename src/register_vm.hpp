@@ -0,0 +1,154 @@
+#ifndef LISPKIT_COMPILER_REGISTER_VM_HPP
+#define LISPKIT_COMPILER_REGISTER_VM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "AST.hpp"
+#include "resource_limits.hpp"
+
+namespace yy {
+
+/**
+ * Register machine, an alternative to the SECD machine of execute_secd.
+ *
+ * Instructions are three-address: r[a] = op(b, c). An operand is a
+ * register of the current frame or, with constant_operand set, an index
+ * in the constant pool, so (SUB N (QUOTE 1)) is one instruction instead
+ * of LD, LDC, SUB. Every call gets a register file of
+ * register_function::registers values:
+ *
+ *     [arguments][captured variables][temporaries]
+ *
+ * Closures are flat: a LAMBDA copies the values of its free variables
+ * into the closure, a call copies them into the capture registers. A
+ * closure is the list (function captured...), a list like any other for
+ * ATOM and EQ, as closures are in the SECD machine.
+ */
+struct register_instruction {
+    enum class opcode : std::uint8_t {
+        move,                   // r[a] = b
+        add, subtract, multiply, divide, remainder,
+        less_equal, equal,      // r[a] = b op c
+        atom, car, cdr,         // r[a] = op b
+        cons,                   // r[a] = (b . c), in place when c is a
+        jump,                   // to a
+        jump_unless,            // to a unless b is TRUE
+        jump_unless_less_equal, // to a unless b <= c
+        jump_unless_equal,      // to a unless b = c
+        closure,                // r[a] = closure of function b
+        call,                   // r[a] = b(r[c], ... r[c + d - 1])
+        ret                     // return a
+    };
+
+    static constexpr std::uint32_t constant_operand = 1u << 31;
+
+    opcode op;
+    std::uint32_t a = 0;
+    std::uint32_t b = 0;
+    std::uint32_t c = 0;
+    std::uint32_t d = 0;
+};
+
+struct register_function {
+    std::uint32_t arity = 0;
+    std::uint32_t captures = 0;
+    std::uint32_t registers = 0;        // весь кадр: аргументы, захваченные, временные
+    std::vector<register_instruction> code;
+    std::vector<AST_node> sources;      // форма каждой инструкции, для сообщений об ошибках
+    // operands of the creating function copied by its closure instruction
+    std::vector<std::uint32_t> capture_operands;
+};
+
+// function 0 is the program itself
+struct register_program {
+    std::vector<register_function> functions;
+    std::vector<AST_node> constants;
+
+    // readable listing, one instruction per line
+    void disassemble(std::ostream& out) const;
+};
+
+/**
+ * Compiles the AST the way Interpreter::compile does (the same forms,
+ * variable resolution and order of evaluation) to a register_program.
+ *
+ * Registers are allocated like a stack: a form takes the registers it
+ * needs above the ones in use and gives them back when its value has been
+ * consumed. Variables and constants are operands themselves and are never
+ * copied, LET is compiled inline - its variables are registers or
+ * constants of the enclosing function, not a closure call as in SECD.
+ */
+class RegisterCompiler {
+public:
+    explicit RegisterCompiler(std::string file_name = "input");
+
+    // throws std::runtime_error on the programs Interpreter::compile rejects
+    register_program compile(const AST_node& program);
+
+private:
+    struct scope {
+        AST_node names;
+        std::vector<std::uint32_t> operands;
+    };
+
+    struct function_state {
+        std::size_t index = 0;
+        std::uint32_t next_register = 0;
+        std::vector<scope> scopes;      // последний - самый внутренний
+    };
+
+    // operand with the value of current, written to destination if it is not a variable or a constant
+    std::uint32_t expression(const AST_node& current, const std::uint32_t* destination);
+    std::uint32_t variable(const AST_node& current);
+    bool lookup(const std::string& name, std::uint32_t& operand) const;
+    std::uint32_t constant(const AST_node& quoted);
+    std::uint32_t lambda(const AST_node& current, const std::uint32_t* destination);
+    // conditional jump over the true branch, its target is patched by the caller
+    std::size_t condition(const AST_node& current);
+    std::uint32_t target(const std::uint32_t* destination);
+    void move(std::uint32_t destination, std::uint32_t operand, const AST_node& source);
+    std::size_t emit(const AST_node& source, register_instruction::opcode op, std::uint32_t a = 0, std::uint32_t b = 0,
+                     std::uint32_t c = 0, std::uint32_t d = 0);
+    std::uint32_t allocate(std::uint32_t count = 1);
+    void release(std::uint32_t first);
+    register_function& current_function();
+
+    std::string file_name;
+    register_program program;
+    std::vector<function_state> active;     // вложенность функций, последняя - текущая
+};
+
+/**
+ * Runs a register_program without recursion on the native stack: the
+ * register files of all calls live in one vector, the calls in another.
+ * Errors have the messages of the SECD machine and the location of the
+ * failing form.
+ */
+class RegisterVM {
+public:
+    explicit RegisterVM(std::string file_name = "input");
+
+    // guard may be null, a step is one instruction, the depth is the number of calls
+    AST_node run(const register_program& program, LimitGuard* guard);
+
+private:
+    struct call_frame {
+        const register_function* function;
+        std::size_t pc;
+        std::size_t base;
+        std::uint32_t result;
+    };
+
+    [[noreturn]] void fail(const register_function& function, std::size_t pc, const std::string& command,
+                           const std::string& description) const;
+
+    std::string file_name;
+};
+
+}
+
+#endif //LISPKIT_COMPILER_REGISTER_VM_HPP
@@ -0,0 +1,80 @@
+#include "resource_limits.hpp"
+
+#include <algorithm>
+#include <format>
+
+#include "alloc_stats.hpp"
+
+using namespace yy;
+
+bool resource_limits::any() const {
+    return max_steps != 0 || max_heap_bytes != 0 || max_depth != 0 || max_stack_bytes != 0 || timeout.count() != 0 || cancel != nullptr;
+}
+
+LimitGuard::LimitGuard(const resource_limits& limits) :
+        limits(limits)
+{
+    if(limits.max_depth != 0)
+        max_depth = limits.max_depth;
+    if(limits.max_stack_bytes != 0)
+        max_stack_bytes = limits.max_stack_bytes;
+    //граница стека - кадр того, кто запускает программу
+    char probe;
+    stack_base = reinterpret_cast<std::uintptr_t>(&probe);
+    next_check = check_interval;
+    if(limits.max_steps != 0)
+        next_check = std::min(next_check, limits.max_steps + 1);
+    if(limits.timeout.count() != 0)
+        deadline = clock_type::now() + limits.timeout;
+    if(limits.max_heap_bytes != 0)
+        heap_baseline = alloc_stats::current().live_bytes;
+}
+
+bool LimitGuard::check() {
+    if(limits.max_steps != 0 && steps > limits.max_steps){
+        exceeded = std::format("resource limit exceeded: more than {} steps", limits.max_steps);
+        return false;
+    }
+    if(limits.cancel != nullptr && limits.cancel->load(std::memory_order_relaxed)){
+        exceeded = "execution cancelled";
+        return false;
+    }
+    if(limits.timeout.count() != 0 && clock_type::now() > deadline){
+        exceeded = std::format("resource limit exceeded: running longer than {} ms", limits.timeout.count());
+        return false;
+    }
+    if(limits.max_heap_bytes != 0){
+        auto grown = alloc_stats::current().live_bytes - heap_baseline;
+        if(grown > 0 && static_cast<std::uint64_t>(grown) > limits.max_heap_bytes){
+            exceeded = std::format("resource limit exceeded: heap grew by {} bytes, limit is {}", grown, limits.max_heap_bytes);
+            return false;
+        }
+    }
+    //после превышения следующий step() снова попадет сюда
+    next_check = steps + check_interval;
+    if(limits.max_steps != 0)
+        next_check = std::min(next_check, limits.max_steps + 1);
+    return true;
+}
+
+bool LimitGuard::depth_exceeded(std::size_t depth) {
+    exceeded = std::format("resource limit exceeded: depth {} is over the limit of {}", depth, max_depth);
+    return false;
+}
+
+bool LimitGuard::stack_exceeded(std::size_t used) {
+    exceeded = std::format("resource limit exceeded: {} bytes of native stack used, limit is {}", used, max_stack_bytes);
+    return false;
+}
+
+std::uint64_t LimitGuard::get_steps() const {
+    return steps;
+}
+
+std::size_t LimitGuard::get_depth() const {
+    return depth;
+}
+
+const std::string& LimitGuard::reason() const {
+    return exceeded;
+}
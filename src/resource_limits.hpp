@@ -0,0 +1,121 @@
+#ifndef LISPKIT_COMPILER_RESOURCE_LIMITS_HPP
+#define LISPKIT_COMPILER_RESOURCE_LIMITS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+namespace yy {
+
+/**
+ * Limits of one execute(), execute_secd() or execute_register() run,
+ * zero means unlimited.
+ *
+ * A step is one execute() call of the tree-walker or one SECD or
+ * register machine instruction. The depth is the nesting of execute()
+ * calls, the longer of the SECD stack and dump or the number of register
+ * machine calls. The tree-walker recurses on the native stack, the frame
+ * size depends on the build, so max_stack_bytes limits the native stack
+ * used by the run as well: a clean error instead of a crash. The heap
+ * limit applies to the growth of live heap bytes of the running thread
+ * since the start of the run (alloc_stats.hpp).
+ *
+ * cancel is set by another thread to stop the run, it is polled together
+ * with the clock.
+ */
+struct resource_limits {
+    std::uint64_t max_steps = 0;
+    std::uint64_t max_heap_bytes = 0;
+    std::size_t max_depth = 0;
+    std::size_t max_stack_bytes = 0;
+    std::chrono::milliseconds timeout{0};
+    const std::atomic<bool>* cancel = nullptr;
+
+    bool any() const;
+};
+
+/**
+ * Checks resource_limits during one run. step() is called from the
+ * dispatch loops: it compares the depth and counts the step, the clock
+ * and the heap counters are read only every check_interval steps.
+ */
+class LimitGuard {
+public:
+    static constexpr std::uint64_t check_interval = 1024;
+
+    explicit LimitGuard(const resource_limits& limits);
+
+    // false once a limit is exceeded, reason() tells which one
+    inline bool step(std::size_t depth) {
+        if(depth > max_depth)
+            return depth_exceeded(depth);
+        if(++steps < next_check)
+            return true;
+        return check();
+    }
+
+    // step of the tree-walker, also checks its nesting and native stack
+    inline bool nested_step() {
+        char probe;
+        auto here = reinterpret_cast<std::uintptr_t>(&probe);
+        auto used = here < stack_base ? stack_base - here : here - stack_base;
+        if(used > max_stack_bytes)
+            return stack_exceeded(used);
+        return step(depth);
+    }
+
+    // count steps done outside the dispatch loops (native code), same checks as step()
+    inline bool charge(std::uint64_t count) {
+        steps += count;
+        if(steps < next_check)
+            return true;
+        return check();
+    }
+
+    std::uint64_t get_steps() const;
+    std::size_t get_depth() const;
+    const std::string& reason() const;
+
+    // nesting of the tree-walker, also left when an error unwinds the call
+    class nesting {
+    public:
+        explicit nesting(LimitGuard* guard) :
+                guard(guard)
+        {
+            if(guard)
+                guard->depth++;
+        }
+        ~nesting() {
+            if(guard)
+                guard->depth--;
+        }
+        nesting(const nesting&) = delete;
+        nesting& operator=(const nesting&) = delete;
+    private:
+        LimitGuard* guard;
+    };
+
+private:
+    using clock_type = std::chrono::steady_clock;
+
+    bool check();
+    bool depth_exceeded(std::size_t depth);
+    bool stack_exceeded(std::size_t used);
+
+    resource_limits limits;
+    std::size_t max_depth = std::numeric_limits<std::size_t>::max();
+    std::size_t max_stack_bytes = std::numeric_limits<std::size_t>::max();
+    std::uintptr_t stack_base = 0;
+    std::uint64_t steps = 0;
+    std::uint64_t next_check = 0;
+    std::size_t depth = 0;
+    clock_type::time_point deadline;
+    std::int64_t heap_baseline = 0;
+    std::string exceeded;
+};
+
+}
+
+#endif //LISPKIT_COMPILER_RESOURCE_LIMITS_HPP
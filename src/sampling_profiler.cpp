@@ -0,0 +1,86 @@
+#include "sampling_profiler.hpp"
+
+#include <algorithm>
+#include <format>
+
+using namespace yy;
+
+SamplingProfiler::SamplingProfiler(std::chrono::microseconds interval) :
+        interval(std::max(interval, std::chrono::microseconds{1}))
+{}
+
+SamplingProfiler::~SamplingProfiler() {
+    stop();
+}
+
+void SamplingProfiler::set_interval(std::chrono::microseconds new_interval) {
+    interval = std::max(new_interval, std::chrono::microseconds{1});
+}
+
+void SamplingProfiler::start(const std::string &file_name) {
+    stop();
+    file = file_name;
+    frames.clear();
+    pending_ticks.store(0, std::memory_order_relaxed);
+    stopping = false;
+    sampler = std::thread{&SamplingProfiler::sampler_loop, this};
+}
+
+void SamplingProfiler::stop() {
+    if(!sampler.joinable())
+        return;
+    {
+        std::lock_guard lock{sampler_mutex};
+        stopping = true;
+    }
+    sampler_wakeup.notify_one();
+    sampler.join();
+    //тики после последнего вызова относятся к корню
+    if(pending_ticks.load(std::memory_order_relaxed) != 0)
+        take_sample();
+}
+
+void SamplingProfiler::clear() {
+    stacks.clear();
+    samples = 0;
+}
+
+void SamplingProfiler::sampler_loop() {
+    std::unique_lock lock{sampler_mutex};
+    auto next = std::chrono::steady_clock::now() + interval;
+    while(!sampler_wakeup.wait_until(lock, next, [this]{ return stopping; })){
+        pending_ticks.fetch_add(1, std::memory_order_relaxed);
+        next += interval;
+    }
+}
+
+void SamplingProfiler::take_sample() {
+    auto ticks = pending_ticks.exchange(0, std::memory_order_relaxed);
+    if(ticks == 0)
+        return;
+    std::string stack = file;
+    for(auto&& current : frames){
+        stack += ';';
+        stack += *current.name;
+        if(current.builtin){
+            stack += " (builtin)";
+            continue;
+        }
+        if(auto location = current.node->location(); location.known())
+            stack += std::format(" ({}:{}:{})", file, location.line, location.column);
+    }
+    stacks[stack] += ticks;
+    samples += ticks;
+}
+
+std::uint64_t SamplingProfiler::get_samples() const {
+    return samples;
+}
+
+void SamplingProfiler::write_collapsed(std::ostream &out) const {
+    std::vector<std::pair<std::string, std::uint64_t>> sorted{stacks.begin(), stacks.end()};
+    std::sort(sorted.begin(), sorted.end());
+    for(auto&& [stack, count] : sorted)
+        out << stack << ' ' << count << '\n';
+    out.flush();
+}
@@ -0,0 +1,109 @@
+#ifndef LISPKIT_COMPILER_SAMPLING_PROFILER_HPP
+#define LISPKIT_COMPILER_SAMPLING_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "AST.hpp"
+
+namespace yy {
+
+/**
+ * Sampling profiler for the tree-walking interpreter.
+ *
+ * The interpreter keeps a shadow stack of LispKit calls (push/pop around
+ * every builtin and user function). A background thread only counts
+ * ticks; the interpreter thread notices them at the next push or pop and
+ * records its shadow stack with the number of ticks as the weight, so the
+ * stack is never read from another thread.
+ *
+ * write_collapsed() prints one "file;FRAME;FRAME count" line per distinct
+ * stack, the input format of flamegraph.pl, inferno and speedscope.
+ * Builtins are marked with " (builtin)", user functions with the
+ * file:line:col of the call when the call form has a source location.
+ */
+class SamplingProfiler {
+public:
+    explicit SamplingProfiler(std::chrono::microseconds interval = std::chrono::microseconds{1000});
+    ~SamplingProfiler();
+
+    SamplingProfiler(const SamplingProfiler&) = delete;
+    SamplingProfiler& operator=(const SamplingProfiler&) = delete;
+
+    void set_interval(std::chrono::microseconds new_interval);
+
+    // the file name is the root frame of every stack,
+    // samples of several runs are accumulated until clear()
+    void start(const std::string& file_name);
+    void stop();
+    void clear();
+
+    inline void push(const std::string& name, bool builtin, const AST_node& node) {
+        if(pending_ticks.load(std::memory_order_relaxed) != 0)
+            take_sample();
+        frames.push_back({&name, builtin, &node});
+    }
+
+    inline void pop() {
+        if(pending_ticks.load(std::memory_order_relaxed) != 0)
+            take_sample();
+        frames.pop_back();
+    }
+
+    std::uint64_t get_samples() const;
+
+    void write_collapsed(std::ostream& out) const;
+
+    // pops the frame pushed in the constructor, also when an error unwinds the call
+    class frame_scope {
+    public:
+        frame_scope(SamplingProfiler* profiler, const std::string& name, bool builtin, const AST_node& node) :
+                profiler(profiler)
+        {
+            if(profiler)
+                profiler->push(name, builtin, node);
+        }
+        ~frame_scope() {
+            if(profiler)
+                profiler->pop();
+        }
+        frame_scope(const frame_scope&) = delete;
+        frame_scope& operator=(const frame_scope&) = delete;
+    private:
+        SamplingProfiler* profiler;
+    };
+
+private:
+    struct frame {
+        const std::string* name;
+        bool builtin;
+        const AST_node* node;
+    };
+
+    void take_sample();
+    void sampler_loop();
+
+    std::vector<frame> frames;
+    std::string file;
+    std::unordered_map<std::string, std::uint64_t> stacks;
+    std::uint64_t samples = 0;
+
+    std::chrono::microseconds interval;
+    std::atomic<std::uint64_t> pending_ticks{0};
+    std::thread sampler;
+    std::mutex sampler_mutex;
+    std::condition_variable sampler_wakeup;
+    bool stopping = false;
+};
+
+}
+
+#endif //LISPKIT_COMPILER_SAMPLING_PROFILER_HPP
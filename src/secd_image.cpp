@@ -0,0 +1,278 @@
+#include "secd_image.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <format>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LISPKIT_HAS_MMAP 1
+#endif
+
+#include "hash.hpp"
+
+using namespace yy;
+
+namespace {
+    enum tag : std::uint32_t{
+        tag_symbol = 0,
+        tag_constant = 1,
+        tag_list = 2,
+        tag_small = 3
+    };
+    constexpr int tag_shift = 30;
+    constexpr std::uint32_t payload_mask = (1u << tag_shift) - 1;
+    constexpr std::int64_t small_min = -(std::int64_t{1} << (tag_shift - 1));
+    constexpr std::int64_t small_max = (std::int64_t{1} << (tag_shift - 1)) - 1;
+    constexpr std::uint32_t big_constant_flag = 1u << (tag_shift - 1);
+
+    std::uint32_t make_word(tag t, std::uint32_t payload){
+        if(payload > payload_mask)
+            throw std::runtime_error{"SECD image: program is too large"};
+        return (static_cast<std::uint32_t>(t) << tag_shift) | payload;
+    }
+
+    std::uint32_t align8(std::size_t size){
+        return static_cast<std::uint32_t>((size + 7) & ~std::size_t{7});
+    }
+
+    struct encoder{
+        std::vector<std::uint32_t> code;
+        std::vector<std::int64_t> constants;
+        std::vector<std::uint32_t> symbols; // offset, length pairs
+        std::vector<std::uint32_t> big_constants; // offset, length pairs
+        std::string strings;
+        std::unordered_map<std::string, std::uint32_t> symbol_index;
+
+        std::uint32_t intern(const std::string& name){
+            auto find = symbol_index.find(name);
+            if(find != symbol_index.end())
+                return find->second;
+            auto index = static_cast<std::uint32_t>(symbols.size() / 2);
+            symbols.push_back(static_cast<std::uint32_t>(strings.size()));
+            symbols.push_back(static_cast<std::uint32_t>(name.size()));
+            strings += name;
+            symbol_index.insert({name, index});
+            return index;
+        }
+
+        void add(const AST_node& node){
+            if(node.is_string()){
+                code.push_back(make_word(tag_symbol, intern(node.to_string())));
+            }
+            else if(node.is_big()){
+                auto text = node.to_big().to_string();
+                auto index = static_cast<std::uint32_t>(big_constants.size() / 2);
+                if(index >= big_constant_flag)
+                    throw std::runtime_error{"SECD image: program is too large"};
+                code.push_back(make_word(tag_constant, index | big_constant_flag));
+                big_constants.push_back(static_cast<std::uint32_t>(strings.size()));
+                big_constants.push_back(static_cast<std::uint32_t>(text.size()));
+                strings += text;
+            }
+            else if(node.is_num()){
+                auto num = node.to_num();
+                if(num >= small_min && num <= small_max){
+                    code.push_back(make_word(tag_small, static_cast<std::uint32_t>(num) & payload_mask));
+                }
+                else{
+                    if(constants.size() >= big_constant_flag)
+                        throw std::runtime_error{"SECD image: program is too large"};
+                    code.push_back(make_word(tag_constant, static_cast<std::uint32_t>(constants.size())));
+                    constants.push_back(num);
+                }
+            }
+            else{
+                auto&& list = node.to_list();
+                code.push_back(make_word(tag_list, static_cast<std::uint32_t>(list.size())));
+                for(auto&& elem : list)
+                    add(elem);
+            }
+        }
+    };
+
+    struct decoder{
+        const std::uint32_t* code;
+        std::size_t code_count;
+        const std::int64_t* constants;
+        std::size_t constants_count;
+        const std::uint32_t* symbols;
+        std::size_t symbols_count;
+        const char* strings;
+        std::size_t strings_size;
+        const std::uint32_t* big_constants;
+        std::size_t big_constants_count;
+        std::size_t position = 0;
+
+        std::string_view text(std::uint32_t offset, std::uint32_t length){
+            if(std::size_t{offset} + length > strings_size)
+                throw std::runtime_error{"SECD image: bad string"};
+            return {strings + offset, length};
+        }
+
+        std::uint32_t next(){
+            if(position >= code_count)
+                throw std::runtime_error{"SECD image: code section is truncated"};
+            return code[position++];
+        }
+
+        AST_node read(){
+            auto word = next();
+            auto payload = word & payload_mask;
+            switch(static_cast<tag>(word >> tag_shift)){
+                case tag_symbol: {
+                    if(payload >= symbols_count)
+                        throw std::runtime_error{"SECD image: bad symbol index"};
+                    return AST_node{std::string{text(symbols[payload * 2], symbols[payload * 2 + 1])}};
+                }
+                case tag_constant:
+                    if(payload & big_constant_flag){
+                        auto index = payload & ~big_constant_flag;
+                        if(index >= big_constants_count)
+                            throw std::runtime_error{"SECD image: bad constant index"};
+                        try{
+                            return AST_node{big_int{text(big_constants[index * 2], big_constants[index * 2 + 1])}};
+                        }
+                        catch(const std::invalid_argument&){
+                            throw std::runtime_error{"SECD image: bad big constant"};
+                        }
+                    }
+                    if(payload >= constants_count)
+                        throw std::runtime_error{"SECD image: bad constant index"};
+                    return AST_node{constants[payload]};
+                case tag_small: {
+                    // sign extension of the 30 bit payload
+                    auto num = static_cast<std::int32_t>(payload << (32 - tag_shift)) >> (32 - tag_shift);
+                    return AST_node{static_cast<AST_node::num_t>(num)};
+                }
+                case tag_list: {
+                    AST_node node{};
+                    auto&& list = node.to_list();
+                    for(std::uint32_t i = 0; i < payload; i++)
+                        list.push_back(read());
+                    return node;
+                }
+            }
+            throw std::runtime_error{"SECD image: bad code word"};
+        }
+    };
+
+    void check_section(const image::section& s, std::size_t element_size, std::size_t total){
+        if(s.offset % 8 != 0 || std::size_t{s.offset} + std::size_t{s.count} * element_size > total)
+            throw std::runtime_error{"SECD image: section is out of bounds"};
+    }
+}
+
+std::string image::encode(const AST_node &program) {
+    encoder enc;
+    enc.add(program);
+
+    header head{};
+    std::memcpy(head.magic, image::magic, sizeof(head.magic));
+    head.version = image::version;
+    head.byte_order = image::byte_order_tag;
+
+    std::uint32_t offset = align8(sizeof(header));
+    head.code = {offset, static_cast<std::uint32_t>(enc.code.size())};
+    offset = align8(offset + enc.code.size() * sizeof(std::uint32_t));
+    head.constants = {offset, static_cast<std::uint32_t>(enc.constants.size())};
+    offset = align8(offset + enc.constants.size() * sizeof(std::int64_t));
+    head.symbols = {offset, static_cast<std::uint32_t>(enc.symbols.size() / 2)};
+    offset = align8(offset + enc.symbols.size() * sizeof(std::uint32_t));
+    head.big_constants = {offset, static_cast<std::uint32_t>(enc.big_constants.size() / 2)};
+    offset = align8(offset + enc.big_constants.size() * sizeof(std::uint32_t));
+    head.strings = {offset, static_cast<std::uint32_t>(enc.strings.size())};
+    offset = align8(offset + enc.strings.size());
+
+    std::string bytes(offset, '\0');
+    std::memcpy(bytes.data() + head.code.offset, enc.code.data(), enc.code.size() * sizeof(std::uint32_t));
+    std::memcpy(bytes.data() + head.constants.offset, enc.constants.data(), enc.constants.size() * sizeof(std::int64_t));
+    std::memcpy(bytes.data() + head.symbols.offset, enc.symbols.data(), enc.symbols.size() * sizeof(std::uint32_t));
+    std::memcpy(bytes.data() + head.big_constants.offset, enc.big_constants.data(), enc.big_constants.size() * sizeof(std::uint32_t));
+    std::memcpy(bytes.data() + head.strings.offset, enc.strings.data(), enc.strings.size());
+
+    head.checksum = hashing::fnv1a(bytes.data() + sizeof(header), bytes.size() - sizeof(header));
+    std::memcpy(bytes.data(), &head, sizeof(header));
+    return bytes;
+}
+
+AST_node image::decode(std::string_view bytes) {
+    if(bytes.size() < sizeof(header))
+        throw std::runtime_error{"SECD image: file is too short"};
+    header head;
+    std::memcpy(&head, bytes.data(), sizeof(header));
+    if(std::memcmp(head.magic, image::magic, sizeof(head.magic)) != 0)
+        throw std::runtime_error{"SECD image: not an image file"};
+    if(head.byte_order != image::byte_order_tag)
+        throw std::runtime_error{"SECD image: byte order mismatch"};
+    if(head.version == 0 || head.version > image::version)
+        throw std::runtime_error{std::format("SECD image: unsupported version {}", head.version)};
+    auto checksum = hashing::fnv1a(bytes.data() + sizeof(header), bytes.size() - sizeof(header));
+    if(checksum != head.checksum)
+        throw std::runtime_error{"SECD image: checksum mismatch"};
+
+    check_section(head.code, sizeof(std::uint32_t), bytes.size());
+    check_section(head.constants, sizeof(std::int64_t), bytes.size());
+    check_section(head.symbols, 2 * sizeof(std::uint32_t), bytes.size());
+    check_section(head.strings, 1, bytes.size());
+    check_section(head.big_constants, 2 * sizeof(std::uint32_t), bytes.size());
+
+    // секции выровнены по 8 байт, поэтому читаем прямо из отображенной памяти
+    decoder dec{
+        reinterpret_cast<const std::uint32_t*>(bytes.data() + head.code.offset), head.code.count,
+        reinterpret_cast<const std::int64_t*>(bytes.data() + head.constants.offset), head.constants.count,
+        reinterpret_cast<const std::uint32_t*>(bytes.data() + head.symbols.offset), head.symbols.count,
+        bytes.data() + head.strings.offset, head.strings.count,
+        reinterpret_cast<const std::uint32_t*>(bytes.data() + head.big_constants.offset), head.big_constants.count
+    };
+    auto program = dec.read();
+    if(dec.position != dec.code_count)
+        throw std::runtime_error{"SECD image: trailing data in code section"};
+    return program;
+}
+
+AST_node image::load(const std::filesystem::path &path) {
+#ifdef LISPKIT_HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error{std::format("SECD image: cannot open {}", path.string())};
+    struct stat info{};
+    if(::fstat(fd, &info) != 0 || info.st_size == 0){
+        ::close(fd);
+        throw std::runtime_error{std::format("SECD image: cannot read {}", path.string())};
+    }
+    auto size = static_cast<std::size_t>(info.st_size);
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED)
+        throw std::runtime_error{std::format("SECD image: cannot map {}", path.string())};
+    try{
+        auto program = decode(std::string_view{static_cast<const char*>(mapped), size});
+        ::munmap(mapped, size);
+        return program;
+    }
+    catch(...){
+        ::munmap(mapped, size);
+        throw;
+    }
+#else
+    std::ifstream in{path, std::ios::binary};
+    if(!in)
+        throw std::runtime_error{std::format("SECD image: cannot open {}", path.string())};
+    std::string bytes{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+    return decode(bytes);
+#endif
+}
+
+void image::save(const std::filesystem::path &path, const AST_node &program) {
+    auto bytes = encode(program);
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    if(!out.write(bytes.data(), static_cast<std::streamsize>(bytes.size())))
+        throw std::runtime_error{std::format("SECD image: cannot write {}", path.string())};
+}
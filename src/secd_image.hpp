@@ -0,0 +1,73 @@
+#ifndef LISPKIT_COMPILER_SECD_IMAGE_HPP
+#define LISPKIT_COMPILER_SECD_IMAGE_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <filesystem>
+
+#include "AST.hpp"
+
+namespace yy {
+
+/**
+ * Binary image of a compiled SECD program, so that precompiled programs
+ * can be loaded without the Flex/Bison front end.
+ *
+ * Layout (native byte order, every section 8 byte aligned):
+ *   header    - magic, version, byte order tag, checksum, section table
+ *   code      - uint32 words, the program tree in prefix order
+ *   constants - int64 pool for numbers that do not fit in a code word
+ *   symbols   - {offset, length} pairs into the string data
+ *   big       - {offset, length} pairs, decimal text of big_int constants
+ *   strings   - symbol names and big numbers, not null terminated
+ *
+ * Code word: top 2 bits are the tag, the rest is the payload
+ *   symbol   - index in the symbol table
+ *   constant - index in the constant pool, with big_constant_flag
+ *              set - index in the big_int table
+ *   list     - number of elements, the elements follow
+ *   small    - signed 30 bit number stored inline
+ *
+ * The checksum is FNV-1a over everything after the header.
+ */
+namespace image{
+    constexpr char magic[8] = {'L', 'K', 'S', 'E', 'C', 'D', 0, 0};
+    // version 2 added the big_int table, version 1 images are still accepted
+    constexpr std::uint32_t version = 2;
+    constexpr std::uint32_t byte_order_tag = 0x01020304;
+
+    struct section{
+        std::uint32_t offset;
+        std::uint32_t count;
+    };
+
+    struct header{
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        std::uint64_t checksum;
+        section code;
+        section constants;
+        section symbols;
+        section strings;     // count is the size in bytes
+        section big_constants;
+    };
+
+    std::string encode(const AST_node& program);
+
+    /**
+     * Throws std::runtime_error on bad magic, version, byte order,
+     * checksum or a truncated image.
+     */
+    AST_node decode(std::string_view bytes);
+
+    // the file is mapped into memory and decoded in place
+    AST_node load(const std::filesystem::path& path);
+
+    void save(const std::filesystem::path& path, const AST_node& program);
+}
+
+}
+
+#endif //LISPKIT_COMPILER_SECD_IMAGE_HPP
@@ -0,0 +1,564 @@
+#include "secd_jit.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <string_view>
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#include <sys/mman.h>
+#define LISPKIT_HAS_JIT 1
+#endif
+
+using namespace yy;
+
+namespace {
+    constexpr std::size_t max_parameters = 16;
+    constexpr std::size_t native_stack_budget = 2 * 1024 * 1024;
+    constexpr std::uint64_t max_bailouts = 16;
+
+    const void* code_identity(const AST_node& code) {
+        if(!code.is_list())
+            return nullptr;
+        return std::get<AST_node::list_ptr>(code.value).get();
+    }
+
+    bool is_self(const AST_node& value, const void* identity) {
+        if(!value.is_list())
+            return false;
+        auto&& closure = value.to_list();
+        return closure.size() == 2 && code_identity(closure.front()) == identity;
+    }
+
+#ifdef LISPKIT_HAS_JIT
+    // общий для всех кадров одного вызова из VM, смещения полей зашиты в код
+    struct jit_context {
+        std::int64_t fuel;
+        std::int64_t depth_left;
+        std::int64_t failed;
+        LimitGuard* guard;
+    };
+
+    using native_function = std::int64_t (*)(const std::int64_t* arguments, jit_context* context);
+
+    // called by the native code every check_interval calls
+    bool refuel(jit_context* context) {
+        try{
+            if(context->guard && !context->guard->charge(LimitGuard::check_interval))
+                return false;
+        }
+        catch(...){
+            return false; // исключение не должно пройти через кадры без таблиц раскрутки
+        }
+        context->fuel = LimitGuard::check_interval;
+        return true;
+    }
+
+    enum reg : std::uint8_t { rax = 0, rcx = 1, rdx = 2, rbx = 3, rdi = 7 };
+
+    // just the few x86-64 instructions the compiler below needs
+    class assembler {
+    public:
+        std::vector<std::uint8_t> code;
+
+        void emit(std::initializer_list<std::uint8_t> bytes) {
+            code.insert(code.end(), bytes);
+        }
+
+        void emit32(std::int32_t value) {
+            std::uint8_t bytes[4];
+            std::memcpy(bytes, &value, 4);
+            code.insert(code.end(), bytes, bytes + 4);
+        }
+
+        void emit64(std::int64_t value) {
+            std::uint8_t bytes[8];
+            std::memcpy(bytes, &value, 8);
+            code.insert(code.end(), bytes, bytes + 8);
+        }
+
+        // REX.W opcode [rbp + disp32]
+        void frame_operand(std::initializer_list<std::uint8_t> opcode, std::uint8_t reg, std::int32_t disp) {
+            code.push_back(0x48);
+            emit(opcode);
+            code.push_back(static_cast<std::uint8_t>(0x80 | (reg << 3) | 5));
+            emit32(disp);
+        }
+
+        // REX.W opcode [rbx + disp8], the context
+        void context_operand(std::initializer_list<std::uint8_t> opcode, std::uint8_t reg, std::size_t offset) {
+            code.push_back(0x48);
+            emit(opcode);
+            code.push_back(static_cast<std::uint8_t>(0x40 | (reg << 3) | rbx));
+            code.push_back(static_cast<std::uint8_t>(offset));
+        }
+
+        // opcode + rel32 to be bound later, returns the position of rel32
+        std::size_t jump(std::initializer_list<std::uint8_t> opcode) {
+            emit(opcode);
+            emit32(0);
+            return code.size() - 4;
+        }
+
+        void bind(std::size_t patch, std::size_t target) {
+            auto rel = static_cast<std::int32_t>(static_cast<std::int64_t>(target) - static_cast<std::int64_t>(patch + 4));
+            std::memcpy(code.data() + patch, &rel, 4);
+        }
+    };
+
+    const std::initializer_list<std::uint8_t> jz = {0x0F, 0x84};
+    const std::initializer_list<std::uint8_t> jnz = {0x0F, 0x85};
+    const std::initializer_list<std::uint8_t> jo = {0x0F, 0x80};
+    const std::initializer_list<std::uint8_t> jmp = {0xE9};
+
+    /**
+     * Compiles one closure body by abstract interpretation of the SECD
+     * stack: the kinds of the stack entries are known statically, every
+     * stack position has a slot in the native frame and, for argument
+     * lists being built there, a block of one slot per parameter. CONS
+     * puts the first argument of the list last in the block, so parameter
+     * i of a call is block[n - 1 - i].
+     */
+    class body_compiler {
+    public:
+        enum class kind : std::uint8_t { number, boolean, nil, self, arguments };
+
+        struct value {
+            kind type;
+            std::vector<SECDJit::parameter> elements;    // arguments: в порядке CONS
+
+            bool operator==(const value&) const = default;
+        };
+
+        explicit body_compiler(const std::vector<SECDJit::parameter>& signature) :
+                signature(signature),
+                block_size(static_cast<std::int32_t>(signature.size()))
+        {}
+
+        bool compile(const AST_node& body) {
+            prologue();
+            std::vector<value> stack;
+            //тело с RTS читает аргументы через LDS, его LD (0 j) - уже окружение замыкания
+            bool on_stack = body.is_list() && !body.to_list().empty() && body.to_list().back().is_string() &&
+                            body.to_list().back().to_string() == "RTS";
+            if(!sequence(body, stack, false, on_stack))
+                return false;
+            //выход с ошибкой: флаг для вызывающих кадров и VM
+            auto fail = out.code.size();
+            out.context_operand({0xC7}, 0, offsetof(jit_context, failed));
+            out.emit32(1);
+            epilogue();
+            for(auto patch : fail_jumps)
+                out.bind(patch, fail);
+            auto frame = static_cast<std::int32_t>(max_depth) * (block_size + 1) * 8;
+            frame = (frame + 15) & ~15;
+            std::memcpy(out.code.data() + frame_patch, &frame, 4);
+            frame_bytes = static_cast<std::size_t>(frame) + 32;
+            return true;
+        }
+
+        const std::vector<std::uint8_t>& get_code() const {
+            return out.code;
+        }
+
+        std::size_t get_frame_bytes() const {
+            return frame_bytes;
+        }
+
+    private:
+        // над rbp: адрес возврата, под ним сохраненные rbx и r12
+        std::int32_t region(std::size_t position) const {
+            return -16 - 8 * static_cast<std::int32_t>(position + 1) * (block_size + 1);
+        }
+
+        std::int32_t slot(std::size_t position) const {
+            return region(position) + 8 * block_size;
+        }
+
+        std::int32_t block(std::size_t position, std::size_t index) const {
+            return region(position) + 8 * static_cast<std::int32_t>(index);
+        }
+
+        void prologue() {
+            out.emit({0x55});                       // push rbp
+            out.emit({0x48, 0x89, 0xE5});           // mov rbp, rsp
+            out.emit({0x53});                       // push rbx
+            out.emit({0x41, 0x54});                 // push r12
+            out.emit({0x48, 0x81, 0xEC});           // sub rsp, frame
+            frame_patch = out.code.size();
+            out.emit32(0);
+            out.emit({0x49, 0x89, 0xFC});           // mov r12, rdi
+            out.emit({0x48, 0x89, 0xF3});           // mov rbx, rsi
+            out.context_operand({0xFF}, 1, offsetof(jit_context, depth_left));  // dec
+            fail_jumps.push_back(out.jump(jz));
+            out.context_operand({0xFF}, 1, offsetof(jit_context, fuel));        // dec
+            auto fueled = out.jump(jnz);
+            out.emit({0x48, 0x89, 0xDF});           // mov rdi, rbx
+            out.emit({0x48, 0xB8});                 // mov rax, refuel
+            out.emit64(reinterpret_cast<std::int64_t>(&refuel));
+            out.emit({0xFF, 0xD0});                 // call rax
+            out.emit({0x84, 0xC0});                 // test al, al
+            fail_jumps.push_back(out.jump(jz));
+            out.bind(fueled, out.code.size());
+        }
+
+        void epilogue() {
+            out.emit({0x48, 0x8D, 0x65, 0xF0});     // lea rsp, [rbp - 16]
+            out.emit({0x41, 0x5C});                 // pop r12
+            out.emit({0x5B});                       // pop rbx
+            out.emit({0x5D});                       // pop rbp
+            out.emit({0xC3});                       // ret
+        }
+
+        void push(std::vector<value>& stack, value entry) {
+            stack.push_back(std::move(entry));
+            max_depth = std::max(max_depth, stack.size());
+        }
+
+        static bool is_number(const std::vector<value>& stack, std::size_t count) {
+            if(stack.size() < count)
+                return false;
+            for(auto i = stack.size() - count; i < stack.size(); i++)
+                if(stack[i].type != kind::number)
+                    return false;
+            return true;
+        }
+
+        bool sequence(const AST_node& code, std::vector<value>& stack, bool branch, bool on_stack) {
+            if(!code.is_list())
+                return false;
+            auto&& list = code.to_list();
+            for(auto it = list.begin(); it != list.end(); ++it){
+                if(!it->is_string())
+                    return false;
+                //проверенные компилятором варианты (ADD_N, SEL_B) генерируются так же
+                auto command = std::string_view{it->to_string()};
+                if(command.ends_with("_N") || command.ends_with("_B"))
+                    command.remove_suffix(2);
+                auto operand = [&]() -> const AST_node* {
+                    auto next = std::next(it);
+                    if(next == list.end())
+                        return nullptr;
+                    it = next;
+                    return &*it;
+                };
+                auto top = stack.size() - 1;
+                if(command == "LD" || command == "LDS"){
+                    //аргумент j - это LDS j в теле с RTS и LD (0 j) в теле с RTN
+                    auto index = operand();
+                    if(!index || (command == "LDS") != on_stack)
+                        return false;
+                    if(command == "LD"){
+                        if(!index->is_list() || index->to_list().size() != 2)
+                            return false;
+                        auto&& pair = index->to_list();
+                        if(!pair.front().is_num() || !pair.back().is_num() || pair.front().to_num() != 0)
+                            return false;
+                        index = &pair.back();
+                    }
+                    else if(!index->is_num())
+                        return false;
+                    auto j = index->to_num();
+                    if(j < 0 || static_cast<std::size_t>(j) >= signature.size())
+                        return false;
+                    if(signature[j] == SECDJit::parameter::self){
+                        push(stack, {kind::self, {}});
+                        continue;
+                    }
+                    // mov rax, [r12 + 8 * (n - 1 - j)]
+                    out.emit({0x49, 0x8B, 0x84, 0x24});
+                    out.emit32(8 * static_cast<std::int32_t>(signature.size() - 1 - j));
+                    push(stack, {kind::number, {}});
+                    out.frame_operand({0x89}, rax, slot(stack.size() - 1));
+                }
+                else if(command == "LDC"){
+                    auto constant = operand();
+                    if(!constant)
+                        return false;
+                    if(constant->is_list() && constant->to_list().empty()){
+                        push(stack, {kind::nil, {}});
+                        continue;
+                    }
+                    if(!constant->is_num())
+                        return false;
+                    auto number = constant->to_num();
+                    push(stack, {kind::number, {}});
+                    if(number >= std::numeric_limits<std::int32_t>::min() && number <= std::numeric_limits<std::int32_t>::max()){
+                        out.frame_operand({0xC7}, 0, slot(stack.size() - 1));
+                        out.emit32(static_cast<std::int32_t>(number));
+                    }
+                    else{
+                        out.emit({0x48, 0xB8});
+                        out.emit64(number);
+                        out.frame_operand({0x89}, rax, slot(stack.size() - 1));
+                    }
+                }
+                else if(command == "ADD" || command == "SUB" || command == "MUL"){
+                    if(!is_number(stack, 2))
+                        return false;
+                    out.frame_operand({0x8B}, rax, slot(top - 1));
+                    if(command == "ADD")
+                        out.frame_operand({0x03}, rax, slot(top));
+                    else if(command == "SUB")
+                        out.frame_operand({0x2B}, rax, slot(top));
+                    else
+                        out.frame_operand({0x0F, 0xAF}, rax, slot(top));
+                    //переполнение - VM перейдет на big_int
+                    fail_jumps.push_back(out.jump(jo));
+                    out.frame_operand({0x89}, rax, slot(top - 1));
+                    stack.pop_back();
+                }
+                else if(command == "DIVE" || command == "REM"){
+                    if(!is_number(stack, 2))
+                        return false;
+                    //ноль и -1 отдаем VM: ошибка и особый случай min / -1
+                    out.frame_operand({0x8B}, rcx, slot(top));
+                    out.emit({0x48, 0x85, 0xC9});           // test rcx, rcx
+                    fail_jumps.push_back(out.jump(jz));
+                    out.emit({0x48, 0x83, 0xF9, 0xFF});     // cmp rcx, -1
+                    fail_jumps.push_back(out.jump(jz));
+                    out.frame_operand({0x8B}, rax, slot(top - 1));
+                    out.emit({0x48, 0x99});                 // cqo
+                    out.emit({0x48, 0xF7, 0xF9});           // idiv rcx
+                    out.frame_operand({0x89}, command == "DIVE" ? rax : rdx, slot(top - 1));
+                    stack.pop_back();
+                }
+                else if(command == "LEQ" || command == "EQ"){
+                    if(!is_number(stack, 2))
+                        return false;
+                    out.frame_operand({0x8B}, rax, slot(top - 1));
+                    out.frame_operand({0x3B}, rax, slot(top));                  // cmp
+                    if(command == "LEQ")
+                        out.emit({0x0F, 0x9E, 0xC0});       // setle al
+                    else
+                        out.emit({0x0F, 0x94, 0xC0});       // sete al
+                    out.emit({0x0F, 0xB6, 0xC0});           // movzx eax, al
+                    out.frame_operand({0x89}, rax, slot(top - 1));
+                    stack.pop_back();
+                    stack.back().type = kind::boolean;
+                }
+                else if(command == "CONS"){
+                    if(stack.size() < 2)
+                        return false;
+                    auto&& element = stack[top];
+                    auto&& list = stack[top - 1];
+                    if(element.type != kind::number && element.type != kind::self)
+                        return false;
+                    if(list.type != kind::nil && list.type != kind::arguments)
+                        return false;
+                    if(list.elements.size() >= signature.size())
+                        return false;
+                    if(element.type == kind::number){
+                        out.frame_operand({0x8B}, rax, slot(top));
+                        out.frame_operand({0x89}, rax, block(top - 1, list.elements.size()));
+                    }
+                    list.type = kind::arguments;
+                    list.elements.push_back(element.type == kind::number ? SECDJit::parameter::number : SECDJit::parameter::self);
+                    stack.pop_back();
+                }
+                else if(command == "AP"){
+                    if(stack.size() < 2 || stack[top].type != kind::self)
+                        return false;
+                    auto&& arguments = stack[top - 1];
+                    if(arguments.type != kind::arguments && !(arguments.type == kind::nil && signature.empty()))
+                        return false;
+                    if(arguments.elements.size() != signature.size())
+                        return false;
+                    for(std::size_t i = 0; i < signature.size(); i++)
+                        if(arguments.elements[signature.size() - 1 - i] != signature[i])
+                            return false;
+                    out.frame_operand({0x8D}, rdi, block(top - 1, 0));      // lea
+                    out.emit({0x48, 0x89, 0xDE});           // mov rsi, rbx
+                    out.bind(out.jump({0xE8}), 0);          // call самого себя
+                    out.context_operand({0x83}, 7, offsetof(jit_context, failed));   // cmp ..., 0
+                    out.emit({0x00});
+                    fail_jumps.push_back(out.jump(jnz));
+                    out.frame_operand({0x89}, rax, slot(top - 1));
+                    stack.pop_back();
+                    stack.back() = {kind::number, {}};
+                }
+                else if(command == "SEL"){
+                    auto true_branch = operand();
+                    auto false_branch = operand();
+                    if(!true_branch || !false_branch || stack.empty() || stack.back().type != kind::boolean)
+                        return false;
+                    out.frame_operand({0x83}, 7, slot(top));                    // cmp ..., 0
+                    out.emit({0x00});
+                    stack.pop_back();
+                    auto to_false = out.jump(jz);
+                    auto true_stack = stack;
+                    if(!sequence(*true_branch, true_stack, true, on_stack))
+                        return false;
+                    auto to_end = out.jump(jmp);
+                    out.bind(to_false, out.code.size());
+                    if(!sequence(*false_branch, stack, true, on_stack))
+                        return false;
+                    out.bind(to_end, out.code.size());
+                    //после JOIN стек VM один и тот же, какая бы ветка ни выполнилась
+                    if(true_stack != stack)
+                        return false;
+                }
+                else if(command == "JOIN"){
+                    return branch && std::next(it) == list.end();
+                }
+                else if(command == "RTN" || command == "RTS"){
+                    if(branch || (command == "RTS") != on_stack || std::next(it) != list.end() || stack.size() != 1 || stack.back().type != kind::number)
+                        return false;
+                    out.frame_operand({0x8B}, rax, slot(0));
+                    out.context_operand({0xFF}, 0, offsetof(jit_context, depth_left));  // inc
+                    epilogue();
+                    return true;
+                }
+                else{
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        const std::vector<SECDJit::parameter>& signature;
+        std::int32_t block_size;
+        assembler out;
+        std::vector<std::size_t> fail_jumps;
+        std::size_t frame_patch = 0;
+        std::size_t max_depth = 1;
+        std::size_t frame_bytes = 0;
+    };
+#endif
+}
+
+bool SECDJit::available() {
+#ifdef LISPKIT_HAS_JIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+SECDJit::~SECDJit() {
+    for(auto&& [identity, target] : entries)
+        release(target.native);
+}
+
+bool SECDJit::try_call(const AST_node& code, const AST_node& arguments, LimitGuard* guard, AST_node& result) {
+#ifdef LISPKIT_HAS_JIT
+    auto identity = code_identity(code);
+    if(!identity)
+        return false;
+    auto [it, inserted] = entries.try_emplace(identity);
+    auto&& target = it->second;
+    if(inserted)
+        target.code = code;
+    if(target.given_up)
+        return false;
+    if(!target.native.memory){
+        if(++target.calls < threshold)
+            return false;
+        if(!compile(target, arguments)){
+            target.given_up = true;
+            stats.rejected++;
+            return false;
+        }
+        stats.compiled++;
+    }
+    std::int64_t values[max_parameters];
+    if(!bind_arguments(target, arguments, values))
+        return false;
+    jit_context context{};
+    context.fuel = guard ? static_cast<std::int64_t>(LimitGuard::check_interval) : std::numeric_limits<std::int64_t>::max();
+    context.depth_left = static_cast<std::int64_t>(native_stack_budget / target.native.frame_bytes);
+    context.guard = guard;
+    auto function = reinterpret_cast<native_function>(target.native.memory);
+    auto value = function(values, &context);
+    if(context.failed){
+        stats.bailouts++;
+        if(++target.bailouts >= max_bailouts)
+            target.given_up = true;
+        return false;
+    }
+    stats.native_calls++;
+    result = AST_node{value};
+    return true;
+#else
+    (void)code;
+    (void)arguments;
+    (void)guard;
+    (void)result;
+    return false;
+#endif
+}
+
+const SECDJit::statistics &SECDJit::get_statistics() const {
+    return stats;
+}
+
+bool SECDJit::compile(entry& target, const AST_node& arguments) {
+#ifdef LISPKIT_HAS_JIT
+    if(!arguments.is_list())
+        return false;
+    auto&& list = arguments.to_list();
+    if(list.size() > max_parameters)
+        return false;
+    auto identity = code_identity(target.code);
+    for(auto&& argument : list){
+        if(argument.is_num())
+            target.signature.push_back(parameter::number);
+        else if(is_self(argument, identity))
+            target.signature.push_back(parameter::self);
+        else
+            return false;
+    }
+    body_compiler compiler{target.signature};
+    if(!compiler.compile(target.code))
+        return false;
+    auto&& code = compiler.get_code();
+    auto memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if(memory == MAP_FAILED)
+        return false;
+    std::memcpy(memory, code.data(), code.size());
+    if(mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0){
+        munmap(memory, code.size());
+        return false;
+    }
+    target.native = {memory, code.size(), compiler.get_frame_bytes()};
+    return true;
+#else
+    (void)target;
+    (void)arguments;
+    return false;
+#endif
+}
+
+bool SECDJit::bind_arguments(const entry& target, const AST_node& arguments, std::int64_t* values) const {
+    if(!arguments.is_list())
+        return false;
+    auto&& list = arguments.to_list();
+    auto count = target.signature.size();
+    if(list.size() != count)
+        return false;
+    auto identity = code_identity(target.code);
+    std::size_t i = 0;
+    for(auto&& argument : list){
+        if(target.signature[i] == parameter::number){
+            if(!argument.is_num())
+                return false;
+            values[count - 1 - i] = argument.to_num();
+        }
+        else{
+            if(!is_self(argument, identity))
+                return false;
+            values[count - 1 - i] = 0;
+        }
+        i++;
+    }
+    return true;
+}
+
+void SECDJit::release(compiled_code& native) {
+#ifdef LISPKIT_HAS_JIT
+    if(native.memory)
+        munmap(native.memory, native.size);
+#endif
+    native = {};
+}
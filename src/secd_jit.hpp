@@ -0,0 +1,91 @@
+#ifndef LISPKIT_COMPILER_SECD_JIT_HPP
+#define LISPKIT_COMPILER_SECD_JIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "AST.hpp"
+#include "resource_limits.hpp"
+
+namespace yy {
+
+/**
+ * Native code for hot SECD closures, x86-64 only.
+ *
+ * execute_secd calls try_call() on every AP. A closure body is compiled
+ * after threshold calls with the kinds of the arguments of that call: each
+ * parameter is either a small number (num_t) or the closure itself, which
+ * is how the compiler passes a recursive function to its own body. The
+ * body may load its arguments (LD (0 i), or LDS i in a body that ends
+ * with RTS), number and () constants, the arithmetic and comparisons,
+ * SEL/JOIN, CONS of argument lists and AP of itself, and must return a
+ * number. Anything else - other closures, free variables, lists as
+ * values - leaves the closure to the VM.
+ *
+ * The native code never allocates. An overflow (the VM would switch to
+ * big_int), a division by zero or -1, a too deep recursion or a limit of
+ * the guard abandons the whole native call: try_call() returns false and
+ * the VM runs the AP itself, which repeats the same pure computation and
+ * reports errors as usual. A closure that keeps bailing out is given back
+ * to the VM for good.
+ */
+class SECDJit {
+public:
+    struct statistics {
+        std::uint64_t compiled = 0;      // closures with native code
+        std::uint64_t rejected = 0;      // hot closures outside the subset
+        std::uint64_t native_calls = 0;  // AP executed natively
+        std::uint64_t bailouts = 0;      // native calls given back to the VM
+    };
+
+    // the build has a code generator for this platform
+    static bool available();
+
+    SECDJit() = default;
+    ~SECDJit();
+    SECDJit(const SECDJit&) = delete;
+    SECDJit& operator=(const SECDJit&) = delete;
+
+    /**
+     * Run an AP natively if the closure code is compiled (or hot enough to
+     * be compiled now) and the arguments match its signature.
+     * \returns true with the result of the call, false if the VM must run it
+     */
+    bool try_call(const AST_node& code, const AST_node& arguments, LimitGuard* guard, AST_node& result);
+
+    const statistics& get_statistics() const;
+
+    std::uint64_t threshold = 64;
+
+    // kind of a parameter in the signature of the native code
+    enum class parameter : std::uint8_t { number, self };
+
+private:
+    struct compiled_code {
+        void* memory = nullptr;
+        std::size_t size = 0;
+        std::size_t frame_bytes = 0;
+    };
+
+    struct entry {
+        AST_node code;                    // держит хранилище, по адресу которого ищем
+        std::uint64_t calls = 0;
+        std::uint64_t bailouts = 0;
+        bool given_up = false;
+        std::vector<parameter> signature;
+        compiled_code native;
+    };
+
+    bool compile(entry& target, const AST_node& arguments);
+    bool bind_arguments(const entry& target, const AST_node& arguments, std::int64_t* values) const;
+    static void release(compiled_code& native);
+
+    std::unordered_map<const void*, entry> entries;
+    statistics stats;
+};
+
+}
+
+#endif //LISPKIT_COMPILER_SECD_JIT_HPP
@@ -0,0 +1,210 @@
+#include "secd_profile.hpp"
+
+#include <algorithm>
+#include <format>
+#include <iomanip>
+#include <tuple>
+#include <utility>
+
+using namespace yy;
+
+namespace {
+    const void* code_identity(const AST_node& code) {
+        if(!code.is_list())
+            return nullptr;
+        return std::get<AST_node::list_ptr>(code.value).get();
+    }
+
+    // в программе только идентификаторы и числа, экранировать нужно лишь на всякий случай
+    std::string json_string(const std::string& str) {
+        std::string quoted = "\"";
+        for(char c : str){
+            if(c == '"' || c == '\\')
+                quoted += '\\';
+            quoted += c;
+        }
+        return quoted + '"';
+    }
+}
+
+void SECDProfile::start(const AST_node &program, const std::string &file_name) {
+    file = file_name;
+    opcodes.clear();
+    closures.clear();
+    current = nullptr;
+    total_nanoseconds = total_allocations = total_allocated_bytes = 0;
+    instructions = 0;
+    max_stack_depth = max_dump_depth = 0;
+
+    //нумерация LDF в порядке обхода программы, без рекурсии
+    std::size_t sites = 0;
+    std::vector<std::pair<AST_node::AST_node_list::const_iterator, AST_node::AST_node_list::const_iterator>> pending;
+    if(program.is_list())
+        pending.emplace_back(program.to_list().begin(), program.to_list().end());
+    while(!pending.empty()){
+        auto& [it, end] = pending.back();
+        if(it == end){
+            pending.pop_back();
+            continue;
+        }
+        auto&& node = *it++;
+        if(node.is_string() && node.to_string() == "LDF" && it != end && it->is_list()){
+            auto&& entry = closures[code_identity(*it)];
+            if(entry.site == 0){
+                entry.site = ++sites;
+                describe_site(entry, *it);
+            }
+        }
+        else if(node.is_list()){
+            auto&& list = node.to_list();
+            pending.emplace_back(list.begin(), list.end());
+        }
+    }
+
+    run_start = current_start = clock_type::now();
+    run_allocations = current_allocations = alloc_stats::current();
+}
+
+void SECDProfile::charge_current() {
+    auto now = clock_type::now();
+    auto allocations = alloc_stats::current();
+    if(current != nullptr){
+        current->nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(now - current_start).count();
+        current->allocations += allocations.allocations - current_allocations.allocations;
+        current->allocated_bytes += allocations.allocated_bytes - current_allocations.allocated_bytes;
+    }
+    current_start = now;
+    current_allocations = allocations;
+}
+
+SECDProfile::opcode_statistics &SECDProfile::opcode_entry(const std::string &opcode) {
+    auto find = opcodes.find(opcode);
+    if(find != opcodes.end())
+        return find->second;
+    auto&& entry = opcodes[opcode];
+    entry.opcode = opcode;
+    return entry;
+}
+
+SECDProfile::closure_statistics &SECDProfile::closure_entry(const AST_node &code) {
+    auto&& entry = closures[code_identity(code)];
+    if(entry.site == 0){
+        // функция, которой не было в тексте программы
+        entry.site = closures.size();
+        describe_site(entry, code);
+    }
+    return entry;
+}
+
+void SECDProfile::describe_site(closure_statistics &entry, const AST_node &code) const {
+    entry.code = code.print_tree(3);
+    if(auto location = code.location(); location.known())
+        entry.location = std::format("{}:{}:{}", file, location.line, location.column);
+}
+
+void SECDProfile::closure_created(const AST_node &code) {
+    closure_entry(code).created++;
+}
+
+void SECDProfile::closure_called(const AST_node &code) {
+    closure_entry(code).calls++;
+}
+
+void SECDProfile::finish() {
+    charge_current();
+    current = nullptr;
+    auto allocations = alloc_stats::current();
+    total_nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - run_start).count();
+    total_allocations = allocations.allocations - run_allocations.allocations;
+    total_allocated_bytes = allocations.allocated_bytes - run_allocations.allocated_bytes;
+}
+
+std::uint64_t SECDProfile::get_instructions() const {
+    return instructions;
+}
+
+std::size_t SECDProfile::get_max_stack_depth() const {
+    return max_stack_depth;
+}
+
+std::size_t SECDProfile::get_max_dump_depth() const {
+    return max_dump_depth;
+}
+
+std::vector<SECDProfile::opcode_statistics> SECDProfile::get_opcodes() const {
+    std::vector<opcode_statistics> result;
+    for(auto&& [opcode, stats] : opcodes)
+        result.push_back(stats);
+    std::sort(result.begin(), result.end(), [](auto&& left, auto&& right){
+        return std::tie(right.nanoseconds, left.opcode) < std::tie(left.nanoseconds, right.opcode);
+    });
+    return result;
+}
+
+std::vector<SECDProfile::closure_statistics> SECDProfile::get_closures() const {
+    std::vector<closure_statistics> result;
+    for(auto&& [identity, stats] : closures)
+        result.push_back(stats);
+    std::sort(result.begin(), result.end(), [](auto&& left, auto&& right){
+        return std::tie(right.calls, left.site) < std::tie(left.calls, right.site);
+    });
+    return result;
+}
+
+void SECDProfile::report_text(std::ostream &out) const {
+    auto flags = out.flags();
+    auto precision = out.precision();
+    out << "SECD profile: " << instructions << " instructions, "
+        << std::fixed << std::setprecision(3) << static_cast<double>(total_nanoseconds) / 1e6 << " ms, "
+        << total_allocations << " allocations (" << total_allocated_bytes << " bytes)" << std::endl;
+    out << "max stack depth " << max_stack_depth << ", max dump depth " << max_dump_depth << std::endl;
+    out << std::left << std::setw(8) << "opcode" << std::right << std::setw(12) << "count"
+        << std::setw(12) << "time us" << std::setw(8) << "time %"
+        << std::setw(12) << "allocs" << std::setw(14) << "bytes" << std::endl;
+    for(auto&& stats : get_opcodes()){
+        auto share = total_nanoseconds == 0 ? 0.0 : 100.0 * static_cast<double>(stats.nanoseconds) / static_cast<double>(total_nanoseconds);
+        out << std::left << std::setw(8) << stats.opcode << std::right << std::setw(12) << stats.count
+            << std::setw(12) << std::setprecision(1) << static_cast<double>(stats.nanoseconds) / 1e3
+            << std::setw(8) << share
+            << std::setw(12) << stats.allocations << std::setw(14) << stats.allocated_bytes << std::endl;
+    }
+    out << "closures by LDF site:" << std::endl;
+    for(auto&& stats : get_closures()){
+        out << "  #" << stats.site;
+        if(!stats.location.empty())
+            out << " at " << stats.location;
+        out << ": " << stats.calls << " calls, " << stats.created << " created  " << stats.code << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void SECDProfile::report_json(std::ostream &out) const {
+    out << "{\"instructions\":" << instructions
+        << ",\"nanoseconds\":" << total_nanoseconds
+        << ",\"allocations\":" << total_allocations
+        << ",\"allocated_bytes\":" << total_allocated_bytes
+        << ",\"max_stack_depth\":" << max_stack_depth
+        << ",\"max_dump_depth\":" << max_dump_depth
+        << ",\"opcodes\":[";
+    bool first = true;
+    for(auto&& stats : get_opcodes()){
+        out << (first ? "" : ",") << "{\"opcode\":" << json_string(stats.opcode)
+            << ",\"count\":" << stats.count
+            << ",\"nanoseconds\":" << stats.nanoseconds
+            << ",\"allocations\":" << stats.allocations
+            << ",\"allocated_bytes\":" << stats.allocated_bytes << '}';
+        first = false;
+    }
+    out << "],\"closures\":[";
+    first = true;
+    for(auto&& stats : get_closures()){
+        out << (first ? "" : ",") << "{\"site\":" << stats.site
+            << ",\"calls\":" << stats.calls
+            << ",\"created\":" << stats.created
+            << ",\"location\":" << json_string(stats.location)
+            << ",\"code\":" << json_string(stats.code) << '}';
+        first = false;
+    }
+    out << "]}";
+}
@@ -0,0 +1,106 @@
+#ifndef LISPKIT_COMPILER_SECD_PROFILE_HPP
+#define LISPKIT_COMPILER_SECD_PROFILE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AST.hpp"
+#include "alloc_stats.hpp"
+
+namespace yy {
+
+/**
+ * Instruction level profile of one execute_secd run.
+ *
+ * The time and the allocations between two consecutive instructions are
+ * charged to the first one. Closures are identified by their LDF site:
+ * the code list of an LDF keeps its storage in every closure made from
+ * it, sites are numbered in prefix order of the program and carry the
+ * source location of the code list. With hash-consing identical function
+ * bodies share one site.
+ */
+class SECDProfile {
+public:
+    struct opcode_statistics {
+        std::string opcode;
+        std::uint64_t count = 0;
+        std::uint64_t nanoseconds = 0;
+        std::uint64_t allocations = 0;
+        std::uint64_t allocated_bytes = 0;
+    };
+
+    struct closure_statistics {
+        std::size_t site = 0;
+        std::string code;           // first levels of the function code
+        std::string location;       // file:line:col, empty if unknown
+        std::uint64_t created = 0;  // LDF executions
+        std::uint64_t calls = 0;    // AP executions, memoized ones included
+    };
+
+    // reset the counters and number LDF sites of the program
+    void start(const AST_node& program, const std::string& file_name);
+
+    inline void begin_instruction(const std::string& opcode, std::size_t stack_depth, std::size_t dump_depth) {
+        charge_current();
+        instructions++;
+        if(stack_depth > max_stack_depth)
+            max_stack_depth = stack_depth;
+        if(dump_depth > max_dump_depth)
+            max_dump_depth = dump_depth;
+        current = &opcode_entry(opcode);
+        current->count++;
+    }
+
+    void closure_created(const AST_node& code);
+
+    void closure_called(const AST_node& code);
+
+    // charge the last instruction, called once after the run
+    void finish();
+
+    std::uint64_t get_instructions() const;
+    std::size_t get_max_stack_depth() const;
+    std::size_t get_max_dump_depth() const;
+
+    // sorted by time, the most expensive first
+    std::vector<opcode_statistics> get_opcodes() const;
+    // sorted by calls
+    std::vector<closure_statistics> get_closures() const;
+
+    void report_text(std::ostream& out) const;
+    void report_json(std::ostream& out) const;
+
+private:
+    using clock_type = std::chrono::steady_clock;
+
+    void charge_current();
+
+    opcode_statistics& opcode_entry(const std::string& opcode);
+
+    closure_statistics& closure_entry(const AST_node& code);
+
+    void describe_site(closure_statistics& entry, const AST_node& code) const;
+
+    std::unordered_map<std::string, opcode_statistics> opcodes;
+    std::unordered_map<const void*, closure_statistics> closures;
+    std::string file;
+    opcode_statistics* current = nullptr;
+    clock_type::time_point current_start;
+    alloc_stats::counters current_allocations;
+    clock_type::time_point run_start;
+    alloc_stats::counters run_allocations;
+    std::uint64_t total_nanoseconds = 0;
+    std::uint64_t total_allocations = 0;
+    std::uint64_t total_allocated_bytes = 0;
+    std::uint64_t instructions = 0;
+    std::size_t max_stack_depth = 0;
+    std::size_t max_dump_depth = 0;
+};
+
+}
+
+#endif //LISPKIT_COMPILER_SECD_PROFILE_HPP